@@ -0,0 +1,224 @@
+#include "audio.h"
+#include "machine.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+
+const double PI = 3.14159265358979323846;
+// How long each one-shot sound lasts; the UFO loops instead
+const double SOUND_SECONDS[SOUNDS] = {0.0, 0.3, 1.2, 0.35, 0.6, 0.1, 0.1, 0.1, 0.1, 1.0};
+const double FLEET_HZ[4] = {62.0, 58.0, 55.0, 51.0};
+const uint8_t AMP_ENABLE = 0x20; // OUT 3 bit 5
+const std::size_t CHUNK = 256;
+const int WAV_HEADER_SIZE = 44;
+
+static double square(Voice &voice, double frequency) {
+	voice.phase += frequency / SAMPLE_RATE;
+	voice.phase -= std::floor(voice.phase);
+	return voice.phase < 0.5 ? 1.0 : -1.0;
+}
+
+// One sample of a playing sound, from -1 to 1
+static double soundSample(int sound, Voice &voice, double noise) {
+	double t = (double) voice.position / SAMPLE_RATE;
+	double fade = sound == SOUND_UFO ? 1.0 : 1.0 - t / SOUND_SECONDS[sound];
+	switch(sound) {
+		case SOUND_UFO:
+			return square(voice, 700.0 + 250.0 * std::sin(2.0 * PI * 8.0 * t)) * 0.15;
+		case SOUND_SHOT:
+			return (square(voice, 1500.0 - 4000.0 * t) * 0.5 + noise * 0.5) * fade * 0.25;
+		case SOUND_PLAYER_DEATH:
+			return noise * fade * fade * 0.4;
+		case SOUND_INVADER_DEATH:
+			return (square(voice, 400.0 - 800.0 * t) * 0.4 + noise * 0.6) * fade * 0.3;
+		case SOUND_EXTRA_LIFE:
+			return (int) (t * 10.0) % 2 == 0 ? square(voice, 1200.0) * 0.2 : 0.0;
+		case SOUND_FLEET_1:
+		case SOUND_FLEET_2:
+		case SOUND_FLEET_3:
+		case SOUND_FLEET_4:
+			return square(voice, FLEET_HZ[sound - SOUND_FLEET_1]) * fade * 0.4;
+		case SOUND_UFO_HIT:
+			return square(voice, 500.0 + 400.0 * std::sin(2.0 * PI * 12.0 * t)) * fade * 0.25;
+	}
+	return 0.0;
+}
+
+static int16_t nextSample(Synth &synth) {
+	synth.noise = (synth.noise >> 1) ^ (-(synth.noise & 1) & 0xb400); // Galois LFSR
+	double noise = (synth.noise & 1) ? 1.0 : -1.0;
+	double mix = 0.0;
+	for(int sound = 0; sound < SOUNDS; sound++) {
+		Voice &voice = synth.voices[sound];
+		if(!voice.playing) {
+			continue;
+		}
+		mix += soundSample(sound, voice, noise);
+		voice.position++;
+		if(sound != SOUND_UFO && voice.position >= SOUND_SECONDS[sound] * SAMPLE_RATE) {
+			voice.playing = false;
+		}
+	}
+	if(!(synth.port3 & AMP_ENABLE)) {
+		return 0;
+	}
+	mix = std::max(-1.0, std::min(1.0, mix));
+	return (int16_t) (mix * 32767.0);
+}
+
+static void trigger(Synth &synth, int sound) {
+	synth.voices[sound].playing = true;
+	synth.voices[sound].position = 0;
+	synth.voices[sound].phase = 0.0;
+}
+
+static void portChanged(Synth &synth, uint8_t port, uint8_t value) {
+	if(port == 3) {
+		uint8_t rising = value & ~synth.port3;
+		synth.voices[SOUND_UFO].playing = value & 0x01;
+		for(int bit = 1; bit < 5; bit++) {
+			if(rising & (1 << bit)) {
+				trigger(synth, SOUND_UFO + bit);
+			}
+		}
+		synth.port3 = value;
+	} else if(port == 5) {
+		uint8_t rising = value & ~synth.port5;
+		for(int bit = 0; bit < 5; bit++) {
+			if(rising & (1 << bit)) {
+				trigger(synth, SOUND_FLEET_1 + bit);
+			}
+		}
+		synth.port5 = value;
+	}
+}
+
+static void queue(Audio &audio, const SoundEvent &event) {
+	audio.dropped += 1 - audio.events.write(&event, 1);
+}
+
+void soundOut(Audio &audio, uint64_t cycle, uint8_t port, uint8_t value) {
+	queue(audio, {cycle, SoundEventType::Out, port, value, 0});
+}
+
+void generateAudio(Audio &audio, uint64_t cycle) {
+	queue(audio, {cycle, SoundEventType::Advance, 0, 0, 0});
+}
+
+void resetAudio(Audio &audio, uint64_t cycle, uint8_t port3, uint8_t port5) {
+	queue(audio, {cycle, SoundEventType::Reset, 0, port3, port5});
+}
+
+static void writeLittleEndian(FILE *file, uint32_t value, int bytes) {
+	for(int i = 0; i < bytes; i++) {
+		fputc((value >> (i * 8)) & 0xff, file);
+	}
+}
+
+static void writeWavHeader(FILE *file, uint32_t dataSize) {
+	fwrite("RIFF", 1, 4, file);
+	writeLittleEndian(file, WAV_HEADER_SIZE - 8 + dataSize, 4);
+	fwrite("WAVEfmt ", 1, 8, file);
+	writeLittleEndian(file, 16, 4); // fmt chunk size
+	writeLittleEndian(file, 1, 2); // PCM
+	writeLittleEndian(file, 1, 2); // Mono
+	writeLittleEndian(file, SAMPLE_RATE, 4);
+	writeLittleEndian(file, SAMPLE_RATE * 2, 4); // Bytes per second
+	writeLittleEndian(file, 2, 2); // Bytes per sample
+	writeLittleEndian(file, 16, 2); // Bits per sample
+	fwrite("data", 1, 4, file);
+	writeLittleEndian(file, dataSize, 4);
+}
+
+static void writeSamples(Audio &audio, const int16_t *samples, std::size_t count) {
+	uint8_t bytes[CHUNK * 2];
+	for(std::size_t i = 0; i < count; i++) {
+		bytes[i * 2] = (uint16_t) samples[i] & 0xff;
+		bytes[i * 2 + 1] = (uint16_t) samples[i] >> 8;
+	}
+	fwrite(bytes, 2, count, audio.file);
+	audio.written += count;
+}
+
+static void generateSamples(Audio &audio, uint64_t cycle) {
+	Synth &synth = audio.synth;
+	uint64_t end = cycle * SAMPLE_RATE / CPU_HZ;
+	int16_t buffer[CHUNK];
+	while(synth.samples < end) {
+		std::size_t count = (std::size_t) std::min<uint64_t>(CHUNK, end - synth.samples);
+		for(std::size_t i = 0; i < count; i++) {
+			buffer[i] = nextSample(synth);
+		}
+		synth.samples += count;
+		writeSamples(audio, buffer, count);
+	}
+}
+
+static void handleEvent(Audio &audio, const SoundEvent &event) {
+	Synth &synth = audio.synth;
+	switch(event.type) {
+		case SoundEventType::Advance:
+			generateSamples(audio, event.cycle);
+			break;
+		case SoundEventType::Out:
+			generateSamples(audio, event.cycle);
+			portChanged(synth, event.port, event.value);
+			break;
+		case SoundEventType::Reset:
+			for(Voice &voice : synth.voices) {
+				voice = Voice();
+			}
+			synth.voices[SOUND_UFO].playing = event.value & 0x01;
+			synth.port3 = event.value;
+			synth.port5 = event.value5;
+			synth.samples = event.cycle * SAMPLE_RATE / CPU_HZ;
+			break;
+	}
+}
+
+// Audio thread: handles events as they come until stopAudio() and the queue is empty
+static void runAudio(Audio *audio) {
+	SoundEvent events[256];
+	for(;;) {
+		bool running = audio->running.load(std::memory_order_acquire);
+		std::size_t count = audio->events.read(events, 256);
+		if(count == 0) {
+			if(!running) {
+				break;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			continue;
+		}
+		for(std::size_t i = 0; i < count; i++) {
+			handleEvent(*audio, events[i]);
+		}
+	}
+}
+
+void startAudio(Audio &audio, const std::string &fileName, AudioFormat format) {
+	audio.file = fopen(fileName.c_str(), "wb");
+	if(!audio.file) {
+		throw std::runtime_error("Could not open file!");
+	}
+	audio.format = format;
+	if(format == AudioFormat::Wav) {
+		writeWavHeader(audio.file, 0); // Sizes are filled in by stopAudio()
+	}
+	audio.running = true;
+	audio.output = std::thread(runAudio, &audio);
+}
+
+void stopAudio(Audio &audio) {
+	if(!audio.file) {
+		return;
+	}
+	audio.running.store(false, std::memory_order_release);
+	audio.output.join();
+	if(audio.format == AudioFormat::Wav && fseek(audio.file, 0, SEEK_SET) == 0) {
+		writeWavHeader(audio.file, (uint32_t) std::min<uint64_t>(audio.written * 2, 0xffffffff - WAV_HEADER_SIZE));
+	}
+	fclose(audio.file);
+	audio.file = nullptr;
+}
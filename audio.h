@@ -0,0 +1,94 @@
+#ifndef AUDIO_H
+#define AUDIO_H
+
+#include "ring.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+const int SAMPLE_RATE = 44100; // 16-bit mono
+
+// The sounds wired to the OUT 3 and OUT 5 bits of the Space Invaders sound board
+enum Sound {
+	SOUND_UFO, // OUT 3 bit 0, repeats for as long as the bit is set
+	SOUND_SHOT, // OUT 3 bit 1
+	SOUND_PLAYER_DEATH, // OUT 3 bit 2
+	SOUND_INVADER_DEATH, // OUT 3 bit 3
+	SOUND_EXTRA_LIFE, // OUT 3 bit 4 (bit 5 enables the amplifier)
+	SOUND_FLEET_1, // OUT 5 bits 0 - 3, the four notes of the invaders marching
+	SOUND_FLEET_2,
+	SOUND_FLEET_3,
+	SOUND_FLEET_4,
+	SOUND_UFO_HIT, // OUT 5 bit 4
+	SOUNDS
+};
+
+enum class AudioFormat {
+	Wav,
+	Raw // Headerless signed 16-bit little endian, e.g. for a pipe into aplay
+};
+
+// What the emulation thread tells the audio thread. Samples up to cycle are generated before
+// the event is applied.
+enum class SoundEventType : uint8_t {
+	Advance, // Emulated time has reached cycle
+	Out, // port was written with value
+	Reset // Jump to cycle with port3 = value and port5 = value5, e.g. after loading a save state
+};
+
+struct SoundEvent {
+	uint64_t cycle;
+	SoundEventType type;
+	uint8_t port;
+	uint8_t value;
+	uint8_t value5;
+};
+
+struct Voice {
+	bool playing = false;
+	uint32_t position = 0; // Samples since it was triggered
+	double phase = 0.0; // Oscillator position in cycles, 0 to 1
+};
+
+// The synthesizer state, owned by the audio thread
+struct Synth {
+	uint8_t port3 = 0x00;
+	uint8_t port5 = 0x00;
+	uint64_t samples = 0; // Generated since power on
+	Voice voices[SOUNDS];
+	uint16_t noise = 0xace1; // LFSR state
+};
+
+struct Audio {
+	// Emulation thread
+	uint64_t dropped = 0; // Events thrown away because the queue was full
+	// Shared with the audio thread
+	RingBuffer<SoundEvent> events{4096};
+	std::atomic<bool> running{false};
+	// Audio thread
+	std::thread output;
+	Synth synth;
+	FILE *file = nullptr;
+	AudioFormat format = AudioFormat::Wav;
+	uint64_t written = 0; // Samples written to file
+};
+
+// Opens the file and starts the audio thread, which synthesizes the sound from the events the
+// emulation thread queues and writes it out. None of the functions below ever block the
+// emulation thread: events that don't fit in the queue are counted in dropped.
+void startAudio(Audio &audio, const std::string &fileName, AudioFormat format);
+// Handles a write to port 3 or 5 made at the given cycle. Samples up to that cycle are
+// generated with the old port state first, so every sound starts on its exact sample.
+void soundOut(Audio &audio, uint64_t cycle, uint8_t port, uint8_t value);
+// Lets the audio thread generate samples up to the given cycle, e.g. once a frame
+void generateAudio(Audio &audio, uint64_t cycle);
+// Jumps to the given cycle with the given port latches, e.g. after loading a save state.
+// Sounds that were playing stop, except the UFO if its bit is set.
+void resetAudio(Audio &audio, uint64_t cycle, uint8_t port3, uint8_t port5);
+// Waits for the audio thread to handle every event, then fills in the WAV sizes and closes
+void stopAudio(Audio &audio);
+
+#endif
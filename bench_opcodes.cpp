@@ -0,0 +1,308 @@
+// Runs generated streams of each class of instruction through emulate8080() and reports what
+// each emulated instruction costs the host: time, cycles, instructions, branch misses and L1
+// misses, the last four read with perf_event_open(). The conditional jumps are run at several
+// taken ratios, in a random order, to show what mispredicting the guest's branches costs.
+// Without access to the counters (perf_event_paranoid, containers, other systems) only the time
+// is reported.
+//
+// g++ -std=c++14 -O2 cpu.cpp bench_opcodes.cpp -o bench_opcodes
+#include "cpu.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+const uint16_t CODE = 0x0100;
+const uint16_t SUBROUTINE = 0x7000; // A RET the CALLs go to
+const uint16_t DATA = 0x8000; // Where HL points
+const uint16_t STACK = 0xff00;
+const int BLOCK_INSTRUCTIONS = 4096; // Generated per class, then a JMP back to the start
+
+enum Event {
+	EVENT_CYCLES,
+	EVENT_INSTRUCTIONS,
+	EVENT_BRANCH_MISSES,
+	EVENT_L1D_MISSES,
+	EVENT_L1I_MISSES,
+	EVENTS
+};
+
+struct Counts {
+	double nanoseconds = 0;
+	double events[EVENTS] = {};
+	bool counted[EVENTS] = {};
+};
+
+struct InstructionClass {
+	std::string name;
+	void (*generate)(std::vector<uint8_t> &code, std::mt19937 &random, int taken);
+	int taken; // Percent of conditional jumps taken
+};
+
+const int M = 6; // The register number of M in opcodes
+
+// Any register but M
+static int anyRegister(std::mt19937 &random) {
+	int r = random() % 7;
+	return r >= M ? r + 1 : r;
+}
+
+static void movRegisters(std::vector<uint8_t> &code, std::mt19937 &random, int) {
+	for(int i = 0; i < BLOCK_INSTRUCTIONS; i++) {
+		code.push_back(0x40 + anyRegister(random) * 8 + anyRegister(random));
+	}
+}
+
+// Loads, stores and ALU operations on M, stepping HL along a few hundred bytes
+static void memoryHL(std::vector<uint8_t> &code, std::mt19937 &random, int) {
+	const int loaded[5] = {0, 1, 2, 3, 7}; // Not H or L
+	code.insert(code.end(), {0x21, DATA & 0xff, DATA >> 8}); // LXI H
+	for(int i = 1; i < BLOCK_INSTRUCTIONS; i++) {
+		uint8_t opCode;
+		switch(i % 8 == 0 ? 4 : random() % 4) {
+			case 0:
+				opCode = 0x40 + loaded[random() % 5] * 8 + M; // MOV r,M
+				break;
+			case 1:
+				opCode = 0x70 + anyRegister(random); // MOV M,r
+				break;
+			case 2:
+				opCode = 0x80 + random() % 8 * 8 + M; // ADD M to CMP M
+				break;
+			case 3:
+				opCode = 0x34 + random() % 3; // INR M, DCR M, MVI M
+				break;
+			default:
+				opCode = 0x23; // INX H
+		}
+		code.push_back(opCode);
+		if(opCode == 0x36) {
+			code.push_back((uint8_t) random());
+		}
+	}
+}
+
+// Register and immediate forms of the arithmetic and logic instructions, INR and DCR
+static void alu(std::vector<uint8_t> &code, std::mt19937 &random, int) {
+	for(int i = 0; i < BLOCK_INSTRUCTIONS; i++) {
+		switch(random() % 3) {
+			case 0:
+				code.push_back(0x80 + random() % 8 * 8 + anyRegister(random));
+				break;
+			case 1:
+				code.insert(code.end(), {(uint8_t) (0xc6 + random() % 8 * 8), (uint8_t) random()});
+				break;
+			default:
+				code.push_back(anyRegister(random) * 8 + 4 + random() % 2);
+		}
+	}
+}
+
+// With Z set, JZs are taken and JNZs aren't. Both go to the next instruction either way.
+static void conditionalJumps(std::vector<uint8_t> &code, std::mt19937 &random, int taken) {
+	code.push_back(0xaf); // XRA A
+	for(int i = 1; i < BLOCK_INSTRUCTIONS; i++) {
+		uint16_t next = CODE + code.size() + 3;
+		code.insert(code.end(), {(uint8_t) ((int) (random() % 100) < taken ? 0xca : 0xc2), (uint8_t) next,
+		                         (uint8_t) (next >> 8)});
+	}
+}
+
+static void callReturn(std::vector<uint8_t> &code, std::mt19937 &, int) {
+	for(int i = 0; i < BLOCK_INSTRUCTIONS; i += 2) {
+		code.insert(code.end(), {0xcd, SUBROUTINE & 0xff, SUBROUTINE >> 8}); // CALL
+	}
+}
+
+static std::vector<InstructionClass> allClasses() {
+	std::vector<InstructionClass> classes = {
+		{"MOV r,r", movRegisters, 0},
+		{"Memory through HL", memoryHL, 0},
+		{"ALU", alu, 0},
+	};
+	for(int taken : {0, 25, 50, 75, 100}) {
+		classes.push_back({"Jcc " + std::to_string(taken) + "% taken", conditionalJumps, taken});
+	}
+	classes.push_back({"CALL / RET", callReturn, 0});
+	return classes;
+}
+
+#ifdef __linux__
+struct PerfEvents {
+	int fds[EVENTS];
+};
+
+static int openEvent(uint32_t type, uint64_t config) {
+	perf_event_attr attr;
+	std::memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = type;
+	attr.config = config;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+	return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+// Events the CPU or the kernel doesn't allow stay -1
+static void openEvents(PerfEvents &perf) {
+	const uint64_t read = PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16;
+	perf.fds[EVENT_CYCLES] = openEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+	perf.fds[EVENT_INSTRUCTIONS] = openEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+	perf.fds[EVENT_BRANCH_MISSES] = openEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+	perf.fds[EVENT_L1D_MISSES] = openEvent(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | read);
+	perf.fds[EVENT_L1I_MISSES] = openEvent(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1I | read);
+}
+
+static void closeEvents(PerfEvents &perf) {
+	for(int fd : perf.fds) {
+		if(fd >= 0) {
+			close(fd);
+		}
+	}
+}
+
+static void startEvents(PerfEvents &perf) {
+	for(int fd : perf.fds) {
+		if(fd >= 0) {
+			ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+			ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+		}
+	}
+}
+
+// Scaled up by how long each was actually counting if the PMU had to take turns
+static void stopEvents(PerfEvents &perf, Counts &counts) {
+	for(int fd : perf.fds) {
+		if(fd >= 0) {
+			ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+		}
+	}
+	for(int event = 0; event < EVENTS; event++) {
+		uint64_t values[3];
+		if(perf.fds[event] < 0 || read(perf.fds[event], values, sizeof(values)) != sizeof(values) || !values[2]) {
+			continue;
+		}
+		counts.events[event] = (double) values[0] * values[1] / values[2];
+		counts.counted[event] = true;
+	}
+}
+#else
+struct PerfEvents {};
+
+static void openEvents(PerfEvents &) {}
+static void closeEvents(PerfEvents &) {}
+static void startEvents(PerfEvents &) {}
+static void stopEvents(PerfEvents &, Counts &) {}
+#endif
+
+static void setUp(unique_ptr<CPU> &cpu, const InstructionClass &instructionClass) {
+	std::mt19937 random(8080);
+	std::vector<uint8_t> code;
+	instructionClass.generate(code, random, instructionClass.taken);
+	code.insert(code.end(), {0xc3, CODE & 0xff, CODE >> 8}); // JMP
+	clearMemory(*cpu);
+	std::copy(code.begin(), code.end(), cpu->RAM + CODE);
+	cpu->RAM[SUBROUTINE] = 0xc9; // RET
+	cpu->PC = CODE;
+	cpu->SP = STACK;
+	cpu->HL = DATA;
+}
+
+// The fastest of repeats runs of instructions each
+static Counts measure(unique_ptr<CPU> &cpu, PerfEvents &perf, uint64_t instructions, int repeats) {
+	uint64_t cycles = 0;
+	for(uint64_t i = 0; i < instructions / 10; i++) { // Warming up the caches and predictors
+		cycles += emulate8080(cpu);
+	}
+	Counts best;
+	for(int repeat = 0; repeat < repeats; repeat++) {
+		Counts counts;
+		auto start = std::chrono::steady_clock::now();
+		startEvents(perf);
+		for(uint64_t i = 0; i < instructions; i++) {
+			cycles += emulate8080(cpu);
+		}
+		stopEvents(perf, counts);
+		counts.nanoseconds = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+		if(repeat == 0 || counts.nanoseconds < best.nanoseconds) {
+			best = counts;
+		}
+	}
+	if(cycles == 0) { // Keeps the loops from being thrown away
+		printf("No cycles!\n");
+	}
+	return best;
+}
+
+static void printColumn(const Counts &counts, int event, double per) {
+	if(counts.counted[event]) {
+		printf(" %10.2f", counts.events[event] / per);
+	} else {
+		printf(" %10s", "-");
+	}
+}
+
+int main(int argc, char *argv[]) {
+	uint64_t instructions = 20000000;
+	int repeats = 3;
+	std::string only;
+	for(int i = 1; i < argc; i++) {
+		std::string argument = argv[i];
+		if(argument == "--instructions" && i + 1 < argc) {
+			instructions = std::max<uint64_t>(1, std::stoull(argv[++i]));
+		} else if(argument == "--repeat" && i + 1 < argc) {
+			repeats = std::max(1, std::stoi(argv[++i]));
+		} else if(argument == "--class" && i + 1 < argc) {
+			only = argv[++i];
+		} else {
+			printf("Usage: %s [--instructions N] [--repeat N] [--class NAME]\n", argv[0]);
+			printf("  --instructions N   Emulated instructions per run (default 20000000)\n");
+			printf("  --repeat N         Runs per class, the fastest is reported (default 3)\n");
+			printf("  --class NAME       Only classes whose name starts with NAME\n");
+			return 1;
+		}
+	}
+
+	PerfEvents perf;
+	openEvents(perf);
+	unique_ptr<CPU> cpu(new CPU());
+	printf("%-22s %10s %10s %10s %10s %10s %10s\n", "Per instruction", "ns", "cycles", "host ins", "br miss/k",
+	       "L1D miss/k", "L1I miss/k");
+	bool anyCounted = false;
+	for(const InstructionClass &instructionClass : allClasses()) {
+		if(instructionClass.name.compare(0, only.size(), only) != 0) {
+			continue;
+		}
+		setUp(cpu, instructionClass);
+		Counts counts = measure(cpu, perf, instructions, repeats);
+		double per = (double) instructions;
+		printf("%-22s %10.2f", instructionClass.name.c_str(), counts.nanoseconds / per);
+		printColumn(counts, EVENT_CYCLES, per);
+		printColumn(counts, EVENT_INSTRUCTIONS, per);
+		printColumn(counts, EVENT_BRANCH_MISSES, per / 1000);
+		printColumn(counts, EVENT_L1D_MISSES, per / 1000);
+		printColumn(counts, EVENT_L1I_MISSES, per / 1000);
+		printf("\n");
+		for(bool counted : counts.counted) {
+			anyCounted |= counted;
+		}
+	}
+	closeEvents(perf);
+	if(!anyCounted) {
+		printf("No hardware counters (see /proc/sys/kernel/perf_event_paranoid), only times\n");
+	}
+	return 0;
+}
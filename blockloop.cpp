@@ -0,0 +1,271 @@
+#include "blockloop.h"
+#ifdef COVERAGE
+#include "coverage.h"
+#endif
+
+#include <algorithm>
+#include <cstring>
+
+static uint8_t &reg(CPU &cpu, int r) {
+	switch(r) {
+		case 0:
+			return cpu.B;
+		case 1:
+			return cpu.C;
+		case 2:
+			return cpu.D;
+		case 3:
+			return cpu.E;
+		case 4:
+			return cpu.H;
+		case 5:
+			return cpu.L;
+	}
+	return cpu.A;
+}
+
+static uint16_t &pair(CPU &cpu, int p) {
+	return p == 0 ? cpu.BC : p == 1 ? cpu.DE : cpu.HL;
+}
+
+// Whether register r (0 B to 5 L) is half of a pair the loop steps
+static bool isStepped(const BlockLoop &loop, int r) {
+	return r < 6 && loop.steps[r / 2] != 0;
+}
+
+// Fills in everything but jump, head, length and code. Leaves cycles at 0 if the loop isn't
+// one runBlockLoop() handles.
+static void analyze(BlockLoop &loop) {
+	uint8_t opCodes[BLOCK_LOOP_MAX_LENGTH];
+	uint8_t operands[BLOCK_LOOP_MAX_LENGTH];
+	int count = 0;
+	int cycles = OPCODE_CYCLES[BLOCK_LOOP_JUMP];
+	int end = loop.length - 3;
+	int offset = 0;
+	for(; offset < end; offset += OPCODE_SIZES[loop.code[offset]]) {
+		opCodes[count] = loop.code[offset];
+		operands[count] = loop.code[offset + 1];
+		cycles += OPCODE_CYCLES[opCodes[count]];
+		count++;
+	}
+	if(offset != end || count < 2) {
+		return;
+	}
+
+	// The instructions ending it
+	uint8_t last = opCodes[count - 1];
+	uint8_t move = opCodes[count - 2];
+	int body;
+	if((last & 0xc7) == 0x05 && (last >> 3) < 6) { // DCR r
+		loop.end = BlockLoopEnd::Count;
+		loop.counter = last >> 3;
+		body = count - 1;
+	} else if(move >= 0x78 && move < 0x7e && last >= 0xb0 && last < 0xb6 && (move & 7) / 2 == (last & 7) / 2 &&
+	          (move & 7) != (last & 7)) { // MOV A,r / ORA r
+		loop.end = BlockLoopEnd::WideCount;
+		loop.counter = (move & 7) / 2;
+		body = count - 2;
+	} else if(move >= 0x78 && move < 0x7e && last == 0xfe) { // MOV A,r / CPI n
+		loop.end = BlockLoopEnd::Compare;
+		loop.counter = move & 7;
+		loop.compare = operands[count - 1];
+		body = count - 2;
+	} else {
+		return;
+	}
+
+	bool stepped[3] = {};
+	bool fromA = false;
+	for(int i = 0; i < body; i++) {
+		uint8_t opCode = opCodes[i];
+		int p = opCode == 0x7e || opCode == 0x77 || (opCode & 0xf8) == 0x70 || opCode == 0x36 ? 2 : (opCode >> 4) & 3;
+		switch(opCode) {
+			case 0x0a: case 0x1a: case 0x7e: // LDAX B, LDAX D, MOV A,M
+				if(loop.load >= 0 || loop.store >= 0) {
+					return;
+				}
+				loop.load = p;
+				loop.loadStepped = stepped[p];
+				break;
+			case 0x02: case 0x12: case 0x77: // STAX B, STAX D, MOV M,A
+			case 0x36: // MVI M
+			case 0x70: case 0x71: case 0x72: case 0x73: case 0x74: case 0x75: // MOV M,r
+				if(loop.store >= 0) {
+					return;
+				}
+				loop.store = p;
+				loop.storeStepped = stepped[p];
+				if(opCode == 0x36) {
+					loop.fillValue = operands[i];
+				} else if(opCode >= 0x70 && opCode < 0x76) {
+					loop.fillRegister = opCode & 7;
+				} else {
+					fromA = true;
+					loop.fillRegister = loop.load < 0 ? 7 : -1;
+				}
+				break;
+			case 0x03: case 0x13: case 0x23: // INX
+			case 0x0b: case 0x1b: case 0x2b: // DCX
+				if(stepped[p]) {
+					return;
+				}
+				stepped[p] = true;
+				loop.steps[p] = opCode & 0x08 ? -1 : 1;
+				break;
+			default:
+				return;
+		}
+	}
+
+	// Everything read has to either be worked out per pass or stay the same throughout
+	bool writesA = loop.end != BlockLoopEnd::Count;
+	if(loop.store < 0 || (loop.load >= 0 && !fromA)) {
+		return;
+	}
+	if(loop.fillRegister >= 0 && (isStepped(loop, loop.fillRegister) || (loop.fillRegister == 7 && writesA) ||
+	                              (loop.end == BlockLoopEnd::Count && loop.fillRegister == loop.counter))) {
+		return;
+	}
+	switch(loop.end) {
+		case BlockLoopEnd::Count:
+			if(isStepped(loop, loop.counter) || loop.counter / 2 == loop.store || loop.counter / 2 == loop.load) {
+				return;
+			}
+			break;
+		case BlockLoopEnd::WideCount:
+			if(loop.steps[loop.counter] != -1 || loop.counter == loop.store || loop.counter == loop.load) {
+				return;
+			}
+			break;
+		case BlockLoopEnd::Compare:
+			if(!isStepped(loop, loop.counter)) {
+				return;
+			}
+			break;
+	}
+	loop.cycles = cycles;
+	loop.instructions = count + 1;
+}
+
+// Passes until the loop falls through its JNZ, at most limit
+static uint32_t passesLeft(CPU &cpu, const BlockLoop &loop, uint32_t limit) {
+	uint32_t passes = limit;
+	if(loop.end == BlockLoopEnd::Count) {
+		uint8_t counter = reg(cpu, loop.counter);
+		passes = counter ? counter : 0x100;
+	} else if(loop.end == BlockLoopEnd::WideCount) {
+		uint16_t counter = pair(cpu, loop.counter);
+		passes = counter ? counter : 0x10000;
+	} else {
+		uint16_t value = pair(cpu, loop.counter / 2);
+		int step = loop.steps[loop.counter / 2];
+		bool high = loop.counter % 2 == 0;
+		for(uint32_t i = 1; i <= limit; i++) {
+			uint16_t after = value + step * (int) i;
+			if((high ? after >> 8 : after & 0xff) == loop.compare) {
+				return i;
+			}
+		}
+	}
+	return std::min(passes, limit);
+}
+
+void markCode(BlockLoops &loops, uint32_t start, uint32_t size) {
+	for(uint32_t page = start >> CODE_PAGE_SHIFT; size && page <= (start + size - 1) >> CODE_PAGE_SHIFT &&
+	                                               page < loops.codePages.size(); page++) {
+		loops.codePages.set(page);
+	}
+}
+
+int runBlockLoop(unique_ptr<CPU> &cpu, BlockLoops &loops, uint64_t budget) {
+	CPU &c = *cpu;
+	uint8_t *RAM = c.RAM;
+	if(!atBlockLoop(c, loops)) {
+		return 0;
+	}
+	uint16_t head = RAM[(uint16_t) (c.PC + 2)] << 8 | RAM[(uint16_t) (c.PC + 1)];
+	int length = c.PC + 3 - head;
+	if(head > c.PC || length > BLOCK_LOOP_MAX_LENGTH || c.PC + 3 > (int) RAM_SIZE) { // Or wrapping around
+		loops.rejected.set(c.PC);
+		return 0;
+	}
+	if(getFlag(c.f, FLAG_Z)) { // Leaving the loop
+		return 0;
+	}
+
+	BlockLoop &loop = loops.loop;
+	if(loop.jump != c.PC || loop.head != head || loop.length != length || memcmp(loop.code, RAM + head, length) != 0) {
+		loop = BlockLoop();
+		loop.jump = c.PC;
+		loop.head = head;
+		loop.length = length;
+		memcpy(loop.code, RAM + head, length);
+		analyze(loop);
+		if(!loop.cycles) {
+			loops.rejected.set(c.PC);
+			return 0;
+		}
+	}
+	int jump = OPCODE_CYCLES[BLOCK_LOOP_JUMP];
+	if(budget < (uint64_t) jump) {
+		return 0;
+	}
+	uint32_t passes = passesLeft(c, loop, (uint32_t) std::min<uint64_t>((budget - jump) / loop.cycles, 0x10000));
+	if(passes < 2) {
+		return 0;
+	}
+
+	// Where every pass writes, which has to stay clear of code and inside memory
+	int storeStep = loop.steps[loop.store];
+	int to = pair(c, loop.store) + (loop.storeStepped ? storeStep : 0);
+	int toLast = to + storeStep * (int) (passes - 1);
+	int low = std::min(to, toLast);
+	int high = std::max(to, toLast);
+	if(low < 0 || high >= (int) RAM_SIZE || (low < head + length && high >= head)) {
+		return 0;
+	}
+	for(int page = low >> CODE_PAGE_SHIFT; page <= high >> CODE_PAGE_SHIFT; page++) {
+		if(loops.codePages[page]) {
+			return 0;
+		}
+	}
+
+	// All but the last pass
+	int native = (int) passes - 1;
+	toLast = to + storeStep * (native - 1);
+	if(loop.load < 0) {
+		uint8_t value = loop.fillRegister >= 0 ? reg(c, loop.fillRegister) : loop.fillValue;
+		memset(RAM + std::min(to, toLast), value, storeStep ? native : 1);
+	} else {
+		int loadStep = loop.steps[loop.load];
+		int from = pair(c, loop.load) + (loop.loadStepped ? loadStep : 0);
+		int fromLast = from + loadStep * (native - 1);
+		int fromLow = std::min(from, fromLast);
+		int fromHigh = std::max(from, fromLast);
+		if(loadStep == storeStep && storeStep && fromLow >= 0 && fromHigh < (int) RAM_SIZE &&
+		   (fromHigh < std::min(to, toLast) || fromLow > std::max(to, toLast))) {
+			memcpy(RAM + std::min(to, toLast), RAM + fromLow, native);
+		} else { // Overlapping, so a byte can be copied again after it was written
+			for(int i = 0; i < native; i++) {
+				RAM[(uint16_t) (to + storeStep * i)] = RAM[(uint16_t) (from + loadStep * i)];
+			}
+		}
+	}
+	for(int p = 0; p < 3; p++) {
+		pair(c, p) += loop.steps[p] * native;
+	}
+	if(loop.end == BlockLoopEnd::Count) {
+		reg(c, loop.counter) -= native;
+	}
+	c.PC = head;
+	int cycles = jump + native * loop.cycles;
+	loops.cycles += cycles;
+#ifdef COVERAGE
+	coverBranch(loop.jump, true); // Passes only reach the last one by jumping back
+#endif
+
+	for(int i = 0; i < loop.instructions; i++) {
+		cycles += emulate8080(cpu);
+	}
+	return cycles;
+}
@@ -0,0 +1,73 @@
+#ifndef BLOCKLOOP_H
+#define BLOCKLOOP_H
+
+#include "cpu.h"
+
+#include <bitset>
+#include <cstdint>
+
+// Copy and fill loops, like Space Invaders' LDAX D / MOV M,A / INX H / INX D / DCR B / JNZ, are
+// recognized at the JNZ closing them and run as one memcpy or memset instead of instruction by
+// instruction. A loop body may hold one load of A through BC, DE or HL, one store through one of
+// them (of that A, of a register the loop doesn't change or of an immediate), an INX or DCX of
+// each pair, and ends with one of
+//   DCR r / JNZ               r passes, 256 if r is 0
+//   DCX rp / MOV A,r / ORA r / JNZ   rp passes with the halves of rp in either order
+//   MOV A,r / CPI n / JNZ     until the half r of a stepped pair reaches n
+// Every pass but the last is run natively. The last goes through emulate8080(), so A and the
+// flags come out of the same code they always do, and the registers, memory and cycle count end
+// up exactly as if every instruction had been interpreted.
+//
+// Memory has no side effects (the I/O is on ports), so reads are never checked. Loops writing
+// into themselves, into a code page or across the ends of memory are left to the interpreter.
+const int BLOCK_LOOP_JUMP = 0xc2; // JNZ
+const int BLOCK_LOOP_MAX_LENGTH = 16; // Bytes from the loop's first instruction to the end of the JNZ
+const int CODE_PAGE_SHIFT = 8;
+
+enum class BlockLoopEnd {
+	Count, // DCR
+	WideCount, // DCX / MOV / ORA
+	Compare // MOV / CPI
+};
+
+// The loop last reached, as worked out from its code
+struct BlockLoop {
+	uint16_t jump = 0x0000;
+	uint16_t head = 0x0000;
+	int length = 0; // 0 when nothing has been looked at
+	uint8_t code[BLOCK_LOOP_MAX_LENGTH] = {}; // To notice the loop being replaced
+	int cycles = 0; // Per pass including the JNZ, 0 if it can't run natively
+	int instructions = 0; // Per pass including the JNZ
+	int8_t steps[3] = {}; // +1 for an INX and -1 for a DCX of BC, DE and HL each pass
+	int load = -1; // Pair A is loaded from (0 BC, 1 DE, 2 HL), -1 for a fill
+	int store = -1;
+	bool loadStepped = false; // The pair's INX or DCX comes before the load
+	bool storeStepped = false;
+	int fillRegister = -1; // Stored by a fill (0 B to 5 L, 7 A), -1 for fillValue
+	uint8_t fillValue = 0x00;
+	BlockLoopEnd end = BlockLoopEnd::Count;
+	int counter = 0; // The register (DCR, CPI) or pair (DCX) ending the loop
+	uint8_t compare = 0x00; // The CPI's
+};
+
+struct BlockLoops {
+	std::bitset<(RAM_SIZE >> CODE_PAGE_SHIFT)> codePages; // Left to the interpreter when written
+	// JNZs found not to close a loop that can run natively, so the common case costs a bit test.
+	// Nothing notices them changing into one; clearing it starts over.
+	std::bitset<RAM_SIZE> rejected;
+	BlockLoop loop;
+	uint64_t cycles = 0; // Run natively
+};
+
+// Whether runBlockLoop() may do anything at cpu.PC, cheap enough to ask before every instruction
+inline bool atBlockLoop(const CPU &cpu, const BlockLoops &loops) {
+	return cpu.RAM[cpu.PC] == BLOCK_LOOP_JUMP && !loops.rejected[cpu.PC];
+}
+
+// Pages from start up to start + size hold code
+void markCode(BlockLoops &loops, uint32_t start, uint32_t size);
+// If cpu->PC is a JNZ closing a loop above, runs whole passes of it, as many as finish within
+// budget cycles, and returns the cycles taken. Returns 0 if the interpreter has to step it.
+int runBlockLoop(unique_ptr<CPU> &cpu, BlockLoops &loops, uint64_t budget);
+
+#endif
@@ -0,0 +1,127 @@
+#include "counters.h"
+#include "threadblocks.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <vector>
+
+#ifdef COUNTERS
+typedef ThreadBlocks<CounterBlock, MAX_COUNTER_THREADS> CounterBlocks;
+
+static inline CounterBlock &counters() {
+	return CounterBlocks::local();
+}
+
+// Only the owning thread writes, so this doesn't need to be a locked add
+static inline void bump(std::atomic<uint64_t> &counter, uint64_t amount = 1) {
+	counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+void countMemory(const CPU &cpu, uint8_t opCode, uint16_t pc) {
+	CounterBlock &block = counters();
+	DataAccess accesses[MAX_DATA_ACCESSES];
+	int count = dataAccesses(cpu, pc, accesses);
+	for(int i = 0; i < count; i++) {
+		bump((accesses[i].write ? block.writes : block.reads)[accesses[i].address >> MEMORY_REGION_SHIFT]);
+	}
+	if(opCode == 0xd3) { // OUT
+		bump(block.portOut[cpu.RAM[(uint16_t) (pc + 1)]]);
+	} else if(opCode == 0xdb) { // IN
+		bump(block.portIn[cpu.RAM[(uint16_t) (pc + 1)]]);
+	}
+}
+
+void countInstruction(const CPU &cpu, uint8_t opCode, uint16_t pc, int cycles) {
+	CounterBlock &block = counters();
+	bump(block.instructions);
+	bump(block.cycles, cycles);
+	bump(block.opCodes[opCode]);
+	switch(opCode & 0xc7) {
+		case 0xc2: // Jcc, a jump to the next instruction counts as not taken
+			bump(cpu.PC != (uint16_t) (pc + 3) ? block.taken : block.notTaken);
+			break;
+		case 0xc4: // Ccc
+		case 0xc0: // Rcc
+			bump(cycles > OPCODE_CYCLES[opCode] ? block.taken : block.notTaken);
+			break;
+	}
+}
+
+void countInterrupt() {
+	bump(counters().interrupts);
+}
+
+void suspendCounters(bool suspended) {
+	CounterBlocks::suspend(suspended);
+}
+#endif
+
+CounterSnapshot snapshotCounters() {
+	CounterSnapshot snapshot = {};
+#ifdef COUNTERS
+	snapshot.uncountedThreads = CounterBlocks::overflowed();
+	auto add = [](uint64_t &total, const std::atomic<uint64_t> &counter) {
+		total += counter.load(std::memory_order_relaxed);
+	};
+	for(int i = 0; i < CounterBlocks::used(); i++) {
+		const CounterBlock &block = CounterBlocks::block(i);
+		add(snapshot.instructions, block.instructions);
+		add(snapshot.cycles, block.cycles);
+		add(snapshot.taken, block.taken);
+		add(snapshot.notTaken, block.notTaken);
+		add(snapshot.interrupts, block.interrupts);
+		for(int j = 0; j < 256; j++) {
+			add(snapshot.opCodes[j], block.opCodes[j]);
+			add(snapshot.portIn[j], block.portIn[j]);
+			add(snapshot.portOut[j], block.portOut[j]);
+		}
+		for(int j = 0; j < MEMORY_REGIONS; j++) {
+			add(snapshot.reads[j], block.reads[j]);
+			add(snapshot.writes[j], block.writes[j]);
+		}
+	}
+#endif
+	return snapshot;
+}
+
+void printCounters(const CounterSnapshot &counters, std::ostream &out) {
+	if(!COUNTERS_ENABLED) {
+		out << "Counters not built in, compile with -DCOUNTERS" << std::endl;
+		return;
+	}
+	std::ios::fmtflags flags = out.flags();
+	char fill = out.fill();
+	out << std::dec << counters.instructions << " instructions, " << counters.cycles << " cycles, "
+	    << counters.interrupts << " interrupts" << std::endl;
+	out << "Conditional branches: " << counters.taken << " taken, " << counters.notTaken << " not taken" << std::endl;
+	if(counters.uncountedThreads) {
+		out << counters.uncountedThreads << " threads not counted, over " << MAX_COUNTER_THREADS << " at once" << std::endl;
+	}
+
+	std::vector<int> order(256);
+	for(int i = 0; i < 256; i++) {
+		order[i] = i;
+	}
+	std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+		return counters.opCodes[a] > counters.opCodes[b];
+	});
+	out << "Most run opcodes:";
+	for(int i = 0; i < 16 && counters.opCodes[order[i]]; i++) {
+		out << std::hex << " " << std::setw(2) << std::setfill('0') << order[i] << std::dec << ":" << counters.opCodes[order[i]];
+	}
+	out << std::endl;
+
+	for(int i = 0; i < MEMORY_REGIONS; i++) {
+		if(counters.reads[i] || counters.writes[i]) {
+			out << "Memory " << std::hex << std::setw(4) << std::setfill('0') << (i << MEMORY_REGION_SHIFT) << std::dec
+			    << ": " << counters.reads[i] << " reads, " << counters.writes[i] << " writes" << std::endl;
+		}
+	}
+	for(int i = 0; i < 256; i++) {
+		if(counters.portIn[i] || counters.portOut[i]) {
+			out << "Port " << i << ": " << counters.portIn[i] << " in, " << counters.portOut[i] << " out" << std::endl;
+		}
+	}
+	out.flags(flags);
+	out.fill(fill);
+}
@@ -0,0 +1,61 @@
+#ifndef COUNTERS_H
+#define COUNTERS_H
+
+#include "cpu.h"
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+
+// Build with -DCOUNTERS to count what emulate8080() does. Without it none of the counting is
+// compiled in and every snapshot is zero. Instructions run by recompiled code, skipped as
+// idle loops or run natively as block loops aren't counted.
+#ifdef COUNTERS
+const bool COUNTERS_ENABLED = true;
+#else
+const bool COUNTERS_ENABLED = false;
+#endif
+
+const int MEMORY_REGION_SHIFT = 12; // Data reads and writes are counted per 4 KiB region
+const int MEMORY_REGIONS = RAM_SIZE >> MEMORY_REGION_SHIFT;
+const int MAX_COUNTER_THREADS = 64; // Threads counted at the same time, any more run uncounted
+
+template<typename T>
+struct CounterFields {
+	T instructions;
+	T cycles;
+	T taken; // Conditional jumps, calls and returns
+	T notTaken;
+	T interrupts;
+	T opCodes[256];
+	T reads[MEMORY_REGIONS]; // Data only, not instruction fetches
+	T writes[MEMORY_REGIONS];
+	T portIn[256];
+	T portOut[256];
+	T uncountedThreads; // Past MAX_COUNTER_THREADS at once, their instructions aren't counted
+};
+
+// Each thread counts into its own block (see threadblocks.h), so counting never bounces a cache
+// line between cores and uses plain loads and stores instead of locked adds
+struct alignas(CACHE_LINE_SIZE) CounterBlock : CounterFields<std::atomic<uint64_t>> {
+};
+
+typedef CounterFields<uint64_t> CounterSnapshot;
+
+#ifdef COUNTERS
+// Called by emulate8080() before and after each instruction at pc
+void countMemory(const CPU &cpu, uint8_t opCode, uint16_t pc);
+void countInstruction(const CPU &cpu, uint8_t opCode, uint16_t pc, int cycles);
+void countInterrupt();
+// While suspended, what the calling thread runs isn't counted, e.g. running ahead to frames that
+// are then rewound
+void suspendCounters(bool suspended);
+#endif
+
+// Totals over every thread that has counted, safe to take while they are running. Each counter
+// is exact but they aren't taken at the same instant, so totals can disagree by an instruction
+// or so per running thread.
+CounterSnapshot snapshotCounters();
+void printCounters(const CounterSnapshot &counters, std::ostream &out);
+
+#endif
@@ -0,0 +1,186 @@
+#include "coverage.h"
+#include "threadblocks.h"
+#include "writefile.h"
+
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <vector>
+
+const char COVERAGE_MAGIC[8] = {'8', '0', '8', '0', 'C', 'O', 'V', '\0'};
+
+#ifdef COVERAGE
+typedef ThreadBlocks<CoverageBlock, MAX_COVERAGE_THREADS> CoverageBlocks;
+
+static inline CoverageBlock &coverage() {
+	return CoverageBlocks::local();
+}
+
+// Only the owning thread writes, and once a bit is set it stays set, so this skips the store
+static inline void mark(std::atomic<uint64_t> *map, uint16_t address) {
+	std::atomic<uint64_t> &word = map[address >> 6];
+	uint64_t value = word.load(std::memory_order_relaxed);
+	uint64_t bit = (uint64_t) 1 << (address & 63);
+	if(!(value & bit)) {
+		word.store(value | bit, std::memory_order_relaxed);
+	}
+}
+
+// Whether a conditional instruction at pc jumped, called or returned
+static inline bool wasTaken(const CPU &cpu, uint8_t opCode, uint16_t pc, int cycles) {
+	return (opCode & 0xc7) == 0xc2 ? cpu.PC != (uint16_t) (pc + 3) : cycles > OPCODE_CYCLES[opCode];
+}
+
+static inline bool isConditional(uint8_t opCode) {
+	return (opCode & 0xc7) == 0xc2 || (opCode & 0xc7) == 0xc4 || (opCode & 0xc7) == 0xc0; // Jcc, Ccc, Rcc
+}
+
+// The first time an instruction runs at pc. Its operands are marked then, so code that changes
+// its own instruction lengths can leave some unmarked.
+static __attribute__((noinline)) void coverNew(CoverageBlock &block, const CPU &cpu, uint8_t opCode, uint16_t pc,
+                                               int cycles) {
+	mark(block.executed, pc);
+	for(int i = 0; i < OPCODE_SIZES[opCode]; i++) {
+		mark(block.fetched, (uint16_t) (pc + i));
+	}
+	if(isConditional(opCode)) {
+		mark(wasTaken(cpu, opCode, pc, cycles) ? block.taken : block.notTaken, pc);
+	}
+}
+
+void coverInstruction(const CPU &cpu, uint8_t opCode, uint16_t pc, int cycles) {
+	CoverageBlock &block = coverage();
+	if(!(block.executed[pc >> 6].load(std::memory_order_relaxed) >> (pc & 63) & 1)) {
+		coverNew(block, cpu, opCode, pc, cycles);
+	} else if(isConditional(opCode)) {
+		mark(wasTaken(cpu, opCode, pc, cycles) ? block.taken : block.notTaken, pc);
+	}
+}
+
+void coverBranch(uint16_t pc, bool taken) {
+	CoverageBlock &block = coverage();
+	mark(taken ? block.taken : block.notTaken, pc);
+}
+
+void suspendCoverage(bool suspended) {
+	CoverageBlocks::suspend(suspended);
+}
+#endif
+
+CoverageMap snapshotCoverage() {
+	CoverageMap map = {};
+#ifdef COVERAGE
+	for(int i = 0; i < CoverageBlocks::used(); i++) {
+		const CoverageBlock &block = CoverageBlocks::block(i);
+		for(int j = 0; j < COVERAGE_WORDS; j++) {
+			map.executed[j] |= block.executed[j].load(std::memory_order_relaxed);
+			map.fetched[j] |= block.fetched[j].load(std::memory_order_relaxed);
+			map.taken[j] |= block.taken[j].load(std::memory_order_relaxed);
+			map.notTaken[j] |= block.notTaken[j].load(std::memory_order_relaxed);
+		}
+	}
+#endif
+	return map;
+}
+
+uint64_t uncoveredThreads() {
+#ifdef COVERAGE
+	return CoverageBlocks::overflowed();
+#else
+	return 0;
+#endif
+}
+
+void mergeCoverage(CoverageMap &into, const CoverageMap &from) {
+	for(int i = 0; i < COVERAGE_WORDS; i++) {
+		into.executed[i] |= from.executed[i];
+		into.fetched[i] |= from.fetched[i];
+		into.taken[i] |= from.taken[i];
+		into.notTaken[i] |= from.notTaken[i];
+	}
+}
+
+static void putMap(std::vector<uint8_t> &out, const uint64_t *map) {
+	for(int i = 0; i < COVERAGE_WORDS; i++) {
+		for(int j = 0; j < 8; j++) {
+			out.push_back((map[i] >> (j * 8)) & 0xff);
+		}
+	}
+}
+
+static void getMap(const uint8_t *&in, uint64_t *map) {
+	for(int i = 0; i < COVERAGE_WORDS; i++) {
+		map[i] = 0;
+		for(int j = 0; j < 8; j++) {
+			map[i] |= (uint64_t) *in++ << (j * 8);
+		}
+	}
+}
+
+std::vector<uint8_t> encodeCoverage(const CoverageMap &map) {
+	std::vector<uint8_t> file(COVERAGE_MAGIC, COVERAGE_MAGIC + sizeof(COVERAGE_MAGIC));
+	file.reserve(COVERAGE_FILE_SIZE);
+	file.push_back(COVERAGE_VERSION & 0xff);
+	file.push_back(COVERAGE_VERSION >> 8);
+	putMap(file, map.executed);
+	putMap(file, map.fetched);
+	putMap(file, map.taken);
+	putMap(file, map.notTaken);
+	return file;
+}
+
+void saveCoverage(const CoverageMap &map, const std::string &fileName) {
+	writeFile(fileName, encodeCoverage(map));
+}
+
+CoverageMap loadCoverage(const std::string &fileName) {
+	std::ifstream input(fileName, std::ios::binary);
+	if(!input) {
+		throw std::runtime_error("Could not open file!");
+	}
+	std::vector<uint8_t> file((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+	if(file.size() != COVERAGE_FILE_SIZE || std::memcmp(file.data(), COVERAGE_MAGIC, sizeof(COVERAGE_MAGIC)) != 0 ||
+	   (file[8] | file[9] << 8) != COVERAGE_VERSION) {
+		throw std::runtime_error("Not a coverage file!");
+	}
+	CoverageMap map;
+	const uint8_t *in = file.data() + sizeof(COVERAGE_MAGIC) + 2;
+	getMap(in, map.executed);
+	getMap(in, map.fetched);
+	getMap(in, map.taken);
+	getMap(in, map.notTaken);
+	return map;
+}
+
+static int bits(uint64_t word) {
+	int count = 0;
+	for(; word; word &= word - 1) {
+		count++;
+	}
+	return count;
+}
+
+void printCoverage(const CoverageMap &map, std::ostream &out) {
+	if(!COVERAGE_ENABLED) {
+		out << "Coverage not built in, compile with -DCOVERAGE" << std::endl;
+		return;
+	}
+	std::ios::fmtflags flags = out.flags();
+	int executed = 0;
+	int fetched = 0;
+	int both = 0;
+	int onlyTaken = 0;
+	int onlyNotTaken = 0;
+	for(int i = 0; i < COVERAGE_WORDS; i++) {
+		executed += bits(map.executed[i]);
+		fetched += bits(map.fetched[i]);
+		both += bits(map.taken[i] & map.notTaken[i]);
+		onlyTaken += bits(map.taken[i] & ~map.notTaken[i]);
+		onlyNotTaken += bits(map.notTaken[i] & ~map.taken[i]);
+	}
+	out << std::dec << executed << " instructions covered, " << fetched << " bytes" << std::endl;
+	out << "Conditional branches: " << both << " both ways, " << onlyTaken << " only taken, " << onlyNotTaken
+	    << " only not taken" << std::endl;
+	out.flags(flags);
+}
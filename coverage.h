@@ -0,0 +1,69 @@
+#ifndef COVERAGE_H
+#define COVERAGE_H
+
+#include "cpu.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Build with -DCOVERAGE to record which guest code emulate8080() runs: a bit per address an
+// instruction started at, a bit per byte fetched as part of one, and a bit for each way each
+// conditional jump, call and return went. Setting a bit costs about as much as a counter, so it
+// can stay on for long batch runs. Coverage files are the same bitmaps, so runs in parallel
+// each write their own and disassembler.py ORs them into an annotated listing. Instructions run
+// by recompiled code aren't covered; idle loops and block loops are run through the interpreter
+// at least once, and block loops note the jumps back they take natively.
+#ifdef COVERAGE
+const bool COVERAGE_ENABLED = true;
+#else
+const bool COVERAGE_ENABLED = false;
+#endif
+
+const int COVERAGE_WORDS = RAM_SIZE / 64; // Bits of each map, one per address, in 64-bit words
+const int MAX_COVERAGE_THREADS = 64; // Threads covered at the same time, any more run uncovered
+
+template<typename T>
+struct CoverageFields {
+	T executed[COVERAGE_WORDS]; // An instruction started here
+	T fetched[COVERAGE_WORDS]; // Opcode or operand of an executed instruction
+	T taken[COVERAGE_WORDS]; // The conditional instruction here jumped, called or returned
+	T notTaken[COVERAGE_WORDS]; // It fell through (a jump to the next instruction counts as this)
+};
+
+// Each thread sets bits in its own block (see threadblocks.h), the way the counters count
+struct alignas(CACHE_LINE_SIZE) CoverageBlock : CoverageFields<std::atomic<uint64_t>> {
+};
+
+typedef CoverageFields<uint64_t> CoverageMap;
+
+#ifdef COVERAGE
+// Called by emulate8080() after each instruction at pc
+void coverInstruction(const CPU &cpu, uint8_t opCode, uint16_t pc, int cycles);
+// A conditional instruction at pc run some other way
+void coverBranch(uint16_t pc, bool taken);
+// While suspended, what the calling thread runs isn't covered, as with suspendCounters()
+void suspendCoverage(bool suspended);
+#endif
+
+// Everything every thread has covered, safe to take while they are running
+CoverageMap snapshotCoverage();
+// Threads that ran uncovered, past MAX_COVERAGE_THREADS at once
+uint64_t uncoveredThreads();
+void mergeCoverage(CoverageMap &into, const CoverageMap &from);
+
+// Coverage files are "8080COV" and a zero byte, a uint16 version and the four maps in the order
+// above as uint64 words, all little endian. Saving writes a temporary file and renames it.
+const uint16_t COVERAGE_VERSION = 1;
+const std::size_t COVERAGE_FILE_SIZE = 8 + 2 + 4 * COVERAGE_WORDS * 8;
+std::vector<uint8_t> encodeCoverage(const CoverageMap &map);
+void saveCoverage(const CoverageMap &map, const std::string &fileName);
+// Throws if the file is missing or isn't a coverage file
+CoverageMap loadCoverage(const std::string &fileName);
+// How much was covered
+void printCoverage(const CoverageMap &map, std::ostream &out);
+
+#endif
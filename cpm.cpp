@@ -0,0 +1,77 @@
+#include "cpm.h"
+
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <vector>
+
+void loadCom(CPM &cpm, const std::string &fileName) {
+	std::ifstream input(fileName, std::ios::binary);
+	if(!input) {
+		throw std::runtime_error("Could not open file!");
+	}
+	std::vector<uint8_t> program((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+	if(program.size() > CPM_BDOS_TOP - CPM_TPA - 2) { // Leave room for the return address
+		throw std::runtime_error("Program too large!");
+	}
+	CPU &cpu = *cpm.cpu;
+	std::copy(program.begin(), program.end(), cpu.RAM + CPM_TPA);
+	markCode(cpm.loops, CPM_TPA, (uint32_t) program.size());
+
+	cpu.RAM[CPM_WARM_BOOT] = 0x76; // HLT, never reached since runCPM() stops at 0x0000
+	cpu.RAM[CPM_BDOS] = 0xc3; // JMP CPM_BDOS_TOP
+	cpu.RAM[CPM_BDOS + 1] = CPM_BDOS_TOP & 0xff;
+	cpu.RAM[CPM_BDOS + 2] = CPM_BDOS_TOP >> 8;
+	cpu.RAM[CPM_BDOS_TOP] = 0xc9; // RET, likewise trapped at 0x0005 instead
+	cpu.SP = CPM_BDOS_TOP - 2; // A RET from the program goes to 0x0000
+	cpu.RAM[cpu.SP] = CPM_WARM_BOOT & 0xff;
+	cpu.RAM[cpu.SP + 1] = CPM_WARM_BOOT >> 8;
+	cpu.PC = CPM_TPA;
+}
+
+void flushConsole(CPM &cpm) {
+	if(cpm.console && !cpm.output.empty()) {
+		fwrite(cpm.output.data(), 1, cpm.output.size(), cpm.console);
+		fflush(cpm.console);
+		cpm.output.clear();
+	}
+}
+
+void bdosCall(CPM &cpm) {
+	CPU &cpu = *cpm.cpu;
+	if(cpu.C == 9) {
+		// A string with no '$' prints the whole of memory once rather than looping forever
+		uint16_t address = cpu.DE;
+		for(uint32_t i = 0; i < RAM_SIZE && cpu.RAM[address] != '$'; i++, address++) {
+			cpm.output += cpu.RAM[address];
+		}
+	} else if(cpu.C == 2) {
+		cpm.output += cpu.E;
+	}
+	RET(cpm.cpu);
+	cpm.cycles += 10; // The RET
+	// The exercisers print a line per test minutes apart, so lines are written as they finish
+	if(cpm.output.size() >= CPM_FLUSH_SIZE || (!cpm.output.empty() && cpm.output.back() == '\n')) {
+		flushConsole(cpm);
+	}
+}
+
+bool runCPM(CPM &cpm) {
+	unique_ptr<CPU> &cpu = cpm.cpu;
+	uint64_t cycles = cpm.cycles;
+	while(cpu->PC != CPM_WARM_BOOT) {
+		if(cpu->PC == CPM_BDOS) {
+			cpm.cycles = cycles;
+			bdosCall(cpm);
+			cycles = cpm.cycles;
+		} else if(cpu->halted) {
+			break;
+		} else {
+			int native = atBlockLoop(*cpu, cpm.loops) ? runBlockLoop(cpu, cpm.loops, UINT64_MAX) : 0;
+			cycles += native ? native : emulate8080(cpu);
+		}
+	}
+	cpm.cycles = cycles;
+	flushConsole(cpm);
+	return cpu->PC == CPM_WARM_BOOT;
+}
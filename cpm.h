@@ -0,0 +1,37 @@
+#ifndef CPM_H
+#define CPM_H
+
+#include "blockloop.h"
+#include "cpu.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+// Just enough of CP/M 2.2 to run .COM test programs like cpudiag, TST8080 and 8080EXM.
+// Programs load at 0x0100, print through CALL 5 and finish by jumping to 0x0000 (warm boot).
+const uint16_t CPM_WARM_BOOT = 0x0000;
+const uint16_t CPM_BDOS = 0x0005;
+const uint16_t CPM_TPA = 0x0100; // Where .COM files are loaded and started
+const uint16_t CPM_BDOS_TOP = 0xfe00; // Bottom of the "BDOS", programs read it from 0x0006 to set SP
+const std::size_t CPM_FLUSH_SIZE = 4096;
+
+struct CPM {
+	unique_ptr<CPU> cpu = unique_ptr<CPU>(new CPU());
+	uint64_t cycles = 0;
+	BlockLoops loops; // The program is marked as code
+	FILE *console = stdout; // nullptr keeps everything in output
+	std::string output; // Console output not written yet
+};
+
+// Loads a .COM file at 0x0100 and sets up page zero so the program can find the BDOS
+void loadCom(CPM &cpm, const std::string &fileName);
+// Handles a CALL 5 natively and returns to the caller. Function 2 prints E and function 9
+// prints the '$' terminated string at DE; nothing else is supported.
+void bdosCall(CPM &cpm);
+// Runs until the program jumps to 0x0000. Returns false if it halted instead.
+bool runCPM(CPM &cpm);
+void flushConsole(CPM &cpm);
+
+#endif
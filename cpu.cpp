@@ -1,58 +1,90 @@
+#include "cpu.h"
+#ifdef COUNTERS
+#include "counters.h"
+#endif
+#ifdef COVERAGE
+#include "coverage.h"
+#endif
+
 #include <fstream>
 #include <iterator>
 #include <algorithm>
 #include <stdexcept>
-#include <cstdint>
-#include <vector>
-#include <iostream>
-#include <memory>
-#include <stdio.h>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
 
-using std::uint8_t;
-using std::uint16_t;
-using std::uint32_t;
-using std::cout;
-using std::endl;
-using std::unique_ptr;
 
-struct Flags {
-	uint8_t Z:1;
-	uint8_t S:1;
-	uint8_t P:1;
-	uint8_t CY:1;
-	uint8_t AC:1;
+const uint8_t OPCODE_CYCLES[256] = {
+	4, 10, 7, 5, 5, 5, 7, 4, 4, 10, 7, 5, 5, 5, 7, 4, // 0x00
+	4, 10, 7, 5, 5, 5, 7, 4, 4, 10, 7, 5, 5, 5, 7, 4, // 0x10
+	4, 10, 16, 5, 5, 5, 7, 4, 4, 10, 16, 5, 5, 5, 7, 4, // 0x20
+	4, 10, 13, 5, 10, 10, 10, 4, 4, 10, 13, 5, 5, 5, 7, 4, // 0x30
+	5, 5, 5, 5, 5, 5, 7, 5, 5, 5, 5, 5, 5, 5, 7, 5, // 0x40
+	5, 5, 5, 5, 5, 5, 7, 5, 5, 5, 5, 5, 5, 5, 7, 5, // 0x50
+	5, 5, 5, 5, 5, 5, 7, 5, 5, 5, 5, 5, 5, 5, 7, 5, // 0x60
+	7, 7, 7, 7, 7, 7, 7, 7, 5, 5, 5, 5, 5, 5, 7, 5, // 0x70
+	4, 4, 4, 4, 4, 4, 7, 4, 4, 4, 4, 4, 4, 4, 7, 4, // 0x80
+	4, 4, 4, 4, 4, 4, 7, 4, 4, 4, 4, 4, 4, 4, 7, 4, // 0x90
+	4, 4, 4, 4, 4, 4, 7, 4, 4, 4, 4, 4, 4, 4, 7, 4, // 0xa0
+	4, 4, 4, 4, 4, 4, 7, 4, 4, 4, 4, 4, 4, 4, 7, 4, // 0xb0
+	5, 10, 10, 10, 11, 11, 7, 11, 5, 10, 10, 10, 11, 17, 7, 11, // 0xc0
+	5, 10, 10, 10, 11, 11, 7, 11, 5, 10, 10, 10, 11, 17, 7, 11, // 0xd0
+	5, 10, 10, 18, 11, 11, 7, 11, 5, 5, 10, 4, 11, 17, 7, 11, // 0xe0
+	5, 10, 10, 4, 11, 11, 7, 11, 5, 5, 10, 4, 11, 17, 7, 11 // 0xf0
 };
 
-struct CPU {
-	// Registors
-	uint8_t A = 0x00;
-	uint8_t B = 0x00;
-	uint8_t C = 0x00;
-	uint8_t D = 0x00;
-	uint8_t E = 0x00;
-	uint8_t H = 0x00;
-	uint8_t L = 0x00;
-	uint16_t SP = 0x0000;
-	// Other Stuff
-	uint16_t PC = 0x0000;
-	std::array<uint8_t, 0x10000> RAM;
-	struct Flags f;
-	uint8_t int_enable = 0x00;
+const uint8_t OPCODE_SIZES[256] = {
+	1, 3, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1, // 0x00
+	1, 3, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1, // 0x10
+	1, 3, 3, 1, 1, 1, 2, 1, 1, 1, 3, 1, 1, 1, 2, 1, // 0x20
+	1, 3, 3, 1, 1, 1, 2, 1, 1, 1, 3, 1, 1, 1, 2, 1, // 0x30
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x40
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x50
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x60
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x70
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x80
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x90
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0xa0
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0xb0
+	1, 1, 3, 3, 3, 1, 2, 1, 1, 1, 3, 3, 3, 3, 2, 1, // 0xc0
+	1, 1, 3, 2, 3, 1, 2, 1, 1, 1, 3, 2, 3, 3, 2, 1, // 0xd0
+	1, 1, 3, 1, 3, 1, 2, 1, 1, 1, 3, 1, 3, 3, 2, 1, // 0xe0
+	1, 1, 3, 1, 3, 1, 2, 1, 1, 1, 3, 1, 3, 3, 2, 1 // 0xf0
 };
 
 void RET(unique_ptr<CPU> &cpu) {
 	uint16_t lo = cpu->RAM[cpu->SP];
-	uint16_t hi = cpu->RAM[cpu->SP + 1];
+	uint16_t hi = cpu->RAM[(uint16_t) (cpu->SP + 1)];
 	cpu->SP = cpu->SP + 2;
 	cpu->PC = (hi << 8) | lo;
 }
 
 void CALL(unique_ptr<CPU> &cpu) {
 	uint16_t ret = cpu->PC + 2;
-	cpu->RAM[cpu->SP - 1] = (ret >> 8) & 0xff;
-	cpu->RAM[cpu->SP - 2] = ret & 0xff;
+	cpu->RAM[(uint16_t) (cpu->SP - 1)] = (ret >> 8) & 0xff;
+	cpu->RAM[(uint16_t) (cpu->SP - 2)] = ret & 0xff;
+	cpu->SP = cpu->SP - 2;
+	cpu->PC = (cpu->RAM[(uint16_t) (cpu->PC - 1 + 2)] << 8) | cpu->RAM[(uint16_t) (cpu->PC - 1 + 1)]; // Creates little endian address;
+}
+
+void RST(unique_ptr<CPU> &cpu, uint16_t address) {
+	cpu->RAM[(uint16_t) (cpu->SP - 1)] = (cpu->PC >> 8) & 0xff;
+	cpu->RAM[(uint16_t) (cpu->SP - 2)] = cpu->PC & 0xff;
 	cpu->SP = cpu->SP - 2;
-	cpu->PC = (cpu->RAM[cpu->PC - 1 + 2] << 8) | cpu->RAM[cpu->PC - 1 + 1]; // Creates little endian address;
+	cpu->PC = address;
+}
+
+void generateInterrupt(unique_ptr<CPU> &cpu, int vector) {
+	RST(cpu, vector * 8);
+	cpu->int_enable = 0;
+	cpu->halted = 0;
+#ifdef COUNTERS
+	countInterrupt();
+#endif
 }
 
 int parity(int x) {
@@ -67,65 +99,103 @@ int parity(int x) {
 	return (0 == (p & 0x1));
 }
 
-int ACPlus(int before, int value) {
-	int mask = 1;
-	int carry = 0;
-	for (int i = 0; i < 4; i++) {
-		if ((mask & before) + (mask & value) + carry > 1) {
-			carry = 1;
-		} else {
-			carry = 0;
-		}
-		mask = mask << 1;
+// Z, S and P come from the low byte of answer, CY from whether it overflowed and AC from the carry
+// into bit 4 of before + operand
+static void setArithmeticFlags(uint32_t answer, uint8_t before, uint8_t operand, unique_ptr<CPU> &cpu) {
+	cpu->f.answer = answer;
+	cpu->f.acBefore = before;
+	cpu->f.acOperand = operand;
+	cpu->f.lazy |= FLAG_Z | FLAG_S | FLAG_P | FLAG_CY | FLAG_AC;
+}
+
+// ADD, ADC, ADI and ACI
+static uint8_t add(unique_ptr<CPU> &cpu, uint8_t value, int carry) {
+	uint32_t answer = cpu->A + value + carry;
+	setArithmeticFlags(answer, cpu->A, value, cpu);
+	return answer;
+}
+
+// SUB, SBB, SUI, SBI, CMP and CPI. The 8080 adds the complement, so AC is the carry of
+// A + ~value + !borrow, while CY is set on a borrow.
+static uint8_t subtract(unique_ptr<CPU> &cpu, uint8_t value, int borrow) {
+	uint32_t answer = (uint32_t) cpu->A - value - borrow;
+	setArithmeticFlags(answer, cpu->A, ~value, cpu);
+	return answer;
+}
+
+// INR and DCR (which adds 0xff) leave CY alone
+static uint8_t increment(unique_ptr<CPU> &cpu, uint8_t value, int amount) {
+	if(cpu->f.lazy & FLAG_CY) { // CY comes from the old answer, so work it out before replacing it
+		setFlag(cpu->f, FLAG_CY, getFlag(cpu->f, FLAG_CY));
 	}
-	if (carry) {
-		return 1;
+	uint8_t answer = value + amount;
+	cpu->f.answer = answer;
+	cpu->f.acBefore = value;
+	cpu->f.acOperand = amount > 0 ? 0x01 : 0xfe; // DCR adds ~1 with a carry in
+	cpu->f.lazy |= FLAG_Z | FLAG_S | FLAG_P | FLAG_AC;
+	return answer;
+}
+
+// ANA, XRA, ORA and their immediates clear CY
+static void logic(unique_ptr<CPU> &cpu, uint8_t answer, int ac) {
+	cpu->A = answer;
+	cpu->f.answer = answer;
+	cpu->f.lazy |= FLAG_Z | FLAG_S | FLAG_P;
+	setFlag(cpu->f, FLAG_CY, 0);
+	setFlag(cpu->f, FLAG_AC, ac);
+}
+
+// Over-allocates and keeps the pointer malloc returned just in front of the aligned block
+static void *alignedAlloc(std::size_t size, std::size_t alignment) {
+	void *block = std::malloc(size + alignment + sizeof(void *));
+	if(!block) {
+		throw std::bad_alloc();
 	}
-	return carry == 1;
+	uintptr_t address = (reinterpret_cast<uintptr_t>(block) + sizeof(void *) + alignment - 1) & ~(uintptr_t) (alignment - 1);
+	reinterpret_cast<void **>(address)[-1] = block;
+	return reinterpret_cast<void *>(address);
 }
 
-int ACMinus(int before, int value) {
-	int borrow = 0;
-	int mask = 1 << 3;
-	for (int i = 0; i < 4; i++) {
-		if ((mask & before) < (mask & value)) {
-			if (borrow) {
-				borrow--;
-			} else {
-				borrow = -1;
-				break;
-			}
-		} else if (mask & before) {
-			borrow++;
-		}
-		mask = mask >> 1;
+static void alignedFree(void *pointer) {
+	if(pointer) {
+		std::free(reinterpret_cast<void **>(pointer)[-1]);
 	}
-	return borrow == -1;
 }
 
-void setArithmeticFlags(uint16_t answer, unique_ptr<CPU> &cpu) {
-	cpu->f.Z = ((answer & 0xff) == 0);
-    cpu->f.S = ((answer & 0x80) == 0x80);
-    cpu->f.CY = (answer > 0xff);
-    cpu->f.P = parity(answer & 0xff);
+// Anonymous pages read as zero and take no memory until written
+static uint8_t *mapMemory(uint8_t *at) {
+#ifdef _WIN32
+	if(!at) {
+		at = static_cast<uint8_t *>(alignedAlloc(RAM_SIZE, RAM_ALIGNMENT));
+	}
+	std::memset(at, 0, RAM_SIZE);
+	return at;
+#else
+	void *memory = mmap(at, RAM_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | (at ? MAP_FIXED : 0), -1, 0);
+	if(memory == MAP_FAILED) {
+		throw std::bad_alloc();
+	}
+	return static_cast<uint8_t *>(memory);
+#endif
+}
+
+CPU::CPU() : RAM(mapMemory(nullptr)) {
 }
 
-void setArithmeticFlags(uint32_t answer, unique_ptr<CPU> &cpu) {
-	cpu->f.Z = ((answer & 0xff) == 0);
-    cpu->f.S = ((answer & 0x80) == 0x80);
-    cpu->f.CY = (answer > 0xff);
-    cpu->f.P = parity(answer & 0xff);
+CPU::~CPU() {
+#ifdef _WIN32
+	alignedFree(RAM);
+#else
+	munmap(RAM, RAM_SIZE);
+#endif
 }
 
-void setLogicFlags(unique_ptr<CPU> &cpu) {
-	cpu->f.Z = (cpu->A == 0);
-	cpu->f.S = (0x80 == (cpu->A & 0x80));
-	cpu->f.P = parity(cpu->A);
+void *CPU::operator new(std::size_t size) {
+	return alignedAlloc(size, CACHE_LINE_SIZE);
 }
 
-void UnimplementedInstruction(uint8_t opCode) {
-	cout << "Unimplemented Instruction: " << static_cast<int>(opCode) << endl;
-	exit(1);
+void CPU::operator delete(void *pointer) {
+	alignedFree(pointer);
 }
 
 void loadRom(std::string fileName, unique_ptr<CPU> &cpu, uint32_t offset) {
@@ -135,306 +205,339 @@ void loadRom(std::string fileName, unique_ptr<CPU> &cpu, uint32_t offset) {
 	}
 	std::noskipws(input);
 
-	std::copy(std::istream_iterator<uint8_t>(input), std::istream_iterator<uint8_t>(), cpu->RAM.begin() + offset);
+	std::copy(std::istream_iterator<uint8_t>(input), std::istream_iterator<uint8_t>(), cpu->RAM + offset);
+}
+
+void clearMemory(CPU &cpu) {
+	mapMemory(cpu.RAM); // Fresh pages over the old ones
+}
+
+void writeMemory(CPU &cpu, const uint8_t *data) {
+	for(uint32_t page = 0; page < RAM_SIZE; page += RAM_ALIGNMENT) {
+		if(std::memcmp(cpu.RAM + page, data + page, RAM_ALIGNMENT) != 0) {
+			std::memcpy(cpu.RAM + page, data + page, RAM_ALIGNMENT);
+		}
+	}
+}
+
+// Whether the condition of a Jcc, Ccc or Rcc holds: NZ, Z, NC, C, PO, PE, P, M
+static bool condition(const CPU &cpu, uint8_t opCode) {
+	const uint8_t flags[4] = {FLAG_Z, FLAG_CY, FLAG_P, FLAG_S};
+	return getFlag(cpu.f, flags[(opCode >> 4) & 3]) == ((opCode >> 3) & 1);
+}
+
+int dataAccesses(const CPU &cpu, uint16_t pc, DataAccess accesses[MAX_DATA_ACCESSES]) {
+	uint8_t opCode = cpu.RAM[pc];
+	uint16_t direct = (cpu.RAM[(uint16_t) (pc + 2)] << 8) | cpu.RAM[(uint16_t) (pc + 1)];
+	int count = 0;
+	auto read = [&](uint16_t address) {
+		accesses[count++] = {address, false};
+	};
+	auto write = [&](uint16_t address) {
+		accesses[count++] = {address, true};
+	};
+	auto push = [&]() {
+		write(cpu.SP - 1);
+		write(cpu.SP - 2);
+	};
+	auto pop = [&]() {
+		read(cpu.SP);
+		read(cpu.SP + 1);
+	};
+
+	if(opCode >= 0x40 && opCode < 0xc0 && opCode != 0x76) { // MOV, ALU
+		if((opCode & 0x07) == 0x06) {
+			read(cpu.HL);
+		} else if((opCode & 0xf8) == 0x70) {
+			write(cpu.HL);
+		}
+		return count;
+	}
+	switch(opCode & 0xcf) {
+		case 0xc1: // POP
+			pop();
+			return count;
+		case 0xc5: // PUSH
+			push();
+			return count;
+	}
+	switch(opCode & 0xc7) {
+		case 0xc0: // Rcc
+			if(condition(cpu, opCode)) {
+				pop();
+			}
+			return count;
+		case 0xc4: // Ccc
+			if(condition(cpu, opCode)) {
+				push();
+			}
+			return count;
+		case 0xc7: // RST
+			push();
+			return count;
+	}
+	switch(opCode) {
+		case 0x34: // INR M
+		case 0x35: // DCR M
+			read(cpu.HL);
+			write(cpu.HL);
+			break;
+		case 0x36: // MVI M
+			write(cpu.HL);
+			break;
+		case 0x02: // STAX B
+			write(cpu.BC);
+			break;
+		case 0x12: // STAX D
+			write(cpu.DE);
+			break;
+		case 0x0a: // LDAX B
+			read(cpu.BC);
+			break;
+		case 0x1a: // LDAX D
+			read(cpu.DE);
+			break;
+		case 0x32: // STA
+			write(direct);
+			break;
+		case 0x3a: // LDA
+			read(direct);
+			break;
+		case 0x22: // SHLD
+			write(direct);
+			write(direct + 1);
+			break;
+		case 0x2a: // LHLD
+			read(direct);
+			read(direct + 1);
+			break;
+		case 0xe3: // XTHL
+			pop();
+			write(cpu.SP);
+			write(cpu.SP + 1);
+			break;
+		case 0xc9: // RET
+		case 0xd9:
+			pop();
+			break;
+		case 0xcd: // CALL
+		case 0xdd:
+		case 0xed:
+		case 0xfd:
+			push();
+			break;
+	}
+	return count;
 }
 
-void emulate8080(unique_ptr<CPU> &cpu) {
+int emulate8080(unique_ptr<CPU> &cpu) {
 	cpu->PC++; // Causes all uses of this to subtract 1
-	uint8_t opCode = cpu->RAM[cpu->PC - 1];
+	uint8_t opCode = cpu->RAM[(uint16_t) (cpu->PC - 1)];
+	int cycles = OPCODE_CYCLES[opCode]; // Taken conditional CALLs and RETs add 6
 	uint32_t address1;
 	uint32_t address2;
 	uint32_t answer;
+#if defined(COUNTERS) || defined(COVERAGE)
+	uint16_t pc = cpu->PC - 1;
+#endif
+#ifdef COUNTERS
+	countMemory(*cpu, opCode, pc);
+#endif
 
 	//cout << static_cast<int>(opCode) << endl;
 	switch(opCode) {
 		case 0x00: // NOP 
 			break;
 		case 0x01: // LXI B,D16
-			cpu->C = cpu->RAM[cpu->PC - 1 + 1];
-			cpu->B = cpu->RAM[cpu->PC - 1 + 2];
+			cpu->BC = (cpu->RAM[(uint16_t) (cpu->PC - 1 + 2)] << 8) | cpu->RAM[(uint16_t) (cpu->PC - 1 + 1)];
 			cpu->PC += 2;
 			break;
 		case 0x02: // STAX B
-			address1 = (cpu->B << 8) | cpu->C; // Creates the address (BC)
+			address1 = cpu->BC;
 			cpu->RAM[address1] = cpu->A;
 			break;
 		case 0x03: // INX B
-			cpu->C++;
-			if(cpu->C == 0) {
-				cpu->B++;
-			} // Add one to address created from (BC)
+			cpu->BC++;
 			break;
 		case 0x04: // INR B
-			address1 = cpu->f.CY; // Temp variable to store old CY
-			cpu->f.AC = ACPlus(cpu->B, 1);
-			answer = (uint16_t) cpu->B + 1;
-			setArithmeticFlags(answer, cpu);
-			cpu->B = cpu->B + 1;
-			cpu->f.CY = address1;
+			cpu->B = increment(cpu, cpu->B, 1);
 			break;
 		case 0x05: // DCR B
-			address1 = cpu->f.CY; // Temp variable to store old CY
-			cpu->f.AC = ACMinus(cpu->B, 1);
-			answer = (uint16_t) cpu->B - 1;
-			setArithmeticFlags(answer, cpu);
-			cpu->B = cpu->B - 1;
-			cpu->f.CY = address1;
+			cpu->B = increment(cpu, cpu->B, -1);
 			break;
 		case 0x06: // MVI B,D8
-			cpu->B = cpu->RAM[cpu->PC - 1 + 1];
+			cpu->B = cpu->RAM[(uint16_t) (cpu->PC - 1 + 1)];
 			cpu->PC++;
 			break;
 		case 0x07: // RLC
-			cpu->f.CY = (cpu->A >> 7) & 1; // 7th bit
+			setFlag(cpu->f, FLAG_CY, (cpu->A >> 7) & 1); // 7th bit
 			cpu->A = cpu->A << 1;
-			cpu->A = cpu->A | cpu->f.CY; // Set 0th bit to CY
+			cpu->A = cpu->A | getFlag(cpu->f, FLAG_CY); // Set 0th bit to CY
 			break;
-		case 0x08: // -
-			UnimplementedInstruction(opCode);
+		case 0x08: // Undocumented NOP
 			break;
 		case 0x09: // DAD B
-			address1 = (cpu->H << 8) | cpu->L; // Creates the address HL
-			address2 = (cpu->B << 8) | cpu->C; // Creates the address BC
-			answer = address1 + address2;
-			cpu->H = (answer & 0xff00) >> 8;
-			cpu->L = answer & 0xff;
-			cpu->f.CY = ((answer & 0xffff0000) != 0);
+			answer = cpu->HL + cpu->BC;
+			cpu->HL = answer;
+			setFlag(cpu->f, FLAG_CY, ((answer & 0xffff0000) != 0));
 			break;
 		case 0x0a: // LDAX B
-			address1 = (cpu->B << 8) | cpu->C;
+			address1 = cpu->BC;
 			cpu->A = cpu->RAM[(uint16_t) address1];
 			break;
 		case 0x0b: // DCX B
-			cpu->C--;
-			if(cpu->C == 255) {
-				cpu->B--;
-			} // Subtract one to address created from (BC)
+			cpu->BC--;
 			break;
 		case 0x0c: // INR C
-			address1 = cpu->f.CY; // Temp variable to store old CY
-			cpu->f.AC = ACPlus(cpu->C, 1);
-			answer = (uint16_t) cpu->C + 1;
-			setArithmeticFlags(answer, cpu);
-			cpu->C = cpu->C + 1;
-			cpu->f.CY = address1;
+			cpu->C = increment(cpu, cpu->C, 1);
 			break;
 		case 0x0d: // DCR C
-			address1 = cpu->f.CY; // Temp variable to store old CY
-			cpu->f.AC = ACMinus(cpu->C, 1);
-			answer = (uint16_t) cpu->C - (uint16_t) 1;
-			setArithmeticFlags(answer, cpu);
-			cpu->C = cpu->C - 1;
-			cpu->f.CY = address1;
+			cpu->C = increment(cpu, cpu->C, -1);
 			break;
 		case 0x0e: // MVI C,D8
-			cpu->C = cpu->RAM[cpu->PC - 1 + 1];
+			cpu->C = cpu->RAM[(uint16_t) (cpu->PC - 1 + 1)];
 			cpu->PC++;
 			break;
 		case 0x0f: // RRC
-			cpu->f.CY = cpu->A & 1; // 0th bit
+			setFlag(cpu->f, FLAG_CY, cpu->A & 1); // 0th bit
 			cpu->A = cpu->A >> 1;
-			cpu->A = cpu->A | (cpu->f.CY << 7); // Set the 7th bit to CY
+			cpu->A = cpu->A | (getFlag(cpu->f, FLAG_CY) << 7); // Set the 7th bit to CY
 			break;
-		case 0x10: // -
-			UnimplementedInstruction(opCode);
+		case 0x10: // Undocumented NOP
 			break;
 		case 0x11: // LXI D,D16
-			cpu->E = cpu->RAM[cpu->PC - 1 + 1];
-			cpu->D = cpu->RAM[cpu->PC - 1 + 2];
+			cpu->DE = (cpu->RAM[(uint16_t) (cpu->PC - 1 + 2)] << 8) | cpu->RAM[(uint16_t) (cpu->PC - 1 + 1)];
 
 			cpu->PC += 2;
 			break;
 		case 0x12: // STAX D
-			address1 = (cpu->D << 8) | cpu->E; // Creates the address (DE)
+			address1 = cpu->DE;
 			cpu->RAM[address1] = cpu->A;
 			break;
 		case 0x13: // INX D
-			cpu->E++;
-			if(cpu->E == 0) {
-				cpu->D++;
-			} // Add one to address created from (DE)
+			cpu->DE++;
 			break;
 		case 0x14: // INR D
-			address1 = cpu->f.CY; // Temp variable to store old CY
-			cpu->f.AC = ACPlus(cpu->D, 1);
-			answer = (uint16_t) cpu->D + 1;
-			setArithmeticFlags(answer, cpu);
-			cpu->D = cpu->D + 1;
-			cpu->f.CY = address1;
+			cpu->D = increment(cpu, cpu->D, 1);
 			break;
 		case 0x15: // DCR D
-			address1 = cpu->f.CY; // Temp variable to store old CY
-			cpu->f.AC = ACMinus(cpu->D, 1);
-			answer = (uint16_t) cpu->D - (uint16_t) 1;
-			setArithmeticFlags(answer, cpu);
-			cpu->D = cpu->D - 1;
-			cpu->f.CY = address1;
+			cpu->D = increment(cpu, cpu->D, -1);
 			break;
 		case 0x16: // MVI D,D8
-			cpu->D = cpu->RAM[cpu->PC - 1 + 1];
+			cpu->D = cpu->RAM[(uint16_t) (cpu->PC - 1 + 1)];
 			cpu->PC++;
 			break;
 		case 0x17: // RAL
-			answer = cpu->f.CY;
-			cpu->f.CY = (cpu->A >> 7) & 1; // 7th bit
+			answer = getFlag(cpu->f, FLAG_CY);
+			setFlag(cpu->f, FLAG_CY, (cpu->A >> 7) & 1); // 7th bit
 			cpu->A = cpu->A << 1;
 			cpu->A = cpu->A | answer; // Set the 0th bit to previous CY (stored in answer)
 			break;
-		case 0x18: // -
-			UnimplementedInstruction(opCode);
+		case 0x18: // Undocumented NOP
 			break;
 		case 0x19: // DAD D
-			address1 = (cpu->H << 8) | cpu->L; // Creates the address HL
-			address2 = (cpu->D << 8) | cpu->E; // Creates the address DE
-			answer = address1 + address2;
-			cpu->H = (answer & 0xff00) >> 8;
-			cpu->L = answer & 0xff;
-			cpu->f.CY = ((answer & 0xffff0000) != 0);
+			answer = cpu->HL + cpu->DE;
+			cpu->HL = answer;
+			setFlag(cpu->f, FLAG_CY, ((answer & 0xffff0000) != 0));
 			break;
 		case 0x1a: // LDAX D
-			address1 = (cpu->D << 8) | cpu->E;
+			address1 = cpu->DE;
 			cpu->A = cpu->RAM[address1];
 			break;
 		case 0x1b: // DCX D
-			cpu->E--;
-			if(cpu->E == 255) {
-				cpu->D--;
-			} // Subtract one to address created from DC
+			cpu->DE--;
 			break;
 		case 0x1c: // INR E
-			address1 = cpu->f.CY; // Temp variable to store old CY
-			cpu->f.AC = ACPlus(cpu->E, 1);
-			answer = (uint16_t) cpu->E + 1;
-			setArithmeticFlags(answer, cpu);
-			cpu->E = cpu->E + 1;
-			cpu->f.CY = address1;
+			cpu->E = increment(cpu, cpu->E, 1);
 			break;
 		case 0x1d: // DCR E
-			address1 = cpu->f.CY; // Temp variable to store old CY
-			cpu->f.AC = ACMinus(cpu->E, 1);
-			answer = (uint16_t) cpu->E - (uint16_t) 1;
-			setArithmeticFlags(answer, cpu);
-			cpu->E = cpu->E - 1;
-			cpu->f.CY = address1;
+			cpu->E = increment(cpu, cpu->E, -1);
 			break;
 		case 0x1e: // MVI E,D8
-			cpu->E = cpu->RAM[cpu->PC - 1 + 1];
+			cpu->E = cpu->RAM[(uint16_t) (cpu->PC - 1 + 1)];
 			cpu->PC++;
 			break;
 		case 0x1f: // RAR
-			answer = (cpu->A >> 7) & 1; // 7th bit
-			cpu->f.CY = cpu->A & 1; // 0th bit
+			answer = getFlag(cpu->f, FLAG_CY);
+			setFlag(cpu->f, FLAG_CY, cpu->A & 1); // 0th bit
 			cpu->A = cpu->A >> 1;
-			cpu->A = cpu->A | (cpu->f.CY << 7); // Set the 7th bit to prev 7th bit (stored in answer)
+			cpu->A = cpu->A | (answer << 7); // Set the 7th bit to previous CY (stored in answer)
 			break;
-		case 0x20: // RIM
-			UnimplementedInstruction(opCode);
+		case 0x20: // Undocumented NOP (RIM on the 8085)
 			break;
 		case 0x21: // LXI H, D16
-			cpu->L = cpu->RAM[cpu->PC - 1 + 1];
-			cpu->H = cpu->RAM[cpu->PC - 1 + 2];
+			cpu->HL = (cpu->RAM[(uint16_t) (cpu->PC - 1 + 2)] << 8) | cpu->RAM[(uint16_t) (cpu->PC - 1 + 1)];
 			cpu->PC += 2;
 			break;
 		case 0x22: // SHLD addr
-			address1 = (cpu->RAM[cpu->PC - 1 + 2] << 8) | cpu->RAM[cpu->PC - 1 + 1]; // Creates little endian address
+			address1 = (cpu->RAM[(uint16_t) (cpu->PC - 1 + 2)] << 8) | cpu->RAM[(uint16_t) (cpu->PC - 1 + 1)]; // Creates little endian address
 			cpu->RAM[address1] = cpu->L;
-			cpu->RAM[address1 + 1] = cpu->H;
+			cpu->RAM[(uint16_t) (address1 + 1)] = cpu->H;
 			cpu->PC += 2;
 			break;
 		case 0x23: // INX H
-			cpu->L++;
-			if(cpu->L == 0) {
-				cpu->H++;
-			} // Add one to address created from (HL)
+			cpu->HL++;
 			break;
 		case 0x24: // INR H
-			address1 = cpu->f.CY; // Temp variable to store old CY
-			cpu->f.AC = ACPlus(cpu->H, 1);
-			answer = (uint16_t) cpu->H + 1;
-			setArithmeticFlags(answer, cpu);
-			cpu->H = cpu->H + 1;
-			cpu->f.CY = address1;
+			cpu->H = increment(cpu, cpu->H, 1);
 			break;
 		case 0x25: // DCR H
-			address1 = cpu->f.CY; // Temp variable to store old CY
-			cpu->f.AC = ACMinus(cpu->H, 1);
-			answer = (uint16_t) cpu->H - (uint16_t) 1;
-			setArithmeticFlags(answer, cpu);
-			cpu->H = cpu->H - 1;
-			cpu->f.CY = address1;
+			cpu->H = increment(cpu, cpu->H, -1);
 			break;
 		case 0x26: // MVI H,D8
-			cpu->H = cpu->RAM[cpu->PC - 1 + 1];
+			cpu->H = cpu->RAM[(uint16_t) (cpu->PC - 1 + 1)];
 			cpu->PC++;
 			break;
 		case 0x27: // DAA
-			answer = cpu->A;
-			if(static_cast<int>(cpu->A & 0x0f) > 9 || cpu->f.AC) { // if 4 least signifcant bits are greater than 9 or AC is set
-				answer = cpu->A + 6;
-				cpu->A = cpu->A + 6;
-				cpu->f.AC = answer > cpu->A;
-			} if(static_cast<int>(cpu->A >> 4) > 9 || cpu->f.CY) { // if 4 most signifcant bits are greater than 9 or CY is set
-				answer = (((cpu->A >> 4) + 6) << 4) | (cpu->A & 0x0f); // Add 6 to 4 most signifcant bits while keeping the rest the same
-				cout << static_cast<int>(answer);
-				cpu->A = (((cpu->A >> 4) + 6) << 4) | (answer & 0x0f);
+			address1 = 0; // Correction to add
+			address2 = getFlag(cpu->f, FLAG_CY); // DAA can set CY but never clears it
+			if((cpu->A & 0x0f) > 9 || getFlag(cpu->f, FLAG_AC)) {
+				address1 = 0x06;
 			}
-			setArithmeticFlags(answer, cpu);
+			if((cpu->A >> 4) > 9 || address2 || ((cpu->A >> 4) == 9 && (cpu->A & 0x0f) > 9)) {
+				address1 |= 0x60;
+				address2 = 1;
+			}
+			cpu->A = add(cpu, address1, 0);
+			setFlag(cpu->f, FLAG_CY, address2);
 			break;
-		case 0x28: // -
-			UnimplementedInstruction(opCode);
+		case 0x28: // Undocumented NOP
 			break;
 		case 0x29: // DAD H
-			address1 = (cpu->H << 8) | cpu->L; // Creates the address HL
-			address2 = (cpu->B << 8) | cpu->C; // Creates the address HL
-			answer = address1 + address2;
-			cpu->H = (answer & 0xff00) >> 8;
-			cpu->L = answer & 0xff;
-			cpu->f.CY = ((answer & 0xffff0000) != 0);
+			answer = cpu->HL + cpu->HL;
+			cpu->HL = answer;
+			setFlag(cpu->f, FLAG_CY, ((answer & 0xffff0000) != 0));
 			break;
 		case 0x2a: // LHLD adr
-			address1 = (cpu->RAM[cpu->PC - 1 + 2] << 8) | cpu->RAM[cpu->PC - 1 + 1]; // Creates little endian address
+			address1 = (cpu->RAM[(uint16_t) (cpu->PC - 1 + 2)] << 8) | cpu->RAM[(uint16_t) (cpu->PC - 1 + 1)]; // Creates little endian address
 			cpu->L = cpu->RAM[address1];
-			cpu->H = cpu->RAM[address1 + 1];
+			cpu->H = cpu->RAM[(uint16_t) (address1 + 1)];
 			cpu->PC += 2;
 			break;
 		case 0x2b: // DCX H
-			cpu->L--;
-			if(cpu->L == 255) {
-				cpu->H--;
-			} // Subtract one to address created from (HL)
+			cpu->HL--;
 			break;
 		case 0x2c: // INR L
-			address1 = cpu->f.CY; // Temp variable to store old CY
-			cpu->f.AC = ACPlus(cpu->L, 1);
-			answer = (uint16_t) cpu->L + 1;
-			setArithmeticFlags(answer, cpu);
-			cpu->L = cpu->L + 1;
-			cpu->f.CY = address1;
+			cpu->L = increment(cpu, cpu->L, 1);
 			break;
 		case 0x2d: // DCR L
-			address1 = cpu->f.CY; // Temp variable to store old CY
-			cpu->f.AC = ACMinus(cpu->L, 1);
-			answer = (uint16_t) cpu->L - (uint16_t) 1;
-			setArithmeticFlags(answer, cpu);
-			cpu->L = cpu->L - 1;
-			cpu->f.CY = address1;
+			cpu->L = increment(cpu, cpu->L, -1);
 			break;
 		case 0x2e: // MVI L,D8
-			cpu->L = cpu->RAM[cpu->PC - 1 + 1];
+			cpu->L = cpu->RAM[(uint16_t) (cpu->PC - 1 + 1)];
 			cpu->PC++;
 			break;
 		case 0x2f: // CMA
 			cpu->A = ~cpu->A;
 			break;
-		case 0x30: // SIM
-			UnimplementedInstruction(opCode);
+		case 0x30: // Undocumented NOP (SIM on the 8085)
 			break;
 		case 0x31: // LXI SP,D16
-			cpu->SP = (cpu->RAM[cpu->PC - 1 + 2] << 8) | (cpu->RAM[cpu->PC - 1 + 1]);
+			cpu->SP = (cpu->RAM[(uint16_t) (cpu->PC - 1 + 2)] << 8) | (cpu->RAM[(uint16_t) (cpu->PC - 1 + 1)]);
 			cpu->PC += 2;
 			break;
 		case 0x32: // STA adr
-			address1 = (cpu->RAM[cpu->PC - 1 + 2] << 8) | cpu->RAM[cpu->PC - 1 + 1]; // Creates little endian address
+			address1 = (cpu->RAM[(uint16_t) (cpu->PC - 1 + 2)] << 8) | cpu->RAM[(uint16_t) (cpu->PC - 1 + 1)]; // Creates little endian address
 			cpu->RAM[address1] = cpu->A;
 			cpu->PC += 2;
 			break;
@@ -442,50 +545,28 @@ void emulate8080(unique_ptr<CPU> &cpu) {
 			cpu->SP = cpu->SP + 1;
 			break;
 		case 0x34: // INR M
-			address1 = cpu->f.CY; // Temp variable to store old CY
-			address1 = (cpu->H << 8) | cpu->L;
-			cpu->f.AC = ACPlus(address1, 1);
-			answer = (uint32_t) address1 + 1;
-			setArithmeticFlags(answer, cpu);
-			cpu->f.CY = address1;
-			cpu->L = cpu->L + 1;
-			if(cpu->L == 0) {
-				cpu->H = cpu->H + 1;
-			}
+			cpu->RAM[cpu->HL] = increment(cpu, cpu->RAM[cpu->HL], 1);
 			break;
 		case 0x35: // DCR M
-			address1 = cpu->f.CY; // Temp variable to store old CY
-			address1 = (cpu->H << 8) | cpu->L;
-			cpu->f.AC = ACMinus(address1, 1);
-			answer = (uint32_t) address1 - (uint16_t) 1;
-			setArithmeticFlags(answer, cpu);
-			cpu->f.CY = address1;
-			cpu->L = cpu->L - 1;
-			if(cpu->L == 255) {
-				cpu->H = cpu->H - 1;
-			}
+			cpu->RAM[cpu->HL] = increment(cpu, cpu->RAM[cpu->HL], -1);
 			break;
 		case 0x36: // MVI M,D8
-			address1 = (cpu->H << 8) | cpu->L;
-			cpu->RAM[address1] = cpu->RAM[cpu->PC - 1 + 1];
+			address1 = cpu->HL;
+			cpu->RAM[address1] = cpu->RAM[(uint16_t) (cpu->PC - 1 + 1)];
 			cpu->PC++;
 			break;
 		case 0x37: // STC
-			cpu->f.CY = 1;
+			setFlag(cpu->f, FLAG_CY, 1);
 			break;
-		case 0x38: // -
-			UnimplementedInstruction(opCode);
+		case 0x38: // Undocumented NOP
 			break;
 		case 0x39: // DAD SP
-			address1 = (cpu->H << 8) | cpu->L; // Creates the address HL
-			address2 = cpu->SP; // Creates the address SP
-			answer = address1 + address2;
-			cpu->H = (answer & 0xff00) >> 8;
-			cpu->L = answer & 0xff;
-			cpu->f.CY = ((answer & 0xffff0000) != 0);
+			answer = cpu->HL + cpu->SP;
+			cpu->HL = answer;
+			setFlag(cpu->f, FLAG_CY, ((answer & 0xffff0000) != 0));
 			break;
 		case 0x3a: // LDA adr
-			address1 = (cpu->RAM[cpu->PC - 1 + 2] << 8) | cpu->RAM[cpu->PC - 1 + 1]; // Creates little endian address
+			address1 = (cpu->RAM[(uint16_t) (cpu->PC - 1 + 2)] << 8) | cpu->RAM[(uint16_t) (cpu->PC - 1 + 1)]; // Creates little endian address
 			cpu->A = cpu->RAM[address1];
 			cpu->PC += 2;
 			break;
@@ -493,27 +574,17 @@ void emulate8080(unique_ptr<CPU> &cpu) {
 			cpu->SP = cpu->SP - 1;
 			break;
 		case 0x3c: // INR A
-			address1 = cpu->f.CY; // Temp variable to store old CY
-			cpu->f.AC = ACPlus(cpu->A, 1);
-			answer = (uint16_t) cpu->A + 1;
-			setArithmeticFlags(answer, cpu);
-			cpu->A = cpu->A + 1;
-			cpu->f.CY = address1;
+			cpu->A = increment(cpu, cpu->A, 1);
 			break;
 		case 0x3d: // DCR A
-			address1 = cpu->f.CY; // Temp variable to store old CY
-			cpu->f.AC = ACMinus(cpu->A, 1);
-			answer = (uint16_t) cpu->A - (uint16_t) 1;
-			setArithmeticFlags(answer, cpu);
-			cpu->A = cpu->A - 1;
-			cpu->f.CY = address1;
+			cpu->A = increment(cpu, cpu->A, -1);
 			break;
 		case 0x3e: // MVI A,D8
-			cpu->A = cpu->RAM[cpu->PC - 1 + 1];
+			cpu->A = cpu->RAM[(uint16_t) (cpu->PC - 1 + 1)];
 			cpu->PC++;
 			break;
 		case 0x3f: // CMC
-			cpu->f.CY = ~cpu->f.CY;
+			setFlag(cpu->f, FLAG_CY, ~getFlag(cpu->f, FLAG_CY));
 			break;
 		case 0x40: // MOV B,B
 			cpu->B = cpu->B;
@@ -534,7 +605,7 @@ void emulate8080(unique_ptr<CPU> &cpu) {
 			cpu->B = cpu->L;
 			break;
 		case 0x46: // MOV B,M
-			address1 = (cpu->H << 8) | cpu->L; // Creates the address HL
+			address1 = cpu->HL;
 			cpu->B = cpu->RAM[address1];
 			break;
 		case 0x47: // MOV B,A
@@ -559,7 +630,7 @@ void emulate8080(unique_ptr<CPU> &cpu) {
 			cpu->C = cpu->L;
 			break;
 		case 0x4e: // MOV C,M
-			address1 = (cpu->H << 8) | cpu->L; // Creates the address HL
+			address1 = cpu->HL;
 			cpu->C = cpu->RAM[address1];
 			break;
 		case 0x4f: // MOV C,A
@@ -584,7 +655,7 @@ void emulate8080(unique_ptr<CPU> &cpu) {
 			cpu->D = cpu->L;
 			break;
 		case 0x56: // MOV D,M
-			address1 = (cpu->H << 8) | cpu->L; // Creates the address HL
+			address1 = cpu->HL;
 			cpu->D = cpu->RAM[address1];
 			break;
 		case 0x57: // MOV D,A
@@ -609,7 +680,7 @@ void emulate8080(unique_ptr<CPU> &cpu) {
 			cpu->E = cpu->L;
 			break;
 		case 0x5e: // MOV E,M
-			address1 = (cpu->H << 8) | cpu->L; // Creates the address HL
+			address1 = cpu->HL;
 			cpu->E = cpu->RAM[address1];
 			break;
 		case 0x5f: // MOV E,A
@@ -634,7 +705,7 @@ void emulate8080(unique_ptr<CPU> &cpu) {
 			cpu->H = cpu->L;
 			break;
 		case 0x66: // MOV H,M
-			address1 = (cpu->H << 8) | cpu->L; // Creates the address HL
+			address1 = cpu->HL;
 			cpu->H = cpu->RAM[address1];
 			break;
 		case 0x67: // MOV H,A
@@ -659,41 +730,41 @@ void emulate8080(unique_ptr<CPU> &cpu) {
 			cpu->L = cpu->L;
 			break;
 		case 0x6e: // MOV L,M
-			address1 = (cpu->H << 8) | cpu->L; // Creates the address HL
+			address1 = cpu->HL;
 			cpu->L = cpu->RAM[address1];
 			break;
 		case 0x6f: // MOV L,A
 			cpu->L = cpu->A;
 			break;
 		case 0x70: // MOV M,B
-			address1 = (cpu->H << 8) | cpu->L; // Creates the address HL
+			address1 = cpu->HL;
 			cpu->RAM[address1] = cpu->B;
 			break;
 		case 0x71: // MOV M,C
-			address1 = (cpu->H << 8) | cpu->L; // Creates the address HL
+			address1 = cpu->HL;
 			cpu->RAM[address1] = cpu->C;
 			break;
 		case 0x72: // MOV M,D
-			address1 = (cpu->H << 8) | cpu->L; // Creates the address HL
+			address1 = cpu->HL;
 			cpu->RAM[address1] = cpu->D;
 			break;
 		case 0x73: // MOV M,E
-			address1 = (cpu->H << 8) | cpu->L; // Creates the address HL
+			address1 = cpu->HL;
 			cpu->RAM[address1] = cpu->E;
 			break;
 		case 0x74: // MOV M,H
-			address1 = (cpu->H << 8) | cpu->L; // Creates the address HL
+			address1 = cpu->HL;
 			cpu->RAM[address1] = cpu->H;
 			break;
 		case 0x75: // MOV M,L
-			address1 = (cpu->H << 8) | cpu->L; // Creates the address HL
+			address1 = cpu->HL;
 			cpu->RAM[address1] = cpu->L;
 			break;
 		case 0x76: // HLT
-			exit(0);
+			cpu->halted = 1; // Until the next interrupt
 			break;
 		case 0x77: // M,A
-			address1 = (cpu->H << 8) | cpu->L; // Creates the address HL
+			address1 = cpu->HL;
 			cpu->RAM[address1] = cpu->A;
 			break;
 		case 0x78: // MOV A,B
@@ -715,464 +786,272 @@ void emulate8080(unique_ptr<CPU> &cpu) {
 			cpu->A = cpu->L;
 			break;
 		case 0x7e: // MOV A,M
-			address1 = (cpu->H << 8) | cpu->L; // Creates the address HL
+			address1 = cpu->HL;
 			cpu->A = cpu->RAM[address1];
 			break;
 		case 0x7f: // MOV A,A
 			cpu->A = cpu->A;
 			break;
 		case 0x80: // ADD B
-			cpu->f.AC = ACPlus(cpu->A, cpu->B);
-			answer = (uint16_t) cpu->A + (uint16_t) cpu->B;
-			setArithmeticFlags(answer, cpu);
-			cpu->A = cpu->A + cpu->B;
+			cpu->A = add(cpu, cpu->B, 0);
 			break;
 		case 0x81: // ADD C
-			cpu->f.AC = ACPlus(cpu->A, cpu->C);
-			answer = (uint16_t) cpu->A + (uint16_t) cpu->C;
-			setArithmeticFlags(answer, cpu);
-			cpu->A = cpu->A + cpu->C;
+			cpu->A = add(cpu, cpu->C, 0);
 			break;
 		case 0x82: // ADD D
-			cpu->f.AC = ACPlus(cpu->A, cpu->D);
-			answer = (uint16_t) cpu->A + (uint16_t) cpu->D;
-			setArithmeticFlags(answer, cpu);
-			cpu->A = cpu->A + cpu->D;
+			cpu->A = add(cpu, cpu->D, 0);
 			break;
 		case 0x83: // ADD E
-			cpu->f.AC = ACPlus(cpu->A, cpu->E);
-			answer = (uint16_t) cpu->A + (uint16_t) cpu->E;
-			setArithmeticFlags(answer, cpu);
-			cpu->A = cpu->A + cpu->E;
+			cpu->A = add(cpu, cpu->E, 0);
 			break;
 		case 0x84: // ADD H
-			cpu->f.AC = ACPlus(cpu->A, cpu->H);
-			answer = (uint16_t) cpu->A + (uint16_t) cpu->H;
-			setArithmeticFlags(answer, cpu);
-			cpu->A = cpu->A + cpu->H;
+			cpu->A = add(cpu, cpu->H, 0);
 			break;
 		case 0x85: // ADD L
-			cpu->f.AC = ACPlus(cpu->A, cpu->L);
-			answer = (uint16_t) cpu->A + (uint16_t) cpu->L;
-			setArithmeticFlags(answer, cpu);
-			cpu->A = cpu->A + cpu->L;
+			cpu->A = add(cpu, cpu->L, 0);
 			break;
 		case 0x86: // ADD M
-			address1 = (cpu->H << 8) | cpu->L; // Creates the address HL
-			cpu->f.AC = ACPlus(cpu->A, cpu->RAM[address1]);
-			answer = (uint16_t) cpu->A + (uint16_t) cpu->RAM[address1];
-			setArithmeticFlags(answer, cpu);
-			cpu->A = cpu->A + cpu->RAM[address1];
+			cpu->A = add(cpu, cpu->RAM[cpu->HL], 0);
 			break;
 		case 0x87: // ADD A
-			cpu->f.AC = ACPlus(cpu->A, cpu->A);
-			answer = (uint16_t) cpu->A + (uint16_t) cpu->A;
-			setArithmeticFlags(answer, cpu);
-			cpu->A = cpu->A + cpu->A;
+			cpu->A = add(cpu, cpu->A, 0);
 			break;
 		case 0x88: // ADC B
-			cpu->f.AC = ACPlus(cpu->A, cpu->B + cpu->f.CY);
-			answer = (uint16_t) cpu->A + (uint16_t) cpu->B + cpu->f.CY;
-			cpu->A = cpu->A + cpu->B + cpu->f.CY;
-			setArithmeticFlags(answer, cpu);
+			cpu->A = add(cpu, cpu->B, getFlag(cpu->f, FLAG_CY));
 			break;
 		case 0x89: // ADC C
-			cpu->f.AC = ACPlus(cpu->A, cpu->C + cpu->f.CY);
-			answer = (uint16_t) cpu->A + (uint16_t) cpu->C + cpu->f.CY;
-			cpu->A = cpu->A + cpu->C + cpu->f.CY;
-			setArithmeticFlags(answer, cpu);
+			cpu->A = add(cpu, cpu->C, getFlag(cpu->f, FLAG_CY));
 			break;
 		case 0x8a: // ADC D
-			cpu->f.AC = ACPlus(cpu->A, cpu->D + cpu->f.CY);
-			answer = (uint16_t) cpu->A + (uint16_t) cpu->D + cpu->f.CY;
-			cpu->A = cpu->A + cpu->D + cpu->f.CY;
-			setArithmeticFlags(answer, cpu);
+			cpu->A = add(cpu, cpu->D, getFlag(cpu->f, FLAG_CY));
 			break;
 		case 0x8b: // ADC E
-			cpu->f.AC = ACPlus(cpu->A, cpu->E + cpu->f.CY);
-			answer = (uint16_t) cpu->A + (uint16_t) cpu->E + cpu->f.CY;
-			cpu->A = cpu->A + cpu->E + cpu->f.CY;
-			setArithmeticFlags(answer, cpu);
+			cpu->A = add(cpu, cpu->E, getFlag(cpu->f, FLAG_CY));
 			break;
 		case 0x8c: // ADC H
-			cpu->f.AC = ACPlus(cpu->A, cpu->H + cpu->f.CY);
-			answer = (uint16_t) cpu->A + (uint16_t) cpu->H + cpu->f.CY;
-			cpu->A = cpu->A + cpu->H + cpu->f.CY;
-			setArithmeticFlags(answer, cpu);
+			cpu->A = add(cpu, cpu->H, getFlag(cpu->f, FLAG_CY));
 			break;
 		case 0x8d: // ADC L
-			cpu->f.AC = ACPlus(cpu->A, cpu->L + cpu->f.CY);
-			answer = (uint16_t) cpu->A + (uint16_t) cpu->L + cpu->f.CY;
-			cpu->A = cpu->A + cpu->L + cpu->f.CY;
-			setArithmeticFlags(answer, cpu);
+			cpu->A = add(cpu, cpu->L, getFlag(cpu->f, FLAG_CY));
 			break;
 		case 0x8e: // ADC M
-			address1 = (cpu->H << 8) | cpu->L; // Creates the address HL
-			cpu->f.AC = ACPlus(cpu->A, cpu->RAM[address1] + cpu->f.CY);
-			answer = (uint16_t) cpu->A + (uint16_t) cpu->RAM[address1] + cpu->f.CY;
-			cpu->A = cpu->A + cpu->RAM[address1] + cpu->f.CY;
-			setArithmeticFlags(answer, cpu);
+			cpu->A = add(cpu, cpu->RAM[cpu->HL], getFlag(cpu->f, FLAG_CY));
 			break;
 		case 0x8f: // ADC A
-			cpu->f.AC = ACPlus(cpu->A, cpu->A + cpu->f.CY);
-			answer = (uint16_t) cpu->A + (uint16_t) cpu->A + cpu->f.CY;
-			cpu->A = cpu->A + cpu->A + cpu->f.CY;
-			setArithmeticFlags(answer, cpu);
+			cpu->A = add(cpu, cpu->A, getFlag(cpu->f, FLAG_CY));
 			break;
 		case 0x90: // SUB B
-			cpu->f.AC = ACMinus(cpu->A, cpu->B);
-			answer = (uint16_t) cpu->A - (uint16_t) cpu->B;
-			setArithmeticFlags(answer, cpu);
-			cpu->A = cpu->A - cpu->B;
+			cpu->A = subtract(cpu, cpu->B, 0);
 			break;
 		case 0x91: // SUB C
-			cpu->f.AC = ACMinus(cpu->A, cpu->C);
-			answer = (uint16_t) cpu->A - (uint16_t) cpu->C;
-			setArithmeticFlags(answer, cpu);
-			cpu->A = cpu->A - cpu->C;
+			cpu->A = subtract(cpu, cpu->C, 0);
 			break;
 		case 0x92: // SUB D
-			cpu->f.AC = ACMinus(cpu->A, cpu->D);
-			answer = (uint16_t) cpu->A - (uint16_t) cpu->D;
-			setArithmeticFlags(answer, cpu);
-			cpu->A = cpu->A - cpu->D;
+			cpu->A = subtract(cpu, cpu->D, 0);
 			break;
 		case 0x93: // SUB E
-			cpu->f.AC = ACMinus(cpu->A, cpu->E);
-			answer = (uint16_t) cpu->A - (uint16_t) cpu->E;
-			setArithmeticFlags(answer, cpu);
-			cpu->A = cpu->A - cpu->E;
+			cpu->A = subtract(cpu, cpu->E, 0);
 			break;
 		case 0x94: // SUB H
-			cpu->f.AC = ACMinus(cpu->A, cpu->H);
-			answer = (uint16_t) cpu->A - (uint16_t) cpu->H;
-			setArithmeticFlags(answer, cpu);
-			cpu->A = cpu->A - cpu->H;
+			cpu->A = subtract(cpu, cpu->H, 0);
 			break;
 		case 0x95: // SUB L
-			cpu->f.AC = ACMinus(cpu->A, cpu->L);
-			answer = (uint16_t) cpu->A - (uint16_t) cpu->L;
-			setArithmeticFlags(answer, cpu);
-			cpu->A = cpu->A - cpu->L;
+			cpu->A = subtract(cpu, cpu->L, 0);
 			break;
 		case 0x96: // SUB M
-			address1 = (cpu->H << 8) | cpu->L; // Creates the address HL
-			cpu->f.AC = ACMinus(cpu->A, cpu->RAM[address1]);
-			answer = (uint16_t) cpu->A - (uint16_t) cpu->RAM[address1];
-			setArithmeticFlags(answer, cpu);
-			cpu->A = cpu->A - cpu->RAM[address1];
+			cpu->A = subtract(cpu, cpu->RAM[cpu->HL], 0);
 			break;
 		case 0x97: // SUB A
-			cpu->f.AC = ACMinus(cpu->A, cpu->A);
-			answer = (uint16_t) cpu->A - (uint16_t) cpu->A;
-			setArithmeticFlags(answer, cpu);
-			cpu->A = cpu->A - cpu->A;
+			cpu->A = subtract(cpu, cpu->A, 0);
 			break;
 		case 0x98: // SBB B
-			cpu->f.AC = ACMinus(cpu->A, cpu->B + cpu->f.CY);
-			answer = (uint32_t) cpu->A - (uint32_t) cpu->B - (uint32_t) cpu->f.CY;
-			cpu->A = cpu->A - cpu->B - cpu->f.CY;
-			setArithmeticFlags(answer, cpu);
+			cpu->A = subtract(cpu, cpu->B, getFlag(cpu->f, FLAG_CY));
 			break;
 		case 0x99: // SBB C
-			cpu->f.AC = ACMinus(cpu->A, cpu->C + cpu->f.CY);
-			answer = (uint32_t) cpu->A - (uint32_t) cpu->C - (uint32_t) cpu->f.CY;
-			cpu->A = cpu->A - cpu->C - cpu->f.CY;
-			setArithmeticFlags(answer, cpu);
+			cpu->A = subtract(cpu, cpu->C, getFlag(cpu->f, FLAG_CY));
 			break;
 		case 0x9a: // SBB D
-			cpu->f.AC = ACMinus(cpu->A, cpu->D + cpu->f.CY);
-			answer = (uint32_t) cpu->A - (uint32_t) cpu->D - (uint32_t) cpu->f.CY;
-			cpu->A = cpu->A - cpu->D - cpu->f.CY;
-			setArithmeticFlags(answer, cpu);
+			cpu->A = subtract(cpu, cpu->D, getFlag(cpu->f, FLAG_CY));
 			break;
 		case 0x9b: // SBB E
-			cpu->f.AC = ACMinus(cpu->A, cpu->E + cpu->f.CY);
-			answer = (uint32_t) cpu->A - (uint32_t) cpu->E - (uint32_t) cpu->f.CY;
-			cpu->A = cpu->A - cpu->E - cpu->f.CY;
-			setArithmeticFlags(answer, cpu);
+			cpu->A = subtract(cpu, cpu->E, getFlag(cpu->f, FLAG_CY));
 			break;
 		case 0x9c: // SBB H
-			cpu->f.AC = ACMinus(cpu->A, cpu->H + cpu->f.CY);
-			answer = (uint32_t) cpu->A - (uint32_t) cpu->H - (uint32_t) cpu->f.CY;
-			cpu->A = cpu->A - cpu->H - cpu->f.CY;
-			setArithmeticFlags(answer, cpu);
+			cpu->A = subtract(cpu, cpu->H, getFlag(cpu->f, FLAG_CY));
 			break;
 		case 0x9d: // SBB L
-			cpu->f.AC = ACMinus(cpu->A, cpu->L + cpu->f.CY);
-			answer = (uint32_t) cpu->A - (uint32_t) cpu->L - (uint32_t) cpu->f.CY;
-			cpu->A = cpu->A - cpu->L - cpu->f.CY;
-			setArithmeticFlags(answer, cpu);
+			cpu->A = subtract(cpu, cpu->L, getFlag(cpu->f, FLAG_CY));
 			break;
 		case 0x9e: // SBB M
-			address1 = (cpu->H << 8) | cpu->L; // Creates the address HL
-			cpu->f.AC = ACMinus(cpu->A, cpu->RAM[address1] + cpu->f.CY);
-			answer = (uint32_t) cpu->A - (uint32_t) cpu->RAM[address1] - (uint32_t) cpu->f.CY;
-			cpu->A = cpu->A - cpu->RAM[address1] - cpu->f.CY;
-			setArithmeticFlags(answer, cpu);
+			cpu->A = subtract(cpu, cpu->RAM[cpu->HL], getFlag(cpu->f, FLAG_CY));
 			break;
 		case 0x9f: // SBB A
-			cpu->f.AC = ACMinus(cpu->A, cpu->A + cpu->f.CY);
-			answer = (uint32_t) cpu->A - (uint32_t) cpu->A - (uint32_t) cpu->f.CY;
-			cpu->A = cpu->A - cpu->A - cpu->f.CY;
-			setArithmeticFlags(answer, cpu);
+			cpu->A = subtract(cpu, cpu->A, getFlag(cpu->f, FLAG_CY));
 			break;
 		case 0xa0:  // ANA B
-			cpu->f.AC = (0x8 & cpu->A) | (0x8 & cpu->B);
-			cpu->A = cpu->A & cpu->B;
-			setLogicFlags(cpu);
-			cpu->f.CY = 0;
+			logic(cpu, cpu->A & cpu->B, ((cpu->A | cpu->B) >> 3) & 1); // AC is bit 3 of A | value
 			break;
 		case 0xa1:  // ANA C
-			cpu->f.AC = (0x8 & cpu->A) | (0x8 & cpu->C);
-			cpu->A = cpu->A & cpu->C;
-			setLogicFlags(cpu);
-			cpu->f.CY = 0;
+			logic(cpu, cpu->A & cpu->C, ((cpu->A | cpu->C) >> 3) & 1); // AC is bit 3 of A | value
 			break;
 		case 0xa2:  // ANA D
-			cpu->f.AC = (0x8 & cpu->A) | (0x8 & cpu->D);
-			cpu->A = cpu->A & cpu->D;
-			setLogicFlags(cpu);
-			cpu->f.CY = 0;
+			logic(cpu, cpu->A & cpu->D, ((cpu->A | cpu->D) >> 3) & 1); // AC is bit 3 of A | value
 			break;
 		case 0xa3:  // ANA E
-			cpu->f.AC = (0x8 & cpu->A) | (0x8 & cpu->E);
-			cpu->A = cpu->A & cpu->E;
-			setLogicFlags(cpu);
-			cpu->f.CY = 0;
+			logic(cpu, cpu->A & cpu->E, ((cpu->A | cpu->E) >> 3) & 1); // AC is bit 3 of A | value
 			break;
 		case 0xa4:  // ANA H
-			cpu->f.AC = (0x8 & cpu->A) | (0x8 & cpu->H);
-			cpu->A = cpu->A & cpu->H;
-			setLogicFlags(cpu);
-			cpu->f.CY = 0;
+			logic(cpu, cpu->A & cpu->H, ((cpu->A | cpu->H) >> 3) & 1); // AC is bit 3 of A | value
 			break;
 		case 0xa5:  // ANA L
-			cpu->f.AC = (0x8 & cpu->A) | (0x8 & cpu->L);
-			cpu->A = cpu->A & cpu->L;
-			setLogicFlags(cpu);
-			cpu->f.CY = 0;
+			logic(cpu, cpu->A & cpu->L, ((cpu->A | cpu->L) >> 3) & 1); // AC is bit 3 of A | value
 			break;
 		case 0xa6:  // ANA M
-			address1 = (cpu->H << 8) | cpu->L; // Creates the address HL
-			cpu->f.AC = (0x8 & cpu->A) | (0x8 & cpu->RAM[address1]);
-			cpu->A = cpu->A & cpu->RAM[address1];
-			setLogicFlags(cpu);
-			cpu->f.CY = 0;
+			logic(cpu, cpu->A & cpu->RAM[cpu->HL], ((cpu->A | cpu->RAM[cpu->HL]) >> 3) & 1); // AC is bit 3 of A | value
 			break;
 		case 0xa7:  // ANA A
-			cpu->f.AC = (0x8 & cpu->A) | (0x8 & cpu->A);
-			cpu->A = cpu->A & cpu->A;
-			setLogicFlags(cpu);
-			cpu->f.CY = 0;
+			logic(cpu, cpu->A & cpu->A, ((cpu->A | cpu->A) >> 3) & 1); // AC is bit 3 of A | value
 			break;
 		case 0xa8: // XRA B
-			cpu->A = cpu->A ^ cpu->B;
-			setLogicFlags(cpu);
-			cpu->f.AC = cpu->f.CY = 0;
+			logic(cpu, cpu->A ^ cpu->B, 0);
 			break;
 		case 0xa9: // XRA C
-			cpu->A = cpu->A ^ cpu->C;
-			setLogicFlags(cpu);
-			cpu->f.AC = cpu->f.CY = 0;
+			logic(cpu, cpu->A ^ cpu->C, 0);
 			break;
 		case 0xaa: // XRA D
-			cpu->A = cpu->A ^ cpu->D;
-			setLogicFlags(cpu);
-			cpu->f.AC = cpu->f.CY = 0;
+			logic(cpu, cpu->A ^ cpu->D, 0);
 			break;
 		case 0xab: // XRA E
-			cpu->A = cpu->A ^ cpu->E;
-			setLogicFlags(cpu);
-			cpu->f.AC = cpu->f.CY = 0;
+			logic(cpu, cpu->A ^ cpu->E, 0);
 			break;
 		case 0xac: // XRA H
-			cpu->A = cpu->A ^ cpu->H;
-			setLogicFlags(cpu);
-			cpu->f.AC = cpu->f.CY = 0;
+			logic(cpu, cpu->A ^ cpu->H, 0);
 			break;
 		case 0xad: // XRA L
-			cpu->A = cpu->A ^ cpu->L;
-			setLogicFlags(cpu);
-			cpu->f.AC = cpu->f.CY = 0;
+			logic(cpu, cpu->A ^ cpu->L, 0);
 			break;
 		case 0xae: // XRA M
-			address1 = (cpu->H << 8) | cpu->L; // Creates the address HL
-			cpu->A = cpu->A ^ cpu->RAM[address1];
-			setLogicFlags(cpu);
-			cpu->f.AC = cpu->f.CY = 0;
+			logic(cpu, cpu->A ^ cpu->RAM[cpu->HL], 0);
 			break;
 		case 0xaf: // XRA A
-			cpu->A = cpu->A ^ cpu->A;
-			setLogicFlags(cpu);
-			cpu->f.AC = cpu->f.CY = 0;
+			logic(cpu, cpu->A ^ cpu->A, 0);
 			break;
 		case 0xb0: // ORA B
-			cpu->A = cpu->A | cpu->B;
-			setLogicFlags(cpu);
-			cpu->f.AC = cpu->f.CY = 0;
+			logic(cpu, cpu->A | cpu->B, 0);
 			break;
 		case 0xb1: // ORA C
-			cpu->A = cpu->A | cpu->C;
-			setLogicFlags(cpu);
-			cpu->f.AC = cpu->f.CY = 0;
+			logic(cpu, cpu->A | cpu->C, 0);
 			break;
 		case 0xb2: // ORA D
-			cpu->A = cpu->A | cpu->D;
-			setLogicFlags(cpu);
-			cpu->f.AC = cpu->f.CY = 0;
+			logic(cpu, cpu->A | cpu->D, 0);
 			break;
 		case 0xb3: // ORA E
-			cpu->A = cpu->A | cpu->E;
-			setLogicFlags(cpu);
-			cpu->f.AC = cpu->f.CY = 0;
+			logic(cpu, cpu->A | cpu->E, 0);
 			break;
 		case 0xb4: // ORA H
-			cpu->A = cpu->A | cpu->H;
-			setLogicFlags(cpu);
-			cpu->f.AC = cpu->f.CY = 0;
+			logic(cpu, cpu->A | cpu->H, 0);
 			break;
 		case 0xb5: // ORA L
-			cpu->A = cpu->A | cpu->L;
-			setLogicFlags(cpu);
-			cpu->f.AC = cpu->f.CY = 0;
+			logic(cpu, cpu->A | cpu->L, 0);
 			break;
 		case 0xb6: // ORA M
-			address1 = (cpu->H << 8) | cpu->L; // Creates the address HL
-			cpu->A = cpu->A | cpu->RAM[address1];
-			setLogicFlags(cpu);
-			cpu->f.AC = cpu->f.CY = 0;
+			logic(cpu, cpu->A | cpu->RAM[cpu->HL], 0);
 			break;
 		case 0xb7: // ORA A
-			cpu->A = cpu->A | cpu->A;
-			setLogicFlags(cpu);
-			cpu->f.AC = cpu->f.CY = 0;
+			logic(cpu, cpu->A | cpu->A, 0);
 			break;
 		case 0xb8: // CMP B
-			if(cpu->A == cpu->B) {
-				cpu->f.Z = 1;
-			} else if(cpu->A < cpu->B) {
-				cpu->f.CY = 1;
-			}
+			subtract(cpu, cpu->B, 0); // Only sets the flags
 			break;
 		case 0xb9: // CMP C
-			if(cpu->A == cpu->C) {
-				cpu->f.Z = 1;
-			} else if(cpu->A < cpu->C) {
-				cpu->f.CY = 1;
-			}
+			subtract(cpu, cpu->C, 0); // Only sets the flags
 			break;
 		case 0xba: // CMP D
-			if(cpu->A == cpu->D) {
-				cpu->f.Z = 1;
-			} else if(cpu->A < cpu->D) {
-				cpu->f.CY = 1;
-			}
+			subtract(cpu, cpu->D, 0); // Only sets the flags
 			break;
 		case 0xbb: // CMP E
-			if(cpu->A == cpu->E) {
-				cpu->f.Z = 1;
-			} else if(cpu->A < cpu->E) {
-				cpu->f.CY = 1;
-			}
+			subtract(cpu, cpu->E, 0); // Only sets the flags
 			break;
 		case 0xbc: // CMP H
-			if(cpu->A == cpu->H) {
-				cpu->f.Z = 1;
-			} else if(cpu->A < cpu->H) {
-				cpu->f.CY = 1;
-			}
+			subtract(cpu, cpu->H, 0); // Only sets the flags
 			break;
 		case 0xbd: // CMP L
-			if(cpu->A == cpu->L) {
-				cpu->f.Z = 1;
-			} else if(cpu->A < cpu->L) {
-				cpu->f.CY = 1;
-			}
+			subtract(cpu, cpu->L, 0); // Only sets the flags
 			break;
 		case 0xbe: // CMP M
-			address1 = (cpu->H << 8) | cpu->L; // Creates the address HL
-			if(cpu->A == cpu->RAM[address1]) {
-				cpu->f.Z = 1;
-			} else if(cpu->A < cpu->RAM[address1]) {
-				cpu->f.CY = 1;
-			}
+			subtract(cpu, cpu->RAM[cpu->HL], 0); // Only sets the flags
 			break;
 		case 0xbf: // CMP A
-			if(cpu->A == cpu->A) {
-				cpu->f.Z = 1;
-			} else if(cpu->A < cpu->A) {
-				cpu->f.CY = 1;
-			}
+			subtract(cpu, cpu->A, 0); // Only sets the flags
 			break;
 		case 0xc0: // RNZ
-			if(!cpu->f.Z) {
+			if(!getFlag(cpu->f, FLAG_Z)) {
 				RET(cpu);
+				cycles += 6;
 			}
 			break;
 		case 0xc1: // POP B
 			cpu->C = cpu->RAM[cpu->SP];
-			cpu->B = cpu->RAM[cpu->SP + 1];
+			cpu->B = cpu->RAM[(uint16_t) (cpu->SP + 1)];
 			cpu->SP = cpu->SP + 2;
 			break;
 		case 0xc2: //JNZ adr
-			if(!cpu->f.Z) {
-				address1 = (cpu->RAM[cpu->PC - 1 + 2] << 8) | cpu->RAM[cpu->PC - 1 + 1]; // Creates little endian address
+			if(!getFlag(cpu->f, FLAG_Z)) {
+				address1 = (cpu->RAM[(uint16_t) (cpu->PC - 1 + 2)] << 8) | cpu->RAM[(uint16_t) (cpu->PC - 1 + 1)]; // Creates little endian address
 				cpu->PC = address1;
 			} else {
 				cpu->PC += 2;
 			}
 			break;
 		case 0xc3: // JMP adr
-			address1 = (cpu->RAM[cpu->PC - 1 + 2] << 8) | cpu->RAM[cpu->PC - 1 + 1]; // Creates little endian address
+			address1 = (cpu->RAM[(uint16_t) (cpu->PC - 1 + 2)] << 8) | cpu->RAM[(uint16_t) (cpu->PC - 1 + 1)]; // Creates little endian address
 			cpu->PC = address1;
 			break;
 		case 0xc4: // CNZ adr
-			if(!cpu->f.Z) {
+			if(!getFlag(cpu->f, FLAG_Z)) {
 				CALL(cpu);
+				cycles += 6;
 			} else {
 				cpu->PC += 2;
 			}
 			break;
 		case 0xc5: // PUSH B
-			cpu->RAM[cpu->SP - 1] = cpu->B;
-			cpu->RAM[cpu->SP - 2] = cpu->C;
+			cpu->RAM[(uint16_t) (cpu->SP - 1)] = cpu->B;
+			cpu->RAM[(uint16_t) (cpu->SP - 2)] = cpu->C;
 			cpu->SP = cpu->SP - 2;
 			break;
 		case 0xc6: // ADI D8
-			address1 = cpu->RAM[cpu->PC - 1 + 1]; // Stores next value
-			cpu->f.AC = ACPlus(cpu->A, (uint8_t) address1);
-			answer = (uint16_t) cpu->A + (uint16_t) address1;
-			setArithmeticFlags(answer, cpu);
-			cpu->A = cpu->A + (uint8_t) address1;
+			cpu->A = add(cpu, cpu->RAM[(uint16_t) (cpu->PC - 1 + 1)], 0);
 			cpu->PC++;
 			break;
 		case 0xc7: // RST 0
-			CALL(cpu);
-			cpu->PC = 0x0000;
+			RST(cpu, 0x0000);
 			break;
 		case 0xc8: // RZ
-			if(cpu->f.Z) {
+			if(getFlag(cpu->f, FLAG_Z)) {
 				RET(cpu);
+				cycles += 6;
 			}
 			break;
 		case 0xc9: // RET
 			RET(cpu);
 			break;
 		case 0xca: // JZ adr
-			if(cpu->f.Z) {
-				address1 = (cpu->RAM[cpu->PC - 1 + 2] << 8) | cpu->RAM[cpu->PC - 1 + 1]; // Creates little endian address
+			if(getFlag(cpu->f, FLAG_Z)) {
+				address1 = (cpu->RAM[(uint16_t) (cpu->PC - 1 + 2)] << 8) | cpu->RAM[(uint16_t) (cpu->PC - 1 + 1)]; // Creates little endian address
 				cpu->PC = address1;
 			} else {
 				cpu->PC += 2;
 			}
 			break;
-		case 0xcb: // -
-			UnimplementedInstruction(opCode);
+		case 0xcb: // Undocumented JMP adr
+			address1 = (cpu->RAM[(uint16_t) (cpu->PC - 1 + 2)] << 8) | cpu->RAM[(uint16_t) (cpu->PC - 1 + 1)]; // Creates little endian address
+			cpu->PC = address1;
 			break;
 		case 0xcc: // CZ adr
-			if(cpu->f.Z) {
+			if(getFlag(cpu->f, FLAG_Z)) {
 				CALL(cpu);
+				cycles += 6;
 			} else {
 				cpu->PC += 2;
 			}
@@ -1181,117 +1060,112 @@ void emulate8080(unique_ptr<CPU> &cpu) {
 			CALL(cpu);
 			break;
 		case 0xce: // ACI D8
-			address1 = cpu->RAM[cpu->PC - 1 + 1]; // Stores the next value
-			cpu->f.AC = ACPlus(cpu->A, (uint8_t) address1 + cpu->f.CY);
-			answer = (uint32_t) cpu->A + (uint32_t) address1 + (uint32_t) cpu->f.CY;
-			cpu->A = cpu->A + address1 + cpu->f.CY;
-			setArithmeticFlags(answer, cpu);
+			cpu->A = add(cpu, cpu->RAM[(uint16_t) (cpu->PC - 1 + 1)], getFlag(cpu->f, FLAG_CY));
 			cpu->PC++;
 			break;
 		case 0xcf: // RST 1
-			CALL(cpu);
-			cpu->PC = 0x0008;
+			RST(cpu, 0x0008);
 			break;
 		case 0xd0: // RNC
-			if(!cpu->f.CY) {
+			if(!getFlag(cpu->f, FLAG_CY)) {
 				RET(cpu);
+				cycles += 6;
 			}
 			break;
 		case 0xd1: // POP D
 			cpu->E = cpu->RAM[cpu->SP];
-			cpu->D = cpu->RAM[cpu->SP + 1];
+			cpu->D = cpu->RAM[(uint16_t) (cpu->SP + 1)];
 			cpu->SP = cpu->SP + 2;
 			break;
 		case 0xd2: // JNC adr
-			if(!cpu->f.CY) {
-				address1 = (cpu->RAM[cpu->PC - 1 + 2] << 8) | cpu->RAM[cpu->PC - 1 + 1]; // Creates little endian address
+			if(!getFlag(cpu->f, FLAG_CY)) {
+				address1 = (cpu->RAM[(uint16_t) (cpu->PC - 1 + 2)] << 8) | cpu->RAM[(uint16_t) (cpu->PC - 1 + 1)]; // Creates little endian address
 				cpu->PC = address1;
 			} else {
 				cpu->PC += 2;
 			}
 			break;
 		case 0xd3: // OUT D8
-
+			if(cpu->out) {
+				cpu->out(cpu->ioContext, cpu->RAM[(uint16_t) (cpu->PC - 1 + 1)], cpu->A);
+			}
 			cpu->PC++;
 			break;
 		case 0xd4: // CNC adr
-			if(!cpu->f.CY) {
+			if(!getFlag(cpu->f, FLAG_CY)) {
 				CALL(cpu);
+				cycles += 6;
 			} else {
 				cpu->PC += 2;
 			}
 			break;
 		case 0xd5: // PUSH D
-			cpu->RAM[cpu->SP - 1] = cpu->D;
-			cpu->RAM[cpu->SP - 2] = cpu->E;
+			cpu->RAM[(uint16_t) (cpu->SP - 1)] = cpu->D;
+			cpu->RAM[(uint16_t) (cpu->SP - 2)] = cpu->E;
 			cpu->SP = cpu->SP - 2;
 			break;
 		case 0xd6: // SUI D8
-			address1 = cpu->RAM[cpu->PC - 1 + 1]; // Stores the next value
-			cpu->f.AC = ACMinus(cpu->A, (uint8_t) address1);
-			answer = (uint16_t) cpu->A - (uint16_t) address1;
-			setArithmeticFlags(answer, cpu);
-			cpu->A = cpu->A - (uint8_t) address1;
+			cpu->A = subtract(cpu, cpu->RAM[(uint16_t) (cpu->PC - 1 + 1)], 0);
 			cpu->PC++;
 			break;
 		case 0xd7: // RST 2
-			CALL(cpu);
-			cpu->PC = 0x0010;
+			RST(cpu, 0x0010);
 			break;
 		case 0xd8: // RC
-			if(cpu->f.CY) {
+			if(getFlag(cpu->f, FLAG_CY)) {
 				RET(cpu);
+				cycles += 6;
 			}
 			break;
-		case 0xd9: // -
-			UnimplementedInstruction(opCode);
+		case 0xd9: // Undocumented RET
+			RET(cpu);
 			break;
 		case 0xda: // JC adr
-			if(cpu->f.CY) {
-				address1 = (cpu->RAM[cpu->PC - 1 + 2] << 8) | cpu->RAM[cpu->PC - 1 + 1]; // Creates little endian address
+			if(getFlag(cpu->f, FLAG_CY)) {
+				address1 = (cpu->RAM[(uint16_t) (cpu->PC - 1 + 2)] << 8) | cpu->RAM[(uint16_t) (cpu->PC - 1 + 1)]; // Creates little endian address
 				cpu->PC = address1;
 			} else {
 				cpu->PC += 2;
 			}
 			break;
 		case 0xdb: // IN D8
+			if(cpu->in) {
+				cpu->A = cpu->in(cpu->ioContext, cpu->RAM[(uint16_t) (cpu->PC - 1 + 1)]);
+			}
 			cpu->PC++;
 			break;
 		case 0xdc: // CC adr
-			if(cpu->f.CY) {
+			if(getFlag(cpu->f, FLAG_CY)) {
 				CALL(cpu);
+				cycles += 6;
 			} else {
 				cpu->PC += 2;
 			}
 			break;
-		case 0xdd: // -
-			UnimplementedInstruction(opCode);
+		case 0xdd: // Undocumented CALL adr
+			CALL(cpu);
 			break;
 		case 0xde: // SBI D8
-			address1 = cpu->RAM[cpu->PC - 1 + 1]; // Stores the next value
-			cpu->f.AC = ACMinus(cpu->A, (uint8_t) address1 + cpu->f.CY);
-			answer = (uint32_t) cpu->A - (uint32_t) address1 - (uint32_t) cpu->f.CY;
-			setArithmeticFlags(answer, cpu);
-			cpu->A = cpu->A - address1 - cpu->f.CY;
+			cpu->A = subtract(cpu, cpu->RAM[(uint16_t) (cpu->PC - 1 + 1)], getFlag(cpu->f, FLAG_CY));
 			cpu->PC++;
 			break;
 		case 0xdf: // RST 3
-			CALL(cpu);
-			cpu->PC = 0x0018;
+			RST(cpu, 0x0018);
 			break;
 		case 0xe0: // RPO
-			if(cpu->f.P == 0) {
+			if(getFlag(cpu->f, FLAG_P) == 0) {
 				RET(cpu);
+				cycles += 6;
 			}
 			break;
 		case 0xe1: // POP H
 			cpu->L = cpu->RAM[cpu->SP];
-			cpu->H = cpu->RAM[cpu->SP + 1];
+			cpu->H = cpu->RAM[(uint16_t) (cpu->SP + 1)];
 			cpu->SP = cpu->SP + 2;
 			break;
 		case 0xe2: // JPO adr
-			address1 = (cpu->RAM[cpu->PC - 1 + 2] << 8) | cpu->RAM[cpu->PC - 1 + 1]; // Creates little endian address
-			if(cpu->f.P == 0) {
+			address1 = (cpu->RAM[(uint16_t) (cpu->PC - 1 + 2)] << 8) | cpu->RAM[(uint16_t) (cpu->PC - 1 + 1)]; // Creates little endian address
+			if(getFlag(cpu->f, FLAG_P) == 0) {
 				cpu->PC = address1;
 			} else {
 				cpu->PC += 2;
@@ -1302,95 +1176,83 @@ void emulate8080(unique_ptr<CPU> &cpu) {
 			cpu->L = cpu->RAM[cpu->SP];
 			cpu->RAM[cpu->SP] = address1;
 			address1 = cpu->H; // Temp variable to store register H
-			cpu->H = cpu->RAM[cpu->SP + 1];
-			cpu->RAM[cpu->SP + 1] = address1;
+			cpu->H = cpu->RAM[(uint16_t) (cpu->SP + 1)];
+			cpu->RAM[(uint16_t) (cpu->SP + 1)] = address1;
 			break;
 		case 0xe4: // CPO adr
-			if(cpu->f.P == 0) {
+			if(getFlag(cpu->f, FLAG_P) == 0) {
 				CALL(cpu);
+				cycles += 6;
 			} else {
 				cpu->PC += 2;
 			}
 			break;
 		case 0xe5: // PUSH H
-			cpu->RAM[cpu->SP - 1] = cpu->H;
-			cpu->RAM[cpu->SP - 2] = cpu->L;
+			cpu->RAM[(uint16_t) (cpu->SP - 1)] = cpu->H;
+			cpu->RAM[(uint16_t) (cpu->SP - 2)] = cpu->L;
 			cpu->SP = cpu->SP - 2;
 			break;
 		case 0xe6: // ANI D8
-			address1 = cpu->RAM[cpu->PC - 1 + 1]; // Stores the value of the next value
-			cpu->f.AC = (0x8 & cpu->A) | (0x8 & (uint8_t) address1);
-			cpu->A = cpu->A & address1;
-			setLogicFlags(cpu);
-			cpu->f.CY = 0;
+			logic(cpu, cpu->A & cpu->RAM[(uint16_t) (cpu->PC - 1 + 1)], ((cpu->A | cpu->RAM[(uint16_t) (cpu->PC - 1 + 1)]) >> 3) & 1); // AC is bit 3 of A | value
 			cpu->PC++;
 			break;
 		case 0xe7: // RST 4
-			CALL(cpu);
-			cpu->PC = 0x020;
+			RST(cpu, 0x0020);
 			break;
 		case 0xe8: // RPE
-			if(cpu->f.P == 1) {
+			if(getFlag(cpu->f, FLAG_P) == 1) {
 				RET(cpu);
+				cycles += 6;
 			}
 			break;
 		case 0xe9: // PCHL
-			cpu->PC = (cpu->H << 8) | cpu->L;
+			cpu->PC = cpu->HL;
 			break;
 		case 0xea: // JPE adr
-			if(cpu->f.P == 1) {
-				address1 = (cpu->RAM[cpu->PC - 1 + 2] << 8) | cpu->RAM[cpu->PC - 1 + 1]; // Creates little endian address
+			if(getFlag(cpu->f, FLAG_P) == 1) {
+				address1 = (cpu->RAM[(uint16_t) (cpu->PC - 1 + 2)] << 8) | cpu->RAM[(uint16_t) (cpu->PC - 1 + 1)]; // Creates little endian address
 				cpu->PC = address1;
 			} else {
 				cpu->PC += 2;
 			}
 			break;
 		case 0xeb: // XCHG
-			address1 = cpu->H; // Temp variable to store register H
-			cpu->H = cpu->D;
-			cpu->D = address1;
-			address1 = cpu->L; // Temp variable to store register L
-			cpu->L = cpu->E;
-			cpu->E = address1;
+			address1 = cpu->HL; // Temp variable to store register pair HL
+			cpu->HL = cpu->DE;
+			cpu->DE = address1;
 			break;
 		case 0xec: // CPE adr
-			if(cpu->f.P == 1) {
+			if(getFlag(cpu->f, FLAG_P) == 1) {
 				CALL(cpu);
+				cycles += 6;
 			} else {
 				cpu->PC += 2;
 			}
 			break;
-		case 0xed: // -
-			UnimplementedInstruction(opCode);
+		case 0xed: // Undocumented CALL adr
+			CALL(cpu);
 			break;
 		case 0xee: // XRI D8
-			address1 = cpu->RAM[cpu->PC - 1 + 1]; // Stores the next value
-			cpu->A = cpu->A ^ address1;
-			setLogicFlags(cpu);
-			cpu->f.AC = cpu->f.CY = 0;
+			logic(cpu, cpu->A ^ cpu->RAM[(uint16_t) (cpu->PC - 1 + 1)], 0);
 			cpu->PC++;
 			break;
 		case 0xef: // RST 5
-			CALL(cpu);
-			cpu->PC = 0x0028;
+			RST(cpu, 0x0028);
 			break;
 		case 0xf0: // RP
-			if(cpu->f.S == 0) {
+			if(getFlag(cpu->f, FLAG_S) == 0) {
 				RET(cpu);
+				cycles += 6;
 			}
 			break;
 		case 0xf1: // POP PSW
-			cpu->A = cpu->RAM[cpu->SP+1];
-			cpu->f.Z  = (0x01 == (cpu->RAM[cpu->SP] & 0x01));
-			cpu->f.S  = (0x02 == (cpu->RAM[cpu->SP] & 0x02));
-			cpu->f.P  = (0x04 == (cpu->RAM[cpu->SP] & 0x04));
-			cpu->f.CY = (0x05 == (cpu->RAM[cpu->SP] & 0x08));
-			cpu->f.AC = (0x10 == (cpu->RAM[cpu->SP] & 0x10));
+			cpu->A = cpu->RAM[(uint16_t) (cpu->SP + 1)];
+			setFlags(cpu->f, cpu->RAM[cpu->SP]);
 			cpu->SP += 2;
 			break;
 		case 0xf2: // JP adr
-			if(cpu->f.S == 0) {
-				address1 = (cpu->RAM[cpu->PC - 1 + 2] << 8) | cpu->RAM[cpu->PC - 1 + 1]; // Creates little endian address
+			if(getFlag(cpu->f, FLAG_S) == 0) {
+				address1 = (cpu->RAM[(uint16_t) (cpu->PC - 1 + 2)] << 8) | cpu->RAM[(uint16_t) (cpu->PC - 1 + 1)]; // Creates little endian address
 				cpu->PC = address1;
 			} else {
 				cpu->PC += 2;
@@ -1400,44 +1262,38 @@ void emulate8080(unique_ptr<CPU> &cpu) {
 			cpu->int_enable = 0;
 			break;
 		case 0xf4: // CP adr
-			if(cpu->f.S == 0) {
+			if(getFlag(cpu->f, FLAG_S) == 0) {
 				CALL(cpu);
+				cycles += 6;
 			} else {
 				cpu->PC += 2;
 			}
 			break;
 		case 0xf5: // PUSH PSW
-			cpu->RAM[cpu->SP-1] = cpu->A;
-			cpu->RAM[cpu->SP-2] = (cpu->f.Z |
-							cpu->f.S << 1 |
-							cpu->f.P << 2 |
-							cpu->f.CY << 3 |
-							cpu->f.AC << 4 );
+			cpu->RAM[(uint16_t) (cpu->SP - 1)] = cpu->A;
+			cpu->RAM[(uint16_t) (cpu->SP - 2)] = getFlags(cpu->f);
 			cpu->SP = cpu->SP - 2;
 			break;
 		case 0xf6: // ORI D8
-			address1 = cpu->RAM[cpu->PC - 1 + 1]; // Stores the next value
-			cpu->A = cpu->A | address1;
-			setLogicFlags(cpu);
-			cpu->f.AC = cpu->f.CY = 0;
+			logic(cpu, cpu->A | cpu->RAM[(uint16_t) (cpu->PC - 1 + 1)], 0);
 			cpu->PC++;
 			break;
 		case 0xf7: // RST 6
-			CALL(cpu);
-			cpu->PC = 0x0030;
+			RST(cpu, 0x0030);
 			break;
 		case 0xf8: // RM
-			if(cpu->f.S == 1) {
+			if(getFlag(cpu->f, FLAG_S) == 1) {
 				RET(cpu);
+				cycles += 6;
 			}
 			break;
 		case 0xf9: // SPHL
-			address1 = (cpu->H << 8) | cpu->L; // Creates the address HL
+			address1 = cpu->HL;
 			cpu->SP = address1;
 			break;
 		case 0xfa: // JM adr
-			if(cpu->f.S == 1) {
-				address1 = (cpu->RAM[cpu->PC - 1 + 2] << 8) | cpu->RAM[cpu->PC - 1 + 1]; // Creates little endian address
+			if(getFlag(cpu->f, FLAG_S) == 1) {
+				address1 = (cpu->RAM[(uint16_t) (cpu->PC - 1 + 2)] << 8) | cpu->RAM[(uint16_t) (cpu->PC - 1 + 1)]; // Creates little endian address
 				cpu->PC = address1;
 			} else {
 				cpu->PC += 2;
@@ -1447,57 +1303,30 @@ void emulate8080(unique_ptr<CPU> &cpu) {
 			cpu->int_enable = 1;
 			break;
 		case 0xfc: // CM adr
-			if(cpu->f.S == 1) {
+			if(getFlag(cpu->f, FLAG_S) == 1) {
 				CALL(cpu);
+				cycles += 6;
 			} else {
 				cpu->PC += 2;
 			}
 			break;
-		case 0xfd: // -
-			UnimplementedInstruction(opCode);
+		case 0xfd: // Undocumented CALL adr
+			CALL(cpu);
 			break;
 		case 0xfe: // CPI D8
-			address1 = cpu->RAM[cpu->PC - 1 + 1]; // Stores the next value
-			cpu->f.AC = ACMinus(cpu->A, address1);
-			answer = (uint16_t) ((uint16_t) cpu->A - (uint16_t) address1);
-			setArithmeticFlags(answer, cpu);
+			subtract(cpu, cpu->RAM[(uint16_t) (cpu->PC - 1 + 1)], 0); // Only sets the flags
 			cpu->PC++;
 			break;
 		case 0xff: // RST 7
-			CALL(cpu);
-			cpu->PC = 0x0038;
+			RST(cpu, 0x0038);
 			break;
 	}
-}
-
-int main () {
-	unique_ptr<CPU> cpu = unique_ptr<CPU>(new CPU());
-	loadRom("invaders.h", cpu, 0x0000);
-	loadRom("invaders.g", cpu, 0x0800);
-	loadRom("invaders.f", cpu, 0x1000);
-	loadRom("invaders.e", cpu, 0x1800);
-
-	bool done = false;
-
-	cout << std::hex;
-	while(!done) {
-		/*cout << "A: " << static_cast<int>(cpu->A) << " B: " << static_cast<int>(cpu->B) << " C: " << static_cast<int>(cpu->C) 
-		     << " D: " << static_cast<int>(cpu->D) << " E: " << static_cast<int>(cpu->E) << " H: " << static_cast<int>(cpu->H) 
-		     << " L: " << static_cast<int>(cpu->L) << " PC: " << static_cast<int>(cpu->PC) << " SP: " << static_cast<int>(cpu->SP)
-		     << " Next OP Code: " << static_cast<int>(cpu->RAM[cpu->PC]) << endl << endl;
-		done = emulate8080OpCode(cpu);*/
-		/*printf("CUR_OP %04x %04x ", cpu->RAM[cpu->PC], cpu->RAM[cpu->PC + 1]);
-		done = emulate8080OpCode(cpu);
-		printf("%c", cpu->f.Z ? 'z' : '.');
-		printf("%c", cpu->f.S ? 's' : '.');
-		printf("%c", cpu->f.P ? 'p' : '.');
-		printf("%c", cpu->f.CY ? 'c' : '.');
-		printf("%c  ", cpu->f.AC ? 'a' : '.');
-		printf("A %02x B %02x C %02x D %02x E %02x H %02x L %02x SP %04x END_PC %04x\n\n", cpu->A, cpu->B, cpu->C,
-					cpu->D, cpu->E, cpu->H, cpu->L, cpu->SP, cpu->PC);*/
-
-		emulate8080(cpu)
-	}
 
-	return 0;
-}
\ No newline at end of file
+#ifdef COUNTERS
+	countInstruction(*cpu, opCode, pc, cycles);
+#endif
+#ifdef COVERAGE
+	coverInstruction(*cpu, opCode, pc, cycles);
+#endif
+	return cycles;
+}
@@ -0,0 +1,145 @@
+#ifndef CPU_H
+#define CPU_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+using std::uint8_t;
+using std::uint16_t;
+using std::uint32_t;
+using std::unique_ptr;
+
+int parity(int x);
+
+// Bit of each flag in the PSW byte PUSH PSW stores: S Z 0 AC 0 P 1 CY
+enum FlagBits {
+	FLAG_CY = 0x01,
+	FLAG_P = 0x04,
+	FLAG_AC = 0x10,
+	FLAG_Z = 0x40,
+	FLAG_S = 0x80,
+	FLAG_ALL = 0xd5
+};
+
+// Flags are evaluated lazily. Arithmetic only records its answer and operands, and a flag is
+// only computed when something (a conditional jump, PUSH PSW, DAA, ...) reads it.
+struct Flags {
+	uint32_t answer = 0; // Z, S and P from its low byte, CY from whether it overflowed
+	// The two values added to get answer (subtraction adds the complement). AC is the carry into
+	// bit 4, which is bit 4 of acBefore ^ acOperand ^ answer.
+	uint8_t acBefore = 0;
+	uint8_t acOperand = 0;
+	uint8_t known = 0; // Flags that have been set directly
+	uint8_t lazy = 0; // Flags still to be worked out from the last operation
+};
+
+inline int getFlag(const Flags &f, uint8_t flag) {
+	if(!(f.lazy & flag)) {
+		return (f.known & flag) != 0;
+	}
+	switch(flag) {
+		case FLAG_Z:
+			return (f.answer & 0xff) == 0;
+		case FLAG_S:
+			return (f.answer & 0x80) == 0x80;
+		case FLAG_P:
+			return parity(f.answer & 0xff);
+		case FLAG_CY:
+			return f.answer > 0xff;
+	}
+	return ((f.acBefore ^ f.acOperand ^ f.answer) & 0x10) != 0;
+}
+
+// The PSW flag byte, as PUSH PSW stores it
+inline uint8_t getFlags(const Flags &f) {
+	return getFlag(f, FLAG_S) << 7 | getFlag(f, FLAG_Z) << 6 | getFlag(f, FLAG_AC) << 4 | getFlag(f, FLAG_P) << 2 |
+	       0x02 | getFlag(f, FLAG_CY);
+}
+
+// Keeps the low bit of value, like the 1-bit fields flags used to be stored in
+inline void setFlag(Flags &f, uint8_t flag, int value) {
+	f.known = (value & 1) ? (f.known | flag) : (f.known & ~flag);
+	f.lazy &= ~flag;
+}
+
+// From a PSW flag byte, as POP PSW loads it
+inline void setFlags(Flags &f, uint8_t flags) {
+	f.known = flags & FLAG_ALL;
+	f.lazy = 0;
+}
+
+// A register pair, usable both as its two 8-bit halves and as one 16-bit register
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define REGISTER_PAIR(high, low) union { uint16_t high##low = 0x0000; struct { uint8_t high, low; }; }
+#else
+#define REGISTER_PAIR(high, low) union { uint16_t high##low = 0x0000; struct { uint8_t low, high; }; }
+#endif
+
+const uint32_t RAM_SIZE = 0x10000;
+const uint32_t RAM_ALIGNMENT = 4096; // RAM starts on a page boundary
+const uint32_t CACHE_LINE_SIZE = 64;
+
+// Everything the interpreter touches on every instruction fits in one cache line. RAM lives in
+// its own mapping instead of sitting in the middle of the struct, and its pages only take memory
+// once written (or once a SharedRom, rom.h, maps its own over them).
+struct alignas(CACHE_LINE_SIZE) CPU {
+	CPU();
+	~CPU();
+	CPU(const CPU &) = delete;
+	CPU &operator=(const CPU &) = delete;
+	static void *operator new(std::size_t size);
+	static void operator delete(void *pointer);
+
+	// Registors
+	uint8_t A = 0x00;
+	REGISTER_PAIR(B, C);
+	REGISTER_PAIR(D, E);
+	REGISTER_PAIR(H, L);
+	uint16_t SP = 0x0000;
+	// Other Stuff
+	uint16_t PC = 0x0000;
+	struct Flags f;
+	uint8_t int_enable = 0x00;
+	uint8_t halted = 0x00;
+	// I/O handlers, IN leaves A alone and OUT is ignored while they're nullptr
+	uint8_t (*in)(void *context, uint8_t port) = nullptr;
+	void (*out)(void *context, uint8_t port, uint8_t value) = nullptr;
+	void *ioContext = nullptr;
+	uint8_t *RAM; // RAM_SIZE bytes, aligned to RAM_ALIGNMENT
+};
+
+static_assert(sizeof(CPU) == CACHE_LINE_SIZE, "CPU state should fill exactly one cache line");
+
+// Base cycle count of every opcode (taken conditional CALLs and RETs cost 6 more)
+extern const uint8_t OPCODE_CYCLES[256];
+// Length of every opcode's instruction in bytes
+extern const uint8_t OPCODE_SIZES[256];
+
+// A memory read or write other than an instruction fetch
+struct DataAccess {
+	uint16_t address;
+	bool write;
+};
+
+const int MAX_DATA_ACCESSES = 4; // XTHL reads and writes two bytes each
+
+// Works out the data accesses the instruction at pc will make, in order, without running it.
+// Conditional CALLs and RETs only make theirs if the condition holds. Returns how many.
+int dataAccesses(const CPU &cpu, uint16_t pc, DataAccess accesses[MAX_DATA_ACCESSES]);
+
+void RET(unique_ptr<CPU> &cpu);
+void CALL(unique_ptr<CPU> &cpu);
+void RST(unique_ptr<CPU> &cpu, uint16_t address);
+void generateInterrupt(unique_ptr<CPU> &cpu, int vector); // RST vector, takes 11 cycles
+void loadRom(std::string fileName, unique_ptr<CPU> &cpu, uint32_t offset);
+// Zeroes RAM, giving back the memory of its pages and dropping mapped ROM
+void clearMemory(CPU &cpu);
+// Copies RAM_SIZE bytes into RAM, leaving alone the pages that already hold them so shared ROM
+// pages stay shared and pages never written still take no memory
+void writeMemory(CPU &cpu, const uint8_t *data);
+int emulate8080(unique_ptr<CPU> &cpu); // Returns the cycles taken
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef CRC32_H
+#define CRC32_H
+
+#include <cstddef>
+#include <cstdint>
+
+// CRC-32 as zlib and PNG have it, for save states, warm start names and checking ROMs. It's
+// constexpr so the embedded ROM can be checked at compile time with the same code.
+struct CrcTable {
+	uint32_t entries[256];
+};
+
+constexpr CrcTable makeCrcTable() {
+	CrcTable table = {};
+	for(uint32_t i = 0; i < 256; i++) {
+		uint32_t crc = i;
+		for(int bit = 0; bit < 8; bit++) {
+			crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+		}
+		table.entries[i] = crc;
+	}
+	return table;
+}
+
+constexpr CrcTable CRC_TABLE = makeCrcTable();
+
+constexpr uint32_t crc32(const uint8_t *data, std::size_t size) {
+	uint32_t crc = 0xffffffff;
+	for(std::size_t i = 0; i < size; i++) {
+		crc = (crc >> 8) ^ CRC_TABLE.entries[(crc ^ data[i]) & 0xff];
+	}
+	return ~crc;
+}
+
+#endif
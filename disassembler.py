@@ -1,6 +1,14 @@
 import csv
 import sys
 
+# python3 disassembler.py [ROM [COVERAGE...]] writes ROM.txt (invaders.txt by default). Given
+# coverage files from emulator --coverage, they're ORed together and only the instructions that
+# ran are listed as code, everything else as DB data, with conditional branches marked by the
+# ways they went. --origin HEX is where the ROM was loaded (100 for CP/M programs).
+COVERAGE_MAGIC = b"8080COV\0"
+COVERAGE_VERSION = 1
+MAP_SIZE = 0x10000 // 8
+
 opCodes = {}
 with open("8080opcodes.csv") as opcodesFile:
 	opCodesReader = csv.reader(opcodesFile, delimiter="\t")
@@ -14,48 +22,117 @@ with open("8080opcodes.csv") as opcodesFile:
 
 		opCodes[opCode] = [instruction, int(size)]
 
-with open("invaders", "rb") as invadersFile:
-	byte = invadersFile.read(1).hex()
-	lines = []
-	lineNumber = 0
-	while byte:
-		if byte in opCodes:
-			line = hex(lineNumber)[2:].zfill(4)
-			instruction = opCodes[byte][0]
-			bytesLeft = opCodes[byte][1] - 1
-
-			line += "\t" + instruction
-			tempBytes = []
-			for _ in range(bytesLeft):
-				tempBytes.append(invadersFile.read(1).hex())
-			if bytesLeft == 1:
-				line = line.replace("D8", "$" + tempBytes[0])
-			elif bytesLeft == 2:
-				if "D16" in line:
-					line = line.replace("D16", "$" + tempBytes[1] + tempBytes[0])
-				elif "adr" in line:
-					line = line.replace("adr", "$" + tempBytes[1] + tempBytes[0])
-				else:
-					print("No D16 or adr for", byte + "1")
-					sys.exit(1)
-				if "D16" in line and "adr" in line:
-					print("D16 and adr for", byte + "!")
-					sys.exit(1)
-			elif bytesLeft != 0:
-				print(bytesLeft, "bytes left!")
-				sys.exit(1)
-
-			line += "\n"
-			if line.find(" ") > 0:
-				line = list(line)
-				line[line.index(" ")] = "\t"
-			lines.append("".join(line))
+
+# The instruction at the start of data with its operands filled in, and its size
+def disassemble(data):
+	byte = data[:1].hex()
+	if byte not in opCodes:
+		print("Opcode:", byte, "does not exist!")
+		sys.exit(1)
+	instruction, size = opCodes[byte]
+	operands = ["%02x" % b for b in data[1:size]]
+	if len(operands) != size - 1:
+		print("Opcode:", byte, "is cut off!")
+		sys.exit(1)
+	if size == 2:
+		instruction = instruction.replace("D8", "$" + operands[0])
+	elif size == 3:
+		if "D16" in instruction and "adr" in instruction:
+			print("D16 and adr for", byte + "!")
+			sys.exit(1)
+		elif "D16" in instruction:
+			instruction = instruction.replace("D16", "$" + operands[1] + operands[0])
+		elif "adr" in instruction:
+			instruction = instruction.replace("adr", "$" + operands[1] + operands[0])
 		else:
-			print("Opcode:", byte, "does not exist!")
+			print("No D16 or adr for", byte + "1")
 			sys.exit(1)
+	elif size != 1:
+		print(size - 1, "bytes left!")
+		sys.exit(1)
+
+	if instruction.find(" ") > 0:
+		instruction = instruction.replace(" ", "\t", 1)
+	return instruction, size
+
+
+# Bit maps of executed instruction starts, fetched bytes, and branches taken and not taken
+def loadCoverage(fileName):
+	with open(fileName, "rb") as coverageFile:
+		data = coverageFile.read()
+	if len(data) != len(COVERAGE_MAGIC) + 2 + 4 * MAP_SIZE or not data.startswith(COVERAGE_MAGIC) or \
+	   int.from_bytes(data[8:10], "little") != COVERAGE_VERSION:
+		print(fileName, "is not a coverage file!")
+		sys.exit(1)
+	return [data[10 + i * MAP_SIZE:10 + (i + 1) * MAP_SIZE] for i in range(4)]
+
+
+def isSet(bits, address):
+	return bits[address >> 3] >> (address & 7) & 1
+
+
+def listing(rom, origin):
+	lines = []
+	address = 0
+	while address < len(rom):
+		instruction, size = disassemble(rom[address:address + 3])
+		lines.append(hex(origin + address)[2:].zfill(4) + "\t" + instruction + "\n")
+		address += size
+	return lines
+
+
+# Code as it ran and data as DB lines of up to 8 bytes, each line starting with its address
+def coveredListing(rom, origin, maps):
+	executed, fetched, taken, notTaken = maps
+	lines = []
+	data = []
+	covered = 0
+
+	def flush():
+		if data:
+			lines.append(hex(origin + address - len(data))[2:].zfill(4) + "\tDB\t" + ",".join("$%02x" % b for b in data) + "\n")
+			del data[:]
+
+	address = 0
+	while address < len(rom):
+		if isSet(executed, origin + address):
+			flush()
+			instruction, size = disassemble(rom[address:address + 3])
+			line = hex(origin + address)[2:].zfill(4) + "\t" + instruction
+			if isSet(taken, origin + address) or isSet(notTaken, origin + address):
+				ways = isSet(taken, origin + address) * 2 + isSet(notTaken, origin + address)
+				line += "\t; " + ["", "never taken", "always taken", "both ways"][ways]
+			lines.append(line + "\n")
+			address += size
+			covered += size
+		else:
+			data.append(rom[address])
+			address += 1
+			if len(data) == 8:
+				flush()
+	flush()
+	lines.insert(0, "; %d of %d bytes ran as code\n" % (covered, len(rom)))
+	return lines
+
+
+arguments = sys.argv[1:]
+origin = 0
+if len(arguments) >= 2 and arguments[0] == "--origin":
+	origin = int(arguments[1], 16)
+	arguments = arguments[2:]
+romName = arguments[0] if arguments else "invaders"
+with open(romName, "rb") as romFile:
+	rom = romFile.read()
 
-		byte = invadersFile.read(1).hex()
-		lineNumber += 1
+if len(arguments) > 1:
+	maps = [bytearray(MAP_SIZE) for _ in range(4)]
+	for coverageName in arguments[1:]:
+		for merged, bits in zip(maps, loadCoverage(coverageName)):
+			for i in range(MAP_SIZE):
+				merged[i] |= bits[i]
+	lines = coveredListing(rom, origin, maps)
+else:
+	lines = listing(rom, origin)
 
-with open("invaders.txt", "w") as disassembledFile:
+with open(romName + ".txt", "w") as disassembledFile:
 	disassembledFile.writelines(lines)
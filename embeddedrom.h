@@ -0,0 +1,24 @@
+#ifndef EMBEDDEDROM_H
+#define EMBEDDEDROM_H
+
+#include "crc32.h"
+#include "machine.h"
+
+#include <cstdint>
+
+#ifdef EMBEDDED_ROM
+// invaders.h, .g, .f and .e compiled in, so the emulator starts without opening a file. The build
+// writes embedded_rom.inc from the files (CMake's EMBEDDED_ROM=ON, or xxd -i), and fails if they
+// aren't the ones MAME lists.
+constexpr uint8_t INVADERS_ROM[] = {
+#include "embedded_rom.inc"
+};
+
+static_assert(sizeof(INVADERS_ROM) == ROM_SIZE, "The embedded ROM should fill the ROM region!");
+static_assert(crc32(INVADERS_ROM + 0x0000, 0x0800) == 0x734f5ad8, "invaders.h isn't Space Invaders' H ROM!");
+static_assert(crc32(INVADERS_ROM + 0x0800, 0x0800) == 0x6bfaca4a, "invaders.g isn't Space Invaders' G ROM!");
+static_assert(crc32(INVADERS_ROM + 0x1000, 0x0800) == 0x0ccead96, "invaders.f isn't Space Invaders' F ROM!");
+static_assert(crc32(INVADERS_ROM + 0x1800, 0x0800) == 0x14e538b0, "invaders.e isn't Space Invaders' E ROM!");
+#endif
+
+#endif
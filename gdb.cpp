@@ -0,0 +1,378 @@
+#include "gdb.h"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <netinet/in.h>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+const int SIGNAL_INT = 2; // GDB's signal numbers
+const int SIGNAL_TRAP = 5;
+const int REGISTERS = 13; // AF BC DE HL SP PC IX IY AF' BC' DE' HL' IR
+const char HEX[] = "0123456789abcdef";
+
+static bool isNumber(const std::string &text) {
+	return !text.empty() && text.find_first_not_of("0123456789") == std::string::npos;
+}
+
+static int listenOn(const std::string &address) {
+	int listener;
+	bool bound;
+	if(isNumber(address)) {
+		listener = socket(AF_INET, SOCK_STREAM, 0);
+		if(listener < 0) {
+			throw std::runtime_error("Could not listen for GDB!");
+		}
+		int reuse = 1;
+		setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+		sockaddr_in local = {};
+		local.sin_family = AF_INET;
+		local.sin_port = htons(std::atoi(address.c_str()));
+		local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		bound = bind(listener, reinterpret_cast<sockaddr *>(&local), sizeof(local)) == 0;
+	} else {
+		sockaddr_un local = {};
+		local.sun_family = AF_UNIX;
+		if(address.size() >= sizeof(local.sun_path)) {
+			throw std::runtime_error("Socket path too long!");
+		}
+		listener = socket(AF_UNIX, SOCK_STREAM, 0);
+		if(listener < 0) {
+			throw std::runtime_error("Could not listen for GDB!");
+		}
+		std::strcpy(local.sun_path, address.c_str());
+		unlink(address.c_str());
+		bound = bind(listener, reinterpret_cast<sockaddr *>(&local), sizeof(local)) == 0;
+	}
+	if(!bound || listen(listener, 1) != 0) {
+		close(listener);
+		throw std::runtime_error("Could not listen for GDB!");
+	}
+	return listener;
+}
+
+void startDebugger(Debugger &debugger, const std::string &address) {
+	debugger.listener = listenOn(address);
+	std::fprintf(stderr, "Waiting for GDB on %s\n", address.c_str());
+	debugger.client = accept(debugger.listener, nullptr, nullptr);
+	if(debugger.client < 0) {
+		throw std::runtime_error("Could not accept GDB!");
+	}
+	debugger.stepping = true;
+}
+
+void closeDebugger(Debugger &debugger) {
+	if(debugger.client >= 0) {
+		close(debugger.client);
+	}
+	if(debugger.listener >= 0) {
+		close(debugger.listener);
+	}
+	debugger.client = -1;
+	debugger.listener = -1;
+}
+
+// Without a client the machine just runs
+static void detach(Debugger &debugger) {
+	if(debugger.client >= 0) {
+		close(debugger.client);
+	}
+	debugger.client = -1;
+	debugger.stepping = false;
+	debugger.breakpoints.fill(0);
+	if(debugger.watchpoints) {
+		debugger.watchpoints->onHit = nullptr;
+	}
+}
+
+static void sendPacket(Debugger &debugger, const std::string &data) {
+	uint8_t checksum = 0;
+	for(char c : data) {
+		checksum += c;
+	}
+	std::string packet = "$" + data + "#" + HEX[checksum >> 4] + HEX[checksum & 0x0f];
+	const char *next = packet.data();
+	size_t left = packet.size();
+	while(left > 0) {
+		ssize_t sent = ::send(debugger.client, next, left, MSG_NOSIGNAL);
+		if(sent < 0 && errno == EINTR) {
+			continue;
+		}
+		if(sent <= 0) {
+			detach(debugger);
+			return;
+		}
+		next += sent;
+		left -= sent;
+	}
+}
+
+// Blocks until a whole packet has arrived and returns its data, or returns false once GDB has
+// gone. Acks are ignored; packets are acked but never resent.
+static bool receivePacket(Debugger &debugger, std::string &data) {
+	while(debugger.client >= 0) {
+		size_t start = debugger.input.find('$');
+		size_t end = debugger.input.find('#', start);
+		if(start != std::string::npos && end != std::string::npos && end + 2 < debugger.input.size()) {
+			data = debugger.input.substr(start + 1, end - start - 1);
+			debugger.input.erase(0, end + 3);
+			::send(debugger.client, "+", 1, MSG_NOSIGNAL);
+			return true;
+		}
+		if(debugger.input.find('\x03') != std::string::npos && start == std::string::npos) {
+			debugger.input.clear(); // Ctrl-C while already stopped
+		}
+		char buffer[4096];
+		ssize_t received = recv(debugger.client, buffer, sizeof(buffer), 0);
+		if(received < 0 && errno == EINTR) {
+			continue;
+		}
+		if(received <= 0) {
+			detach(debugger);
+			return false;
+		}
+		debugger.input.append(buffer, received);
+	}
+	return false;
+}
+
+void pollDebugger(Debugger &debugger) {
+	if(debugger.client < 0) {
+		return;
+	}
+	char buffer[256];
+	ssize_t received = recv(debugger.client, buffer, sizeof(buffer), MSG_DONTWAIT);
+	if(received == 0 || (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+		detach(debugger);
+		return;
+	}
+	for(ssize_t i = 0; i < received; i++) {
+		if(buffer[i] == '\x03') {
+			debugger.interrupted = true;
+			debugger.stepping = true;
+		}
+	}
+}
+
+// Stops before the next instruction
+static void watchHit(void *context, const WatchHit &hit) {
+	Debugger &debugger = *static_cast<Debugger *>(context);
+	debugger.stepping = true;
+	debugger.watchHit = true;
+	debugger.hit = hit;
+}
+
+static std::string hexByte(uint8_t value) {
+	return std::string(1, HEX[value >> 4]) + HEX[value & 0x0f];
+}
+
+static uint16_t readRegister(const CPU &cpu, int index) {
+	switch(index) {
+		case 0:
+			return cpu.A << 8 | getFlags(cpu.f);
+		case 1:
+			return cpu.BC;
+		case 2:
+			return cpu.DE;
+		case 3:
+			return cpu.HL;
+		case 4:
+			return cpu.SP;
+		case 5:
+			return cpu.PC;
+	}
+	return 0; // Z80 only
+}
+
+static void writeRegister(CPU &cpu, int index, uint16_t value) {
+	switch(index) {
+		case 0:
+			cpu.A = value >> 8;
+			setFlags(cpu.f, value & 0xff);
+			break;
+		case 1:
+			cpu.BC = value;
+			break;
+		case 2:
+			cpu.DE = value;
+			break;
+		case 3:
+			cpu.HL = value;
+			break;
+		case 4:
+			cpu.SP = value;
+			break;
+		case 5:
+			cpu.PC = value;
+			break;
+	}
+}
+
+// Registers are little endian, low byte first
+static std::string registerHex(const CPU &cpu, int index) {
+	uint16_t value = readRegister(cpu, index);
+	return hexByte(value & 0xff) + hexByte(value >> 8);
+}
+
+static uint16_t parseRegister(const std::string &hex) {
+	uint16_t value = std::strtoul(hex.substr(0, 4).c_str(), nullptr, 16);
+	return (value >> 8) | (value << 8);
+}
+
+// Parses "address,length", as used by m, M, Z and z
+static bool parseRange(const std::string &text, uint32_t &address, uint32_t &length) {
+	char *end;
+	address = std::strtoul(text.c_str(), &end, 16);
+	if(*end != ',') {
+		return false;
+	}
+	length = std::strtoul(end + 1, nullptr, 16);
+	return address < RAM_SIZE && length <= RAM_SIZE - address;
+}
+
+static std::string handle(Debugger &debugger, Machine &machine, const std::string &packet, bool &resume) {
+	CPU &cpu = *machine.cpu;
+	char command = packet.empty() ? 0 : packet[0];
+	std::string arguments = packet.empty() ? "" : packet.substr(1);
+	uint32_t address;
+	uint32_t length;
+	switch(command) {
+		case '?':
+			return "S05";
+		case 'g': {
+			std::string registers;
+			for(int i = 0; i < REGISTERS; i++) {
+				registers += registerHex(cpu, i);
+			}
+			return registers;
+		}
+		case 'G':
+			for(int i = 0; i < REGISTERS && (size_t) i * 4 + 4 <= arguments.size(); i++) {
+				writeRegister(cpu, i, parseRegister(arguments.substr(i * 4)));
+			}
+			return "OK";
+		case 'p': {
+			int index = std::strtoul(arguments.c_str(), nullptr, 16);
+			return index < REGISTERS ? registerHex(cpu, index) : "E01";
+		}
+		case 'P': {
+			size_t equals = arguments.find('=');
+			if(equals == std::string::npos) {
+				return "E01";
+			}
+			writeRegister(cpu, std::strtoul(arguments.c_str(), nullptr, 16), parseRegister(arguments.substr(equals + 1)));
+			return "OK";
+		}
+		case 'm': {
+			if(!parseRange(arguments, address, length)) {
+				return "E01";
+			}
+			std::string memory;
+			for(uint32_t i = 0; i < length; i++) {
+				memory += hexByte(cpu.RAM[address + i]);
+			}
+			return memory;
+		}
+		case 'M': {
+			size_t colon = arguments.find(':');
+			if(colon == std::string::npos || !parseRange(arguments, address, length) || arguments.size() - colon - 1 < length * 2) {
+				return "E01";
+			}
+			for(uint32_t i = 0; i < length; i++) {
+				cpu.RAM[address + i] = std::strtoul(arguments.substr(colon + 1 + i * 2, 2).c_str(), nullptr, 16);
+			}
+			return "OK";
+		}
+		case 'c':
+		case 's':
+			if(!arguments.empty()) {
+				cpu.PC = std::strtoul(arguments.c_str(), nullptr, 16);
+			}
+			debugger.stepping = command == 's';
+			resume = true;
+			return "";
+		case 'Z':
+		case 'z':
+			if(arguments.size() < 3 || arguments[0] < '0' || arguments[0] > '4' || !parseRange(arguments.substr(2), address, length)) {
+				return "";
+			}
+			if(arguments[0] >= '2') { // Write, read and access watchpoints, length bytes from address
+				if(!debugger.watchpoints) {
+					return "";
+				}
+				const uint8_t modes[3] = {WATCH_WRITE, WATCH_READ, WATCH_READ | WATCH_WRITE};
+				for(uint32_t i = 0; i < std::max(length, (uint32_t) 1) && address + i < RAM_SIZE; i++) {
+					if(command == 'Z') {
+						addWatchpoint(*debugger.watchpoints, address + i, modes[arguments[0] - '2']);
+					} else {
+						removeWatchpoint(*debugger.watchpoints, address + i, modes[arguments[0] - '2']);
+					}
+				}
+				debugger.watchpoints->onHit = watchHit;
+				debugger.watchpoints->hitContext = &debugger;
+				return "OK";
+			}
+			// Software and hardware breakpoints are the same thing here, kind is ignored
+			if(command == 'Z') {
+				debugger.breakpoints[address >> 6] |= (uint64_t) 1 << (address & 63);
+			} else {
+				debugger.breakpoints[address >> 6] &= ~((uint64_t) 1 << (address & 63));
+			}
+			return "OK";
+		case 'k': // Halting with interrupts off ends runUntil()
+			cpu.halted = 1;
+			cpu.int_enable = 0;
+			detach(debugger);
+			resume = true;
+			return "";
+		case 'D':
+			sendPacket(debugger, "OK");
+			detach(debugger);
+			resume = true;
+			return "";
+		case 'H':
+			return "OK";
+		case 'q':
+			if(packet.compare(0, 10, "qSupported") == 0) {
+				return "PacketSize=4000";
+			}
+			if(packet == "qAttached") {
+				return "1";
+			}
+			return "";
+	}
+	return ""; // Not supported
+}
+
+void stopDebugger(Debugger &debugger, Machine &machine) {
+	if(debugger.client < 0) {
+		debugger.stepping = false;
+		return;
+	}
+	if(debugger.running && debugger.watchHit) { // GDB is waiting to hear why it stopped
+		uint8_t modes = debugger.watchpoints->modes[debugger.hit.address];
+		const char *kind = modes == (WATCH_READ | WATCH_WRITE) ? "awatch" : debugger.hit.mode == WATCH_WRITE ? "watch" : "rwatch";
+		char address[5];
+		std::snprintf(address, sizeof(address), "%04x", debugger.hit.address);
+		sendPacket(debugger, "T" + hexByte(SIGNAL_TRAP) + kind + ":" + address + ";");
+	} else if(debugger.running) {
+		sendPacket(debugger, "S" + hexByte(debugger.interrupted ? SIGNAL_INT : SIGNAL_TRAP));
+	}
+	debugger.interrupted = false;
+	debugger.watchHit = false;
+	bool resume = false;
+	std::string packet;
+	while(!resume && receivePacket(debugger, packet)) {
+		std::string reply = handle(debugger, machine, packet, resume);
+		if(!resume) {
+			sendPacket(debugger, reply);
+		}
+	}
+	debugger.running = resume;
+}
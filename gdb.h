@@ -0,0 +1,58 @@
+#ifndef GDB_H
+#define GDB_H
+
+#include "machine.h"
+#include "watch.h"
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+// GDB remote serial protocol stub. GDB has no 8080 target, so registers are sent in the layout
+// of its Z80 one (AF BC DE HL SP PC, then the Z80-only registers as zeroes), which the 8080 is a
+// subset of:
+//
+//	(gdb) set architecture z80
+//	(gdb) target remote localhost:1234
+//
+// The checks are only compiled into runUntil() with -DDEBUGGER. Even then, without a debugger
+// attached the machine runs as it always does.
+#ifdef DEBUGGER
+const bool DEBUGGER_ENABLED = true;
+#else
+const bool DEBUGGER_ENABLED = false;
+#endif
+
+struct Debugger {
+	int listener = -1;
+	int client = -1;
+	std::string input; // Received but not handled yet
+	bool stepping = false; // Stop before the next instruction
+	bool running = false; // GDB continued or stepped and is waiting for a stop reply
+	bool interrupted = false; // GDB sent Ctrl-C
+	bool watchHit = false; // hit is why it stopped
+	WatchHit hit;
+	Watchpoints *watchpoints = nullptr; // Where GDB's watchpoints go, they aren't supported without
+	std::array<uint64_t, RAM_SIZE / 64> breakpoints = {}; // One bit per address
+};
+
+inline bool isBreakpoint(const Debugger &debugger, uint16_t address) {
+	return (debugger.breakpoints[address >> 6] >> (address & 63)) & 1;
+}
+
+// Listens on a TCP port on localhost if address is a number, otherwise on a Unix socket at that
+// path, and waits for GDB to connect. The CPU stops before its first instruction.
+void startDebugger(Debugger &debugger, const std::string &address);
+// Serves GDB until it continues or steps, called with the CPU stopped
+void stopDebugger(Debugger &debugger, Machine &machine);
+// Called before each instruction while a debugger is attached
+inline void debugInstruction(Debugger &debugger, Machine &machine) {
+	if(debugger.stepping || isBreakpoint(debugger, machine.cpu->PC)) {
+		stopDebugger(debugger, machine);
+	}
+}
+// Checks for a Ctrl-C from GDB without blocking, so it can be called every so often
+void pollDebugger(Debugger &debugger);
+void closeDebugger(Debugger &debugger);
+
+#endif
@@ -0,0 +1,348 @@
+#include "lib8080.h"
+#include "coverage.h"
+#include "machine.h"
+#include "rom.h"
+#include "runahead.h"
+#include "savestate.h"
+#include "vecenv.h"
+#include "video.h"
+
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <vector>
+
+// The handle hosts get. The CPU's I/O goes through it, to the host's callbacks or the board.
+struct lib8080_machine {
+	Machine machine;
+	lib8080_in_callback in = nullptr;
+	lib8080_out_callback out = nullptr;
+	void *context = nullptr;
+	unique_ptr<RunAhead> ahead; // Made on the first lib8080_run_ahead()
+};
+
+struct lib8080_rom {
+	lib8080_rom(const void *data, size_t size, uint16_t address) : rom(static_cast<const uint8_t *>(data), size, address) {
+	}
+
+	SharedRom rom;
+};
+
+struct lib8080_vecenv {
+	VecEnv env;
+};
+
+static uint8_t hostIn(void *context, uint8_t port) {
+	lib8080_machine *machine = static_cast<lib8080_machine *>(context);
+	return machine->in ? machine->in(machine->context, port) : boardIn(machine->machine, port);
+}
+
+static void hostOut(void *context, uint8_t port, uint8_t value) {
+	lib8080_machine *machine = static_cast<lib8080_machine *>(context);
+	if(machine->out) {
+		machine->out(machine->context, port, value);
+	} else {
+		boardOut(machine->machine, port, value);
+	}
+}
+
+int lib8080_version(void) {
+	return LIB8080_VERSION;
+}
+
+lib8080_machine *lib8080_create(void) {
+	lib8080_machine *machine;
+	try {
+		machine = new lib8080_machine; // Mapping its memory can fail as well as the new
+	} catch(const std::exception &) {
+		return nullptr;
+	}
+	CPU &cpu = *machine->machine.cpu;
+	cpu.in = hostIn;
+	cpu.out = hostOut;
+	cpu.ioContext = machine;
+	return machine;
+}
+
+void lib8080_destroy(lib8080_machine *machine) {
+	delete machine;
+}
+
+lib8080_status lib8080_load_rom(lib8080_machine *machine, const void *data, size_t size, uint16_t address) {
+	if(!machine || (!data && size) || size > RAM_SIZE - address) {
+		return LIB8080_INVALID_ARGUMENT;
+	}
+	if(size) {
+		std::memcpy(machine->machine.cpu->RAM + address, data, size);
+		machine->machine.loops.rejected.reset(); // Loops there may be different ones now
+	}
+	return LIB8080_OK;
+}
+
+lib8080_rom *lib8080_rom_create(const void *data, size_t size, uint16_t address) {
+	if((!data && size) || size > RAM_SIZE - address) {
+		return nullptr;
+	}
+	try {
+		return new lib8080_rom(data, size, address);
+	} catch(const std::exception &) {
+		return nullptr;
+	}
+}
+
+void lib8080_rom_destroy(lib8080_rom *rom) {
+	delete rom;
+}
+
+lib8080_status lib8080_map_rom(lib8080_machine *machine, const lib8080_rom *rom) {
+	if(!machine || !rom) {
+		return LIB8080_INVALID_ARGUMENT;
+	}
+	try {
+		mapRom(*machine->machine.cpu, rom->rom);
+	} catch(const std::exception &) {
+		return LIB8080_OUT_OF_MEMORY;
+	}
+	machine->machine.loops.rejected.reset();
+	return LIB8080_OK;
+}
+
+uint8_t *lib8080_memory(lib8080_machine *machine) {
+	return machine ? machine->machine.cpu->RAM : nullptr;
+}
+
+uint64_t lib8080_run(lib8080_machine *machine, uint64_t cycles) {
+	if(!machine) {
+		return 0;
+	}
+	Machine &m = machine->machine;
+	uint64_t start = m.cycles;
+	try {
+		runUntil(m, start + cycles);
+	} catch(const std::exception &) { // Stops where it got to
+	}
+	return m.cycles - start;
+}
+
+uint64_t lib8080_cycles(const lib8080_machine *machine) {
+	return machine ? machine->machine.cycles : 0;
+}
+
+void lib8080_get_registers(const lib8080_machine *machine, lib8080_registers *registers) {
+	if(!machine || !registers) {
+		return;
+	}
+	const CPU &cpu = *machine->machine.cpu;
+	registers->a = cpu.A;
+	registers->b = cpu.B;
+	registers->c = cpu.C;
+	registers->d = cpu.D;
+	registers->e = cpu.E;
+	registers->h = cpu.H;
+	registers->l = cpu.L;
+	registers->flags = getFlags(cpu.f);
+	registers->sp = cpu.SP;
+	registers->pc = cpu.PC;
+	registers->int_enable = cpu.int_enable;
+	registers->halted = cpu.halted;
+}
+
+void lib8080_set_registers(lib8080_machine *machine, const lib8080_registers *registers) {
+	if(!machine || !registers) {
+		return;
+	}
+	CPU &cpu = *machine->machine.cpu;
+	cpu.A = registers->a;
+	cpu.B = registers->b;
+	cpu.C = registers->c;
+	cpu.D = registers->d;
+	cpu.E = registers->e;
+	cpu.H = registers->h;
+	cpu.L = registers->l;
+	setFlags(cpu.f, registers->flags);
+	cpu.SP = registers->sp;
+	cpu.PC = registers->pc;
+	cpu.int_enable = registers->int_enable != 0;
+	cpu.halted = registers->halted != 0;
+	machine->machine.idle = IdleLoop(); // The state it remembered may not be reachable any more
+}
+
+static_assert(LIB8080_SCREEN_WIDTH == SCREEN_WIDTH && LIB8080_SCREEN_HEIGHT == SCREEN_HEIGHT, "Screen sizes differ");
+
+void lib8080_render(const lib8080_machine *machine, uint8_t *rgba) {
+	if(machine && rgba) {
+		convertFrame(machine->machine.cpu->RAM + VRAM_START, rgba);
+	}
+}
+
+static_assert(LIB8080_FRAME_CYCLES == FRAME_CYCLES, "Frame lengths differ");
+
+uint64_t lib8080_run_ahead(lib8080_machine *machine, uint64_t cycles, uint64_t ahead, uint8_t *rgba) {
+	uint64_t run = lib8080_run(machine, cycles);
+	if(!machine || !rgba) {
+		return run;
+	}
+	const uint8_t *vram = machine->machine.cpu->RAM + VRAM_START;
+	if(!machine->ahead) {
+		try {
+			machine->ahead.reset(new RunAhead());
+		} catch(const std::bad_alloc &) {
+		}
+	}
+	if(machine->ahead && ahead) { // Without the memory it's drawn without running ahead
+		lib8080_out_callback out = machine->out;
+		machine->out = nullptr; // Whatever it does couldn't be taken back
+		try {
+			runAhead(machine->machine, *machine->ahead, ahead);
+			vram = machine->ahead->vram.data();
+		} catch(const std::exception &) { // Rewound, so it's drawn without running ahead
+		}
+		machine->out = out;
+	}
+	convertFrame(vram, rgba);
+	return run;
+}
+
+void lib8080_set_io(lib8080_machine *machine, lib8080_in_callback in, lib8080_out_callback out, void *context) {
+	if(!machine) {
+		return;
+	}
+	machine->in = in;
+	machine->out = out;
+	machine->context = context;
+}
+
+void lib8080_set_inputs(lib8080_machine *machine, uint8_t inputs) {
+	if(machine) {
+		machine->machine.inputs = inputs;
+	}
+}
+
+lib8080_status lib8080_snapshot(const lib8080_machine *machine, void *buffer, size_t capacity, size_t *size) {
+	if(!machine || !size || (!buffer && capacity)) {
+		return LIB8080_INVALID_ARGUMENT;
+	}
+	try {
+		std::vector<uint8_t> payload;
+		takeSnapshot(machine->machine, payload);
+		std::vector<uint8_t> state = encodeState(payload);
+		*size = state.size();
+		if(state.size() > capacity) {
+			return LIB8080_BUFFER_TOO_SMALL;
+		}
+		std::memcpy(buffer, state.data(), state.size());
+		return LIB8080_OK;
+	} catch(const std::bad_alloc &) {
+		return LIB8080_OUT_OF_MEMORY;
+	}
+}
+
+size_t lib8080_snapshot_max_size(void) {
+	return SAVE_STATE_HEADER_SIZE + SAVE_STATE_PAYLOAD_SIZE; // Stored uncompressed if LZ doesn't help
+}
+
+lib8080_status lib8080_restore(lib8080_machine *machine, const void *buffer, size_t size) {
+	if(!machine || !buffer) {
+		return LIB8080_INVALID_ARGUMENT;
+	}
+	try {
+		const uint8_t *bytes = static_cast<const uint8_t *>(buffer);
+		restoreSnapshot(machine->machine, decodeState(std::vector<uint8_t>(bytes, bytes + size)));
+		return LIB8080_OK;
+	} catch(const std::bad_alloc &) {
+		return LIB8080_OUT_OF_MEMORY;
+	} catch(const std::runtime_error &) {
+		return LIB8080_BAD_SNAPSHOT;
+	}
+}
+
+static_assert(LIB8080_OBSERVATION_WIDTH == OBSERVATION_WIDTH && LIB8080_OBSERVATION_HEIGHT == OBSERVATION_HEIGHT,
+              "Observation sizes differ");
+static_assert(LIB8080_ACTION_FIRE == ACTION_FIRE && LIB8080_ACTION_LEFT == ACTION_LEFT && LIB8080_ACTION_RIGHT == ACTION_RIGHT,
+              "Actions differ");
+static_assert(LIB8080_INPUT_COIN == INPUT_COIN && LIB8080_INPUT_P1_START == INPUT_P1_START &&
+              LIB8080_INPUT_P1_FIRE == INPUT_P1_FIRE && LIB8080_INPUT_P1_RIGHT == INPUT_P1_RIGHT, "Inputs differ");
+
+static_assert(LIB8080_COVERAGE_SIZE == COVERAGE_FILE_SIZE, "lib8080.h has the wrong coverage size");
+
+lib8080_status lib8080_coverage(void *buffer, size_t capacity, size_t *size) {
+#ifdef COVERAGE
+	if(!size || (!buffer && capacity)) {
+		return LIB8080_INVALID_ARGUMENT;
+	}
+	*size = COVERAGE_FILE_SIZE;
+	if(capacity < COVERAGE_FILE_SIZE) {
+		return LIB8080_BUFFER_TOO_SMALL;
+	}
+	try {
+		std::vector<uint8_t> file = encodeCoverage(snapshotCoverage());
+		std::memcpy(buffer, file.data(), file.size());
+	} catch(const std::exception &) {
+		return LIB8080_OUT_OF_MEMORY;
+	}
+	return LIB8080_OK;
+#else
+	(void) buffer;
+	(void) capacity;
+	(void) size;
+	return LIB8080_INVALID_ARGUMENT;
+#endif
+}
+
+lib8080_vecenv *lib8080_vecenv_create(const void *rom, size_t size, int count, int threads) {
+	if(!rom) {
+		return nullptr;
+	}
+	lib8080_vecenv *env = new(std::nothrow) lib8080_vecenv;
+	if(!env) {
+		return nullptr;
+	}
+	try {
+		startVecEnv(env->env, static_cast<const uint8_t *>(rom), size, count, threads);
+		return env;
+	} catch(const std::exception &) {
+		lib8080_vecenv_destroy(env);
+		return nullptr;
+	}
+}
+
+void lib8080_vecenv_destroy(lib8080_vecenv *env) {
+	if(env) {
+		stopVecEnv(env->env);
+		delete env;
+	}
+}
+
+int lib8080_vecenv_count(const lib8080_vecenv *env) {
+	return env ? env->env.count : 0;
+}
+
+void lib8080_vecenv_observations(const lib8080_vecenv *env, lib8080_observations *observations) {
+	if(!env || !observations) {
+		return;
+	}
+	const Observations &o = env->env.observations;
+	observations->pixels = o.pixels;
+	observations->scores = o.scores;
+	observations->rewards = o.rewards;
+	observations->lives = o.lives;
+	observations->dones = o.dones;
+}
+
+void lib8080_vecenv_step(lib8080_vecenv *env, const uint8_t *actions) {
+	if(env && actions) {
+		try {
+			stepVecEnv(env->env, actions);
+		} catch(const std::exception &) { // Games that fail are already marked done
+		}
+	}
+}
+
+void lib8080_vecenv_reset(lib8080_vecenv *env) {
+	if(env) {
+		try {
+			resetVecEnv(env->env);
+		} catch(const std::exception &) {
+		}
+	}
+}
@@ -0,0 +1,169 @@
+#ifndef LIB8080_H
+#define LIB8080_H
+
+/* C interface to the emulator core, for embedding it in other programs. Only these functions
+ * are exported from the shared library; the C++ inside can change without breaking hosts.
+ * The machine is the Space Invaders board: a 2 MHz 8080 with 64 KiB of RAM, interrupted with
+ * RST 1 and RST 2 120 times a second (only while the program has interrupts enabled), with
+ * the board's buttons and shift register on its I/O ports unless the host takes them over.
+ *
+ * A machine may be used from any thread, but only from one at a time. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32) && !defined(LIB8080_STATIC)
+#ifdef LIB8080_BUILD
+#define LIB8080_API __declspec(dllexport)
+#else
+#define LIB8080_API __declspec(dllimport)
+#endif
+#elif defined(__GNUC__)
+#define LIB8080_API __attribute__((visibility("default")))
+#else
+#define LIB8080_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The screen lib8080_render() draws, the monitor being mounted on its side */
+#define LIB8080_SCREEN_WIDTH 224
+#define LIB8080_SCREEN_HEIGHT 256
+
+/* Bumped whenever a function or struct below changes incompatibly */
+#define LIB8080_VERSION 1
+
+typedef struct lib8080_machine lib8080_machine;
+
+typedef enum lib8080_status {
+	LIB8080_OK = 0,
+	LIB8080_INVALID_ARGUMENT = 1, /* A null pointer, or a ROM that doesn't fit in memory */
+	LIB8080_BUFFER_TOO_SMALL = 2, /* lib8080_snapshot() stored the size it needs */
+	LIB8080_BAD_SNAPSHOT = 3, /* Corrupt, truncated or from a newer version */
+	LIB8080_OUT_OF_MEMORY = 4
+} lib8080_status;
+
+typedef struct lib8080_registers {
+	uint8_t a, b, c, d, e, h, l;
+	uint8_t flags; /* As PUSH PSW stores them: S Z 0 AC 0 P 1 CY */
+	uint16_t sp, pc;
+	uint8_t int_enable;
+	uint8_t halted;
+} lib8080_registers;
+
+/* IN returns what the callback does and OUT goes to it instead of the board. Both are called on
+ * the thread running the machine. */
+typedef uint8_t (*lib8080_in_callback)(void *context, uint8_t port);
+typedef void (*lib8080_out_callback)(void *context, uint8_t port, uint8_t value);
+
+/* The LIB8080_VERSION the library was built with, to check against the header */
+LIB8080_API int lib8080_version(void);
+
+/* A powered on machine with zeroed RAM and registers, or NULL if out of memory */
+LIB8080_API lib8080_machine *lib8080_create(void);
+LIB8080_API void lib8080_destroy(lib8080_machine *machine);
+
+/* Copies size bytes into RAM from address on. Doesn't touch the registers. */
+LIB8080_API lib8080_status lib8080_load_rom(lib8080_machine *machine, const void *data, size_t size, uint16_t address);
+/* A ROM image mapped into the RAM of every machine it's loaded into instead of copied, for hosts
+ * running many machines: they all read its one copy of each page until one writes to it. NULL
+ * if the image doesn't fit in memory or memory runs out. Machines keep it after it's destroyed. */
+typedef struct lib8080_rom lib8080_rom;
+LIB8080_API lib8080_rom *lib8080_rom_create(const void *data, size_t size, uint16_t address);
+LIB8080_API void lib8080_rom_destroy(lib8080_rom *rom);
+/* Like lib8080_load_rom() with the image's bytes and address */
+LIB8080_API lib8080_status lib8080_map_rom(lib8080_machine *machine, const lib8080_rom *rom);
+/* The machine's 65536 bytes of RAM, valid until it is destroyed. The program may modify it. */
+LIB8080_API uint8_t *lib8080_memory(lib8080_machine *machine);
+
+/* Runs at least cycles cycles (finishing the last instruction may go slightly over), or
+ * until the CPU halts with interrupts disabled. Returns the cycles run. */
+LIB8080_API uint64_t lib8080_run(lib8080_machine *machine, uint64_t cycles);
+/* Cycles since power on */
+LIB8080_API uint64_t lib8080_cycles(const lib8080_machine *machine);
+
+LIB8080_API void lib8080_get_registers(const lib8080_machine *machine, lib8080_registers *registers);
+LIB8080_API void lib8080_set_registers(lib8080_machine *machine, const lib8080_registers *registers);
+
+/* Draws video memory into rgba, LIB8080_SCREEN_WIDTH * LIB8080_SCREEN_HEIGHT * 4 bytes from the
+ * top left, coloured by the cabinet's overlay */
+LIB8080_API void lib8080_render(const lib8080_machine *machine, uint8_t *rgba);
+
+/* Runs cycles like lib8080_run(), then ahead cycles more with the same inputs, draws the screen
+ * there into rgba like lib8080_render() and rewinds to where lib8080_run() would have stopped.
+ * Called once a frame, the picture shows input that much sooner (LIB8080_FRAME_CYCLES is a
+ * frame). The cycles run ahead don't reach the OUT callback. Returns the cycles really run. */
+#define LIB8080_FRAME_CYCLES 33332
+LIB8080_API uint64_t lib8080_run_ahead(lib8080_machine *machine, uint64_t cycles, uint64_t ahead, uint8_t *rgba);
+
+/* Replaces both callbacks. NULL hands that direction back to the board. */
+LIB8080_API void lib8080_set_io(lib8080_machine *machine, lib8080_in_callback in, lib8080_out_callback out,
+                                void *context);
+
+/* The board's buttons (IN 1), pressed while their bit is set */
+#define LIB8080_INPUT_COIN 0x01
+#define LIB8080_INPUT_P2_START 0x02
+#define LIB8080_INPUT_P1_START 0x04
+#define LIB8080_INPUT_P1_FIRE 0x10
+#define LIB8080_INPUT_P1_LEFT 0x20
+#define LIB8080_INPUT_P1_RIGHT 0x40
+LIB8080_API void lib8080_set_inputs(lib8080_machine *machine, uint8_t inputs);
+
+/* Writes the whole machine state into buffer in the save state file format (savestate.h) and
+ * stores its size in size. If capacity is too small nothing is written and
+ * LIB8080_BUFFER_TOO_SMALL is returned; lib8080_snapshot_max_size() is always enough. */
+LIB8080_API lib8080_status lib8080_snapshot(const lib8080_machine *machine, void *buffer, size_t capacity,
+                                            size_t *size);
+LIB8080_API size_t lib8080_snapshot_max_size(void);
+/* Accepts snapshots and save state files. The machine is left as it was on failure. */
+LIB8080_API lib8080_status lib8080_restore(lib8080_machine *machine, const void *buffer, size_t size);
+
+/* Everything every machine has run so far, in the coverage file format (coverage.h), with its
+ * size stored in size; LIB8080_BUFFER_TOO_SMALL as for snapshots. Builds without -DCOVERAGE
+ * return LIB8080_INVALID_ARGUMENT. */
+#define LIB8080_COVERAGE_SIZE 32778
+LIB8080_API lib8080_status lib8080_coverage(void *buffer, size_t capacity, size_t *size);
+
+/* A batch of Space Invaders games stepped a frame at a time in parallel, for training agents.
+ * Observations for all of them are in one buffer the environment owns, which each step
+ * overwrites. */
+typedef struct lib8080_vecenv lib8080_vecenv;
+
+/* Observations are the screen at half resolution */
+#define LIB8080_OBSERVATION_WIDTH (LIB8080_SCREEN_WIDTH / 2)
+#define LIB8080_OBSERVATION_HEIGHT (LIB8080_SCREEN_HEIGHT / 2)
+
+/* Actions, one byte per game, any combination */
+#define LIB8080_ACTION_FIRE 0x01
+#define LIB8080_ACTION_LEFT 0x02
+#define LIB8080_ACTION_RIGHT 0x04
+
+/* Arrays with an entry per game, valid until the environment is destroyed */
+typedef struct lib8080_observations {
+	const uint8_t *pixels; /* Games x HEIGHT x WIDTH, how much of each 2x2 block is lit, 0 to 255 */
+	const int32_t *scores; /* Player 1's */
+	const int32_t *rewards; /* Points scored in the last step */
+	const uint8_t *lives; /* Spare ships */
+	const uint8_t *dones; /* The game ended in the last step; it starts again on the next */
+} lib8080_observations;
+
+/* count games of the given ROM (all 8 KiB of invaders.h, .g, .f and .e in that order), already
+ * started, using up to threads threads including the caller's (0 for one per core). NULL if
+ * the ROM doesn't start a game or memory runs out. */
+LIB8080_API lib8080_vecenv *lib8080_vecenv_create(const void *rom, size_t size, int count, int threads);
+LIB8080_API void lib8080_vecenv_destroy(lib8080_vecenv *env);
+LIB8080_API int lib8080_vecenv_count(const lib8080_vecenv *env);
+LIB8080_API void lib8080_vecenv_observations(const lib8080_vecenv *env, lib8080_observations *observations);
+/* Runs every game one frame with actions[game], returning once they're all done. A game that
+ * can't run is reported done and starts over on the next step. */
+LIB8080_API void lib8080_vecenv_step(lib8080_vecenv *env, const uint8_t *actions);
+/* Starts every game over */
+LIB8080_API void lib8080_vecenv_reset(lib8080_vecenv *env);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,212 @@
+#include "machine.h"
+#include "audio.h"
+
+#include <algorithm>
+#ifdef RECOMPILED
+#include "recompiled.h"
+#endif
+#ifdef DEBUGGER
+#include "gdb.h"
+#include "watch.h"
+#endif
+
+// Instructions an idle loop may contain: nothing that writes memory, touches the stack or
+// does I/O, so an iteration can only observe what the last one did
+static bool isSideEffectFree(uint8_t opCode) {
+	if(opCode >= 0x40 && opCode < 0xc0) { // MOV, ALU
+		return opCode < 0x70 || opCode >= 0x78;
+	}
+	if((opCode & 0xc7) == 0xc6) { // Immediate ALU
+		return true;
+	}
+	if((opCode & 0xc6) == 0x04 || (opCode & 0xc7) == 0x06) { // INR, DCR, MVI
+		return (opCode & 0x38) != 0x30;
+	}
+	switch(opCode) {
+		case 0x00: // NOP
+		case 0x01: case 0x11: case 0x21: // LXI
+		case 0x03: case 0x13: case 0x23: // INX
+		case 0x0b: case 0x1b: case 0x2b: // DCX
+		case 0x09: case 0x19: case 0x29: // DAD
+		case 0x0a: case 0x1a: case 0x2a: case 0x3a: // LDAX, LHLD, LDA
+		case 0x07: case 0x0f: case 0x17: case 0x1f: // Rotates
+		case 0x27: case 0x2f: case 0x37: case 0x3f: // DAA, CMA, STC, CMC
+		case 0xeb: // XCHG
+			return true;
+	}
+	return false;
+}
+
+static uint64_t registerState(const CPU &cpu) {
+	uint64_t flags = getFlags(cpu.f);
+	return (uint64_t) cpu.A | (uint64_t) cpu.BC << 8 | (uint64_t) cpu.DE << 24 | (uint64_t) cpu.HL << 40 | flags << 56;
+}
+
+// Space Invaders spends most of each frame in loops like LDA 20c0 / ANA A / JNZ, waiting for an
+// interrupt to change memory. Once a pass through a short straight-line loop without side effects
+// leaves every register and flag as it was, every pass will until the next interrupt, so those
+// passes are skipped in one go. Loops with side effects may be copies or fills runBlockLoop()
+// can run natively instead. Returns whether anything was skipped or run.
+static bool skipIdleLoop(Machine &machine, uint64_t until) {
+	CPU &cpu = *machine.cpu;
+	IdleLoop &idle = machine.idle;
+	uint8_t opCode = cpu.RAM[cpu.PC];
+	if(opCode != 0xc3 && (opCode & 0xc7) != 0xc2) { // JMP, Jcc
+		return false;
+	}
+	uint16_t target = (cpu.RAM[(uint16_t) (cpu.PC + 2)] << 8) | cpu.RAM[(uint16_t) (cpu.PC + 1)];
+	if(target > cpu.PC || cpu.PC - target > 16) {
+		return false;
+	}
+
+	if(idle.jump != cpu.PC || idle.target != target) {
+		idle.jump = cpu.PC;
+		idle.target = target;
+		idle.seen = false;
+		idle.iteration = OPCODE_CYCLES[opCode];
+		uint16_t address = target;
+		while(address < cpu.PC && isSideEffectFree(cpu.RAM[address])) {
+			idle.iteration += OPCODE_CYCLES[cpu.RAM[address]];
+			address += OPCODE_SIZES[cpu.RAM[address]];
+		}
+		if(address != cpu.PC) {
+			idle.iteration = 0;
+		}
+	}
+	if(idle.iteration == 0) {
+		int cycles = atBlockLoop(cpu, machine.loops) ? runBlockLoop(machine.cpu, machine.loops, until - machine.cycles) : 0;
+		machine.cycles += cycles;
+		return cycles != 0;
+	}
+
+	uint64_t state = registerState(cpu);
+	bool repeated = idle.seen && idle.state == state && idle.cycles + idle.iteration == machine.cycles;
+	idle.seen = true;
+	idle.state = state;
+	idle.cycles = machine.cycles;
+	if(!repeated || until - machine.cycles < (uint64_t) idle.iteration) {
+		return false;
+	}
+
+	uint64_t skipped = (until - machine.cycles) / idle.iteration * idle.iteration;
+	machine.cycles += skipped;
+	machine.idleCycles += skipped;
+	idle.cycles = machine.cycles;
+	return true;
+}
+
+uint8_t boardIn(Machine &machine, uint8_t port) {
+	switch(port) {
+		case 0:
+			return 0x0e; // Unused, tied high
+		case 1:
+			return machine.inputs | 0x08;
+		case 2:
+			return machine.dipSwitches;
+		case 3:
+			return (uint8_t) (machine.shift >> (8 - machine.shiftOffset));
+	}
+	return 0x00;
+}
+
+// OUT 3 and OUT 5 trigger the sounds, 6 is the watchdog
+void boardOut(Machine &machine, uint8_t port, uint8_t value) {
+	switch(port) {
+		case 2:
+			machine.shiftOffset = value & 0x07;
+			break;
+		case 4:
+			machine.shift = (uint16_t) (value << 8 | machine.shift >> 8);
+			break;
+		case 3:
+		case 5:
+			(port == 3 ? machine.port3 : machine.port5) = value;
+			if(machine.audio) {
+				soundOut(*machine.audio, machine.cycles, port, value);
+			}
+			break;
+	}
+}
+
+static uint8_t machineIn(void *context, uint8_t port) {
+	return boardIn(*static_cast<Machine *>(context), port);
+}
+
+static void machineOut(void *context, uint8_t port, uint8_t value) {
+	boardOut(*static_cast<Machine *>(context), port, value);
+}
+
+Machine::Machine() {
+	markCode(loops, 0, ROM_SIZE);
+	cpu->in = machineIn;
+	cpu->out = machineOut;
+	cpu->ioContext = this;
+}
+
+#ifdef DEBUGGER
+static bool watching(const Machine &machine) {
+	return machine.watchpoints && machine.watchpoints->count;
+}
+
+static bool debugging(const Machine &machine) {
+	return (machine.debugger && machine.debugger->client >= 0) || watching(machine);
+}
+#endif
+
+static int step(Machine &machine, uint64_t until) {
+#ifdef RECOMPILED
+	int cycles = runRecompiled(machine.cpu, until - machine.cycles);
+	if(cycles) {
+		return cycles;
+	}
+#else
+	(void) until;
+#endif
+	return emulate8080(machine.cpu);
+}
+
+bool runUntil(Machine &machine, uint64_t end) {
+	while(machine.cycles < end) {
+		uint64_t until = std::min(end, machine.nextInterrupt);
+		while(machine.cycles < until) {
+			if(machine.cpu->halted) {
+				if(!machine.cpu->int_enable) {
+					return false;
+				}
+				machine.idleCycles += until - machine.cycles;
+				machine.cycles = until;
+#ifdef DEBUGGER
+			} else if(debugging(machine)) {
+				// One instruction at a time and no idle skipping, so every breakpoint and watchpoint is seen
+				if(machine.debugger && machine.debugger->client >= 0) {
+					debugInstruction(*machine.debugger, machine);
+				}
+				if(!machine.cpu->halted) { // Unless GDB killed it
+					machine.cycles += watching(machine) ? emulateWatched(machine) : emulate8080(machine.cpu);
+				}
+#endif
+			} else if(!skipIdleLoop(machine, until)) {
+				machine.cycles += step(machine, until);
+			}
+		}
+
+		if(machine.cycles >= machine.nextInterrupt) {
+#ifdef DEBUGGER
+			if(machine.debugger) {
+				pollDebugger(*machine.debugger); // For a Ctrl-C, 120 times a second
+			}
+#endif
+			if(machine.cpu->int_enable) {
+				generateInterrupt(machine.cpu, machine.nextVector);
+				machine.cycles += 11;
+			}
+			machine.nextVector = machine.nextVector == 1 ? 2 : 1;
+			machine.nextInterrupt += HALF_FRAME_CYCLES;
+		}
+	}
+	return true;
+}
+
+bool runFrame(Machine &machine) {
+	return runUntil(machine, machine.cycles - machine.cycles % FRAME_CYCLES + FRAME_CYCLES); // Ends just after RST 2
+}
@@ -0,0 +1,71 @@
+#ifndef MACHINE_H
+#define MACHINE_H
+
+#include "blockloop.h"
+#include "cpu.h"
+
+struct Audio;
+struct Debugger;
+struct Watchpoints;
+
+// Space Invaders runs the 8080 at 2 MHz and interrupts it twice a frame: RST 1 when the beam
+// is in the middle of the screen and RST 2 at vblank
+const int CPU_HZ = 2000000;
+const int HALF_FRAME_CYCLES = CPU_HZ / 120;
+const int FRAME_CYCLES = HALF_FRAME_CYCLES * 2;
+const uint32_t ROM_SIZE = 0x2000; // From 0x0000, the rest is RAM
+
+// IN 1 on the Space Invaders board, set means pressed. Bit 3 always reads 1.
+enum InputBits {
+	INPUT_COIN = 0x01,
+	INPUT_P2_START = 0x02,
+	INPUT_P1_START = 0x04,
+	INPUT_P1_FIRE = 0x10,
+	INPUT_P1_LEFT = 0x20,
+	INPUT_P1_RIGHT = 0x40
+};
+
+struct IdleLoop {
+	uint16_t jump = 0x0000; // Backward jump closing the loop
+	uint16_t target = 0x0000;
+	int iteration = 0; // Cycles per iteration, 0 if the loop isn't side effect free
+	bool seen = false; // state and cycles hold the last time the jump was reached
+	uint64_t state = 0;
+	uint64_t cycles = 0;
+};
+
+struct Machine {
+	Machine();
+	Machine(const Machine &) = delete; // The CPU's I/O handlers point back at the machine
+	Machine &operator=(const Machine &) = delete;
+
+	unique_ptr<CPU> cpu = unique_ptr<CPU>(new CPU());
+	uint64_t cycles = 0; // Since power on
+	uint64_t nextInterrupt = HALF_FRAME_CYCLES;
+	int nextVector = 1;
+	uint64_t idleCycles = 0; // Skipped in idle loops and HLT instead of emulated
+	IdleLoop idle;
+	BlockLoops loops; // The ROM is marked as code
+	// Space Invaders board I/O
+	uint8_t inputs = 0x00; // InputBits
+	uint8_t dipSwitches = 0x00; // IN 2: 3 ships, extra ship at 1500 points
+	uint16_t shift = 0x0000; // Shift register, the last two bytes written to OUT 4
+	uint8_t shiftOffset = 0; // OUT 2, IN 3 reads the 8 bits that many below the top of shift
+	uint8_t port3 = 0x00; // Last values written to the sound triggers, for save states
+	uint8_t port5 = 0x00;
+	Audio *audio = nullptr; // Gets the OUT 3 and OUT 5 sound triggers when set
+	// Only looked at in -DDEBUGGER builds
+	Debugger *debugger = nullptr;
+	Watchpoints *watchpoints = nullptr;
+};
+
+// The board's ports, what the CPU's I/O handlers are set to by default
+uint8_t boardIn(Machine &machine, uint8_t port);
+void boardOut(Machine &machine, uint8_t port, uint8_t value);
+
+// Runs until the given cycle, delivering interrupts on the way. Returns false once the CPU has
+// halted with interrupts disabled, since nothing can wake it up again.
+bool runUntil(Machine &machine, uint64_t end);
+bool runFrame(Machine &machine);
+
+#endif
@@ -0,0 +1,318 @@
+#include "audio.h"
+#include "cpm.h"
+#include "counters.h"
+#include "coverage.h"
+#include "gdb.h"
+#include "cpu.h"
+#include "embeddedrom.h"
+#include "machine.h"
+#include "monitor.h"
+#include "pacer.h"
+#include "runahead.h"
+#include "savestate.h"
+#include "video.h"
+#include "warmstart.h"
+#include "watch.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdio.h>
+#include <string>
+
+using std::cout;
+using std::endl;
+
+void usage() {
+	cout << "Usage: emulator [--turbo | --speed N] [--frames N] [--wav FILE | --raw FILE] [--y4m FILE | --rgba FILE]" << endl;
+	cout << "                [--load FILE | --warm POINT [--cache DIR]] [--save FILE [--checkpoint N]] [--screenshot FILE]" << endl;
+	cout << "                [--stats] [--coverage FILE] [--gdb PORT | --gdb SOCKET] [--watch ADDRESS[:r|:w|:rw]]..." << endl;
+	cout << "                [--monitor NAME [--monitor-ram START:LENGTH]] [--run-ahead N]" << endl;
+	cout << "       emulator --cpm FILE [--stats] [--coverage FILE]" << endl;
+	cout << "  --turbo     Run as fast as possible" << endl;
+	cout << "  --speed N   Run at N times real time" << endl;
+	cout << "  --frames N  Stop after N frames and print pacing stats" << endl;
+	cout << "  --wav FILE  Record the sound to a WAV file" << endl;
+	cout << "  --raw FILE  Stream the sound as raw 16-bit 44.1 kHz mono PCM (e.g. to a pipe)" << endl;
+	cout << "  --y4m FILE  Record the video as YUV4MPEG2, - for stdout (e.g. into ffmpeg -i -)" << endl;
+	cout << "  --rgba FILE Record the video as raw 224x256 RGBA frames, - for stdout" << endl;
+	cout << "  --load FILE Start from a save state" << endl;
+	cout << "  --warm POINT  Start at boot, attract or game, from a cached state if there is one" << endl;
+	cout << "  --cache DIR Where --warm keeps its states (default $XDG_CACHE_HOME/i8080 or ~/.cache/i8080)" << endl;
+	cout << "  --save FILE Save the state on exit" << endl;
+	cout << "  --checkpoint N  Also save it every N frames, in the background" << endl;
+	cout << "  --screenshot FILE  Write the last frame as a PPM on exit" << endl;
+	cout << "  --stats     Print the instruction counters on exit (needs a -DCOUNTERS build)" << endl;
+	cout << "  --coverage FILE  Add the code run to a coverage file on exit (needs a -DCOVERAGE build)" << endl;
+	cout << "  --gdb PORT  Wait for GDB on a localhost TCP port, or a Unix socket path (needs a -DDEBUGGER build)" << endl;
+	cout << "  --watch ADDRESS[:r|:w|:rw]  Report reads and/or writes (the default) of a hex address (needs -DDEBUGGER)" << endl;
+	cout << "  --monitor NAME  Publish the state every frame in the shared memory segment /NAME" << endl;
+	cout << "  --monitor-ram START:LENGTH  The RAM it includes, in hex (default 2000:400)" << endl;
+	cout << "  --run-ahead N  Show the screen N frames ahead of the game, to hide its input lag (1 to 8)" << endl;
+	cout << "  --cpm FILE  Run a CP/M .COM program such as cpudiag.bin headless, as fast as possible" << endl;
+}
+
+// ORs what this run covered into the file, if there is one, so runs one after another add up
+void writeCoverage(const std::string &fileName, std::ostream &out) {
+	CoverageMap map = snapshotCoverage();
+	if(COVERAGE_ENABLED) {
+		if(std::ifstream(fileName)) {
+			mergeCoverage(map, loadCoverage(fileName));
+		}
+		saveCoverage(map, fileName);
+	}
+	printCoverage(map, out);
+	if(uncoveredThreads()) {
+		out << uncoveredThreads() << " threads not covered, over " << MAX_COVERAGE_THREADS << " at once" << endl;
+	}
+}
+
+// Console output goes to stdout and the timing to stderr, so the output can be compared as is
+int runCom(const std::string &fileName, bool stats, const std::string &coverageFile) {
+	CPM cpm;
+	loadCom(cpm, fileName);
+	auto start = std::chrono::steady_clock::now();
+	bool finished = runCPM(cpm);
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	if(!finished) {
+		std::cerr << "Halted at " << std::hex << cpm.cpu->PC - 1 << std::dec << endl;
+	}
+	std::cerr << endl << cpm.cycles << " cycles in " << seconds << " s (" << cpm.cycles / seconds / 1e6 << " MHz)" << endl;
+	if(stats) {
+		printCounters(snapshotCounters(), std::cerr);
+	}
+	if(!coverageFile.empty()) {
+		writeCoverage(coverageFile, std::cerr);
+	}
+	return finished ? 0 : 1;
+}
+
+int main(int argc, char *argv[]) {
+	PacingMode mode = PacingMode::RealTime;
+	double multiplier = 1.0;
+	uint64_t frames = 0; // Forever
+	std::string audioFile;
+	AudioFormat audioFormat = AudioFormat::Wav;
+	std::string captureFile;
+	CaptureFormat captureFormat = CaptureFormat::Y4m;
+	std::string loadFile;
+	bool warm = false;
+	WarmStart warmPoint = WarmStart::Boot;
+	std::string cacheDirectory = defaultCacheDirectory();
+	std::string saveFile;
+	std::string comFile;
+	std::string screenshotFile;
+	bool stats = false;
+	std::string coverageFile;
+	std::string monitorName;
+	unsigned long monitorStart = MONITOR_DEFAULT_START;
+	unsigned long monitorLength = MONITOR_DEFAULT_LENGTH;
+	int runAheadFrames = 0;
+	std::string gdbAddress;
+	Watchpoints watchpoints;
+	uint64_t checkpoint = 0; // Frames between saves, 0 for only on exit
+	for(int i = 1; i < argc; i++) {
+		if(strcmp(argv[i], "--turbo") == 0) {
+			mode = PacingMode::Turbo;
+		} else if(strcmp(argv[i], "--speed") == 0 && i + 1 < argc && atof(argv[i + 1]) > 0) {
+			mode = PacingMode::Multiplier;
+			multiplier = atof(argv[++i]);
+		} else if(strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+			frames = strtoull(argv[++i], nullptr, 10);
+		} else if((strcmp(argv[i], "--wav") == 0 || strcmp(argv[i], "--raw") == 0) && i + 1 < argc) {
+			audioFormat = strcmp(argv[i], "--wav") == 0 ? AudioFormat::Wav : AudioFormat::Raw;
+			audioFile = argv[++i];
+		} else if((strcmp(argv[i], "--y4m") == 0 || strcmp(argv[i], "--rgba") == 0) && i + 1 < argc) {
+			captureFormat = strcmp(argv[i], "--y4m") == 0 ? CaptureFormat::Y4m : CaptureFormat::Rgba;
+			captureFile = argv[++i];
+		} else if(strcmp(argv[i], "--load") == 0 && i + 1 < argc) {
+			loadFile = argv[++i];
+		} else if(strcmp(argv[i], "--warm") == 0 && i + 1 < argc && parseWarmStart(argv[i + 1], warmPoint)) {
+			warm = true;
+			i++;
+		} else if(strcmp(argv[i], "--cache") == 0 && i + 1 < argc) {
+			cacheDirectory = argv[++i];
+		} else if(strcmp(argv[i], "--save") == 0 && i + 1 < argc) {
+			saveFile = argv[++i];
+		} else if(strcmp(argv[i], "--checkpoint") == 0 && i + 1 < argc) {
+			checkpoint = strtoull(argv[++i], nullptr, 10);
+		} else if(strcmp(argv[i], "--gdb") == 0 && i + 1 < argc && DEBUGGER_ENABLED) {
+			gdbAddress = argv[++i];
+		} else if(strcmp(argv[i], "--watch") == 0 && i + 1 < argc && DEBUGGER_ENABLED) {
+			char *end;
+			unsigned long address = strtoul(argv[++i], &end, 16);
+			uint8_t mode = strcmp(end, ":r") == 0 ? WATCH_READ : strcmp(end, ":rw") == 0 ? WATCH_READ | WATCH_WRITE : WATCH_WRITE;
+			if(address >= RAM_SIZE || end == argv[i] || (*end && strcmp(end, ":r") && strcmp(end, ":w") && strcmp(end, ":rw"))) {
+				usage();
+				return 1;
+			}
+			addWatchpoint(watchpoints, address, mode);
+		} else if(strcmp(argv[i], "--screenshot") == 0 && i + 1 < argc) {
+			screenshotFile = argv[++i];
+		} else if(strcmp(argv[i], "--stats") == 0) {
+			stats = true;
+		} else if(strcmp(argv[i], "--coverage") == 0 && i + 1 < argc) {
+			coverageFile = argv[++i];
+		} else if(strcmp(argv[i], "--monitor") == 0 && i + 1 < argc) {
+			monitorName = argv[++i];
+		} else if(strcmp(argv[i], "--monitor-ram") == 0 && i + 1 < argc) {
+			char *end;
+			monitorStart = strtoul(argv[++i], &end, 16);
+			monitorLength = *end == ':' ? strtoul(end + 1, &end, 16) : 0;
+			if(*end || monitorLength == 0 || monitorStart + monitorLength > RAM_SIZE) {
+				usage();
+				return 1;
+			}
+		} else if(strcmp(argv[i], "--run-ahead") == 0 && i + 1 < argc && atoi(argv[i + 1]) >= 1 &&
+		          atoi(argv[i + 1]) <= 8) {
+			runAheadFrames = atoi(argv[++i]);
+		} else if(strcmp(argv[i], "--cpm") == 0 && i + 1 < argc) {
+			comFile = argv[++i];
+		} else {
+			usage();
+			return 1;
+		}
+	}
+
+	if(!comFile.empty()) {
+		return runCom(comFile, stats, coverageFile);
+	}
+	if(warm && !loadFile.empty()) {
+		usage();
+		return 1;
+	}
+
+	Machine machine;
+	unique_ptr<CPU> &cpu = machine.cpu;
+#ifdef EMBEDDED_ROM
+	std::memcpy(cpu->RAM, INVADERS_ROM, sizeof(INVADERS_ROM));
+#else
+	loadRom("invaders.h", cpu, 0x0000);
+	loadRom("invaders.g", cpu, 0x0800);
+	loadRom("invaders.f", cpu, 0x1000);
+	loadRom("invaders.e", cpu, 0x1800);
+#endif
+	if(warm) { // Before the sound starts, which would otherwise get all of it at once
+		std::string fileName = warmStartFile(machine, warmPoint, cacheDirectory);
+		std::string reason;
+		switch(warmStart(machine, warmPoint, cacheDirectory, reason)) {
+			case WarmStartResult::Loaded:
+				std::cerr << "Warm start from " << fileName << endl;
+				break;
+			case WarmStartResult::Saved:
+				std::cerr << "Warm start saved to " << fileName << endl;
+				break;
+			case WarmStartResult::NotSaved:
+				std::cerr << "Warning: warm start not saved to " << fileName << ": " << reason << endl;
+				break;
+		}
+	}
+
+	Audio audio;
+	if(!audioFile.empty()) {
+		startAudio(audio, audioFile, audioFormat);
+		machine.audio = &audio;
+	}
+	if(!loadFile.empty()) {
+		loadState(machine, loadFile);
+	}
+	machine.watchpoints = &watchpoints;
+	Debugger debugger;
+	debugger.watchpoints = &watchpoints;
+	if(!gdbAddress.empty()) {
+		startDebugger(debugger, gdbAddress);
+		machine.debugger = &debugger;
+	}
+	Video video;
+	if(!screenshotFile.empty()) {
+		startVideo(video);
+	}
+	Capture capture;
+	if(!captureFile.empty()) {
+		startCapture(capture, captureFile, captureFormat);
+	}
+	Monitor monitor;
+	if(!monitorName.empty()) {
+		startMonitor(monitor, monitorName, monitorStart, monitorLength);
+	}
+	StateWriter writer;
+	if(!saveFile.empty() && checkpoint) {
+		startStateWriter(writer);
+	}
+
+	RunAhead ahead;
+	const uint8_t *screen = runAheadFrames ? ahead.vram.data() : cpu->RAM + VRAM_START;
+	bool done = false;
+	Pacer pacer;
+	startPacing(pacer, mode, multiplier, machine.cycles);
+
+	cout << std::hex;
+	while(!done) {
+		/*cout << "A: " << static_cast<int>(cpu->A) << " B: " << static_cast<int>(cpu->B) << " C: " << static_cast<int>(cpu->C) 
+		     << " D: " << static_cast<int>(cpu->D) << " E: " << static_cast<int>(cpu->E) << " H: " << static_cast<int>(cpu->H) 
+		     << " L: " << static_cast<int>(cpu->L) << " PC: " << static_cast<int>(cpu->PC) << " SP: " << static_cast<int>(cpu->SP)
+		     << " Next OP Code: " << static_cast<int>(cpu->RAM[cpu->PC]) << endl << endl;
+		done = emulate8080OpCode(cpu);*/
+		/*printf("CUR_OP %04x %04x ", cpu->RAM[cpu->PC], cpu->RAM[cpu->PC + 1]);
+		done = emulate8080OpCode(cpu);
+		printf("%c", getFlag(cpu->f, FLAG_Z) ? 'z' : '.');
+		printf("%c", getFlag(cpu->f, FLAG_S) ? 's' : '.');
+		printf("%c", getFlag(cpu->f, FLAG_P) ? 'p' : '.');
+		printf("%c", getFlag(cpu->f, FLAG_CY) ? 'c' : '.');
+		printf("%c  ", getFlag(cpu->f, FLAG_AC) ? 'a' : '.');
+		printf("A %02x B %02x C %02x D %02x E %02x H %02x L %02x SP %04x END_PC %04x\n\n", cpu->A, cpu->B, cpu->C,
+					cpu->D, cpu->E, cpu->H, cpu->L, cpu->SP, cpu->PC);*/
+
+		done = !runFrame(machine); // Ends at vblank
+		if(machine.audio) {
+			generateAudio(audio, machine.cycles);
+		}
+		if(runAheadFrames) {
+			runAhead(machine, ahead, runAheadFrames * (uint64_t) FRAME_CYCLES);
+		}
+		if(video.running) {
+			publishFrame(video, screen);
+		}
+		if(capture.fd >= 0 && !captureFrame(capture, screen)) {
+			done = true; // Nothing is reading the video any more
+		}
+		waitForFrame(pacer, machine.cycles);
+		publishMonitor(monitor, machine, pacer.stats.frames);
+		done = done || pacer.stats.frames == frames;
+		if(!saveFile.empty() && checkpoint && pacer.stats.frames % checkpoint == 0) {
+			queueSave(writer, machine, saveFile);
+		}
+	}
+	stopMonitor(monitor);
+	stopStateWriter(writer);
+	if(!saveFile.empty()) {
+		saveState(machine, saveFile);
+	}
+	stopAudio(audio);
+	stopVideo(video);
+	stopCapture(capture);
+	if(!screenshotFile.empty()) {
+		saveScreenshot(video, screenshotFile);
+	}
+	closeDebugger(debugger);
+	std::ostream &report = captureFile == "-" ? std::cerr : cout; // Stdout may be the video
+	printPacingStats(pacer, report);
+	printRunAheadStats(ahead, report);
+	if(stats) {
+		printCounters(snapshotCounters(), report);
+	}
+	if(!coverageFile.empty()) {
+		writeCoverage(coverageFile, report);
+	}
+	if(audio.dropped) {
+		report << std::dec << audio.dropped << " sound events dropped" << endl;
+	}
+	if(!captureFile.empty()) {
+		report << std::dec << capture.frames << " video frames written, " << capture.frames - capture.converted
+		       << " of them repeats" << endl;
+	}
+
+	return 0;
+}
@@ -0,0 +1,98 @@
+#include "monitor.h"
+
+#include <cstring>
+#include <fcntl.h>
+#include <new>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <unistd.h>
+
+const double RATE_SECONDS = 1.0; // Between updates of the rates
+
+void startMonitor(Monitor &monitor, const std::string &name, uint16_t start, uint32_t length) {
+	if(name.empty() || name.find('/') != std::string::npos || length == 0 || start + length > RAM_SIZE) {
+		throw std::runtime_error("Invalid monitor name or RAM range!");
+	}
+	std::string path = "/" + name;
+	int fd = shm_open(path.c_str(), O_RDWR | O_CREAT, 0644);
+	if(fd < 0) {
+		throw std::runtime_error("Could not create the shared memory segment!");
+	}
+	std::size_t size = MONITOR_HEADER_SIZE + length;
+	void *mapping = MAP_FAILED;
+	if(ftruncate(fd, 0) == 0 && ftruncate(fd, size) == 0) { // Zeroes a segment left behind by a crash
+		mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	}
+	close(fd);
+	if(mapping == MAP_FAILED) {
+		shm_unlink(path.c_str());
+		throw std::runtime_error("Could not map the shared memory segment!");
+	}
+
+	MonitorBlock *block = static_cast<MonitorBlock *>(mapping);
+	new(&block->sequence) std::atomic<uint32_t>(0);
+	block->version = MONITOR_VERSION;
+	block->ramStart = start;
+	block->ramLength = length;
+	std::atomic_thread_fence(std::memory_order_release);
+	block->magic = MONITOR_MAGIC; // Last, so a reader seeing it sees the rest of the header
+	monitor.name = path;
+	monitor.block = block;
+	monitor.size = size;
+	monitor.sampled = std::chrono::steady_clock::time_point();
+}
+
+void publishMonitor(Monitor &monitor, const Machine &machine, uint64_t frame) {
+	MonitorBlock *block = monitor.block;
+	if(!block) {
+		return;
+	}
+	auto now = std::chrono::steady_clock::now();
+	if(monitor.sampled == std::chrono::steady_clock::time_point()) { // The rates start from the first frame
+		monitor.sampled = now;
+		monitor.sampledCycles = machine.cycles;
+		monitor.sampledFrame = frame;
+	}
+	double seconds = std::chrono::duration<double>(now - monitor.sampled).count();
+	bool sample = seconds >= RATE_SECONDS;
+
+	const CPU &cpu = *machine.cpu;
+	uint32_t sequence = block->sequence.load(std::memory_order_relaxed);
+	block->sequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release); // The odd sequence goes out before any of the data
+	block->frame = frame;
+	block->cycles = machine.cycles;
+	block->idleCycles = machine.idleCycles;
+	if(sample) {
+		block->mhz = (machine.cycles - monitor.sampledCycles) / seconds / 1e6;
+		block->fps = (frame - monitor.sampledFrame) / seconds;
+	}
+	block->PC = cpu.PC;
+	block->SP = cpu.SP;
+	block->BC = cpu.BC;
+	block->DE = cpu.DE;
+	block->HL = cpu.HL;
+	block->A = cpu.A;
+	block->flags = getFlags(cpu.f);
+	block->intEnable = cpu.int_enable;
+	block->halted = cpu.halted;
+	block->inputs = machine.inputs;
+	std::memcpy(block->ram, cpu.RAM + block->ramStart, block->ramLength);
+	block->sequence.store(sequence + 2, std::memory_order_release);
+
+	if(sample) {
+		monitor.sampled = now;
+		monitor.sampledCycles = machine.cycles;
+		monitor.sampledFrame = frame;
+	}
+}
+
+void stopMonitor(Monitor &monitor) {
+	if(!monitor.block) {
+		return;
+	}
+	munmap(monitor.block, monitor.size);
+	shm_unlink(monitor.name.c_str());
+	monitor.block = nullptr;
+	monitor.name.clear();
+}
@@ -0,0 +1,76 @@
+#ifndef MONITOR_H
+#define MONITOR_H
+
+#include "machine.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Live machine state published once a frame into a POSIX shared memory segment
+// (/dev/shm/NAME on Linux), for dashboards and other processes to sample without stopping the
+// emulator or talking to it. Every number is little endian (the host's order).
+//
+//   0  uint32   magic, "8MON"
+//   4  uint16   version
+//   6  uint16   first address of the RAM copy
+//   8  uint32   length of the RAM copy
+//  12  uint32   sequence
+//  16  uint64   frame, cycles, idle cycles
+//  40  double   emulated MHz and frames per second, over about the last second
+//  56  uint16   PC SP BC DE HL
+//  66  uint8    A, PSW flags byte, int_enable, halted, inputs, 0
+//  72  uint8[]  the RAM copy
+//
+// Everything from 16 on is guarded by the sequence, a seqlock: it's odd while the emulator is
+// writing. Readers take the sequence, copy what they want, then take it again, and use the copy
+// if both were the same even number, otherwise they try again. The emulator never waits for
+// them. Bytes 0 to 11 never change once the segment is there.
+const uint32_t MONITOR_MAGIC = 0x4e4f4d38;
+const uint16_t MONITOR_VERSION = 1;
+const std::size_t MONITOR_HEADER_SIZE = 72;
+const uint16_t MONITOR_DEFAULT_START = 0x2000; // Space Invaders' variables
+const uint32_t MONITOR_DEFAULT_LENGTH = 0x0400;
+
+struct MonitorBlock {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t ramStart;
+	uint32_t ramLength;
+	std::atomic<uint32_t> sequence;
+	uint64_t frame;
+	uint64_t cycles;
+	uint64_t idleCycles;
+	double mhz;
+	double fps;
+	uint16_t PC, SP, BC, DE, HL;
+	uint8_t A, flags, intEnable, halted, inputs, unused;
+	uint8_t ram[1]; // ramLength of them
+};
+
+static_assert(offsetof(MonitorBlock, sequence) == 12 && offsetof(MonitorBlock, mhz) == 40 &&
+              offsetof(MonitorBlock, PC) == 56 && offsetof(MonitorBlock, A) == 66 &&
+              offsetof(MonitorBlock, ram) == MONITOR_HEADER_SIZE, "Monitor layout differs from monitor.h");
+static_assert(ATOMIC_INT_LOCK_FREE == 2, "The sequence has to be usable across processes");
+
+struct Monitor {
+	std::string name; // Empty when not started
+	MonitorBlock *block = nullptr;
+	std::size_t size = 0;
+	// For the rates
+	std::chrono::steady_clock::time_point sampled;
+	uint64_t sampledCycles = 0;
+	uint64_t sampledFrame = 0;
+};
+
+// Creates (or takes over) the segment /name for a copy of length bytes of RAM from start
+void startMonitor(Monitor &monitor, const std::string &name, uint16_t start, uint32_t length);
+// Called by the emulation thread after each frame. Copies the state in without allocating,
+// locking or waiting.
+void publishMonitor(Monitor &monitor, const Machine &machine, uint64_t frame);
+// Unmaps and removes the segment. Readers that have it mapped keep their last view.
+void stopMonitor(Monitor &monitor);
+
+#endif
@@ -0,0 +1,52 @@
+import mmap
+import os
+import struct
+import sys
+import time
+
+# python3 monitor.py NAME [INTERVAL] prints what emulator --monitor NAME publishes (monitor.h
+# has the layout) every INTERVAL seconds, 1 by default, until the emulator stops. Nothing it
+# does slows the emulator down.
+MONITOR_MAGIC = 0x4e4f4d38
+MONITOR_VERSION = 1
+HEADER = struct.Struct("<IHHII")
+STATE = struct.Struct("<QQQddHHHHHBBBBBx")
+HEADER_SIZE = 72
+
+
+def sample(segment, ramLength):
+	while True:
+		before = HEADER.unpack_from(segment)[4]
+		if before & 1:
+			continue
+		state = STATE.unpack_from(segment, HEADER.size)
+		ram = segment[HEADER_SIZE:HEADER_SIZE + ramLength]
+		if HEADER.unpack_from(segment)[4] == before:
+			return state, ram
+
+
+name = sys.argv[1] if len(sys.argv) > 1 else "i8080"
+interval = float(sys.argv[2]) if len(sys.argv) > 2 else 1.0
+path = "/dev/shm/" + name
+try:
+	fd = os.open(path, os.O_RDONLY)
+except OSError:
+	print("No segment", path + "!")
+	sys.exit(1)
+segment = mmap.mmap(fd, os.fstat(fd).st_size, prot=mmap.PROT_READ)
+os.close(fd)
+magic, version, ramStart, ramLength, _ = HEADER.unpack_from(segment)
+if magic != MONITOR_MAGIC or version != MONITOR_VERSION or len(segment) < HEADER_SIZE + ramLength:
+	print(path, "is not a monitor segment!")
+	sys.exit(1)
+
+while os.path.exists(path):
+	(frame, cycles, idle, mhz, fps, pc, sp, bc, de, hl, a, flags, intEnable, halted, inputs), ram = \
+		sample(segment, ramLength)
+	print("frame %d  %.2f MHz  %.1f fps  cycles %d (%d idle)" % (frame, mhz, fps, cycles, idle))
+	print("  PC %04x SP %04x A %02x BC %04x DE %04x HL %04x flags %02x%s%s  inputs %02x" %
+	      (pc, sp, a, bc, de, hl, flags, " EI" if intEnable else "", " HLT" if halted else "", inputs))
+	for offset in range(0, min(ramLength, 64), 16):
+		print("  %04x  %s" % (ramStart + offset, ram[offset:offset + 16].hex(" ")))
+	sys.stdout.flush()
+	time.sleep(interval)
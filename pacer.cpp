@@ -0,0 +1,78 @@
+#include "pacer.h"
+#include "machine.h"
+
+#include <thread>
+
+using std::chrono::nanoseconds;
+using std::chrono::steady_clock;
+
+// sleep_until() wakes up late by up to a scheduler tick, so it's told to wake this much early
+// and the rest is spun away
+const nanoseconds SPIN = std::chrono::microseconds(200);
+// Further behind than this and the lost time is given up instead of being caught up in a burst
+const nanoseconds MAX_LAG = std::chrono::milliseconds(100);
+
+void startPacing(Pacer &pacer, PacingMode mode, double multiplier, uint64_t cycles) {
+	pacer.mode = mode;
+	pacer.multiplier = mode == PacingMode::Multiplier ? multiplier : 1.0;
+	pacer.start = steady_clock::now();
+	pacer.startCycles = cycles;
+	pacer.stats = PacingStats();
+}
+
+static void recordJitter(PacingStats &stats, nanoseconds jitter) {
+	int bucket = 0;
+	while(bucket < JITTER_BUCKETS - 1 && jitter > std::chrono::microseconds(JITTER_BUCKET_US[bucket])) {
+		bucket++;
+	}
+	stats.jitter[bucket]++;
+	if(jitter > stats.worstJitter) {
+		stats.worstJitter = jitter;
+	}
+}
+
+void waitForFrame(Pacer &pacer, uint64_t cycles) {
+	PacingStats &stats = pacer.stats;
+	stats.frames++;
+	if(pacer.mode == PacingMode::Turbo) {
+		return;
+	}
+
+	double seconds = (cycles - pacer.startCycles) / (double) CPU_HZ / pacer.multiplier;
+	steady_clock::time_point deadline = pacer.start + std::chrono::duration_cast<nanoseconds>(std::chrono::duration<double>(seconds));
+	steady_clock::time_point now = steady_clock::now();
+	if(now >= deadline) {
+		stats.lateFrames++;
+		recordJitter(stats, now - deadline);
+		if(now - deadline > MAX_LAG) {
+			pacer.start = now; // Carry on from here rather than racing to catch up
+			pacer.startCycles = cycles;
+			stats.resyncs++;
+		}
+		return;
+	}
+
+	steady_clock::time_point waitStart = now;
+	if(deadline - now > SPIN) {
+		std::this_thread::sleep_until(deadline - SPIN);
+	}
+	while((now = steady_clock::now()) < deadline) {
+	}
+	recordJitter(stats, now - deadline);
+	stats.sleeping += now - waitStart;
+}
+
+void printPacingStats(const Pacer &pacer, std::ostream &out) {
+	const PacingStats &stats = pacer.stats;
+	out << std::dec << stats.frames << " frames, " << stats.lateFrames << " late, " << stats.resyncs << " resyncs, "
+	    << std::chrono::duration_cast<std::chrono::milliseconds>(stats.sleeping).count() << " ms waiting, worst jitter "
+	    << std::chrono::duration_cast<std::chrono::microseconds>(stats.worstJitter).count() << " us" << std::endl;
+	for(int i = 0; i < JITTER_BUCKETS; i++) {
+		if(i < JITTER_BUCKETS - 1) {
+			out << "  <= " << JITTER_BUCKET_US[i] << " us: ";
+		} else {
+			out << "   > " << JITTER_BUCKET_US[i - 1] << " us: ";
+		}
+		out << stats.jitter[i] << std::endl;
+	}
+}
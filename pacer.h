@@ -0,0 +1,41 @@
+#ifndef PACER_H
+#define PACER_H
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+enum class PacingMode {
+	RealTime, // 60 Hz, like the arcade machine
+	Turbo, // As fast as the host allows
+	Multiplier // A fixed multiple of real time
+};
+
+// Upper bounds of the jitter histogram buckets in microseconds; the last bucket is open ended
+const int JITTER_BUCKET_US[] = {50, 100, 250, 500, 1000, 2000, 4000, 8000};
+const int JITTER_BUCKETS = sizeof(JITTER_BUCKET_US) / sizeof(JITTER_BUCKET_US[0]) + 1;
+
+struct PacingStats {
+	uint64_t frames = 0;
+	uint64_t lateFrames = 0; // Emulation finished after the frame was due
+	uint64_t resyncs = 0; // Fell so far behind that the schedule was restarted
+	uint64_t jitter[JITTER_BUCKETS] = {}; // How long after its deadline each frame was released
+	std::chrono::nanoseconds worstJitter{0};
+	std::chrono::nanoseconds sleeping{0};
+};
+
+struct Pacer {
+	PacingMode mode = PacingMode::RealTime;
+	double multiplier = 1.0;
+	std::chrono::steady_clock::time_point start;
+	uint64_t startCycles = 0;
+	PacingStats stats;
+};
+
+void startPacing(Pacer &pacer, PacingMode mode, double multiplier, uint64_t cycles);
+// Blocks until the emulated time reached by cycles is due in wall time. Deadlines are absolute
+// (start plus emulated time) so rounding and oversleeping never accumulate into drift.
+void waitForFrame(Pacer &pacer, uint64_t cycles);
+void printPacingStats(const Pacer &pacer, std::ostream &out);
+
+#endif
@@ -0,0 +1,651 @@
+/* Python bindings for lib8080, built as the i8080 module:
+ *
+ *   import i8080
+ *   machine = i8080.Machine()
+ *   machine.load(open("invaders", "rb").read())
+ *   machine.run(2000000)          # The GIL is released while it runs
+ *   machine.ram[0x20c0]           # memoryview of RAM, no copies
+ *   machine.render()
+ *   machine.framebuffer           # memoryview of the RGBA screen, 256 x 224 x 4
+ *
+ *   games = i8080.VecEnv(open("invaders", "rb").read(), 64)
+ *   games.step(bytes([i8080.ACTION_FIRE] * 64))   # Every game a frame, in parallel
+ *   games.pixels, games.rewards, games.dones       # Views of the observations
+ *
+ * Everything goes through the C interface in lib8080.h. Views keep their machine alive, and
+ * numpy.asarray() on one shares the memory too. */
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <pythread.h>
+
+#include <stddef.h>
+#include <string.h>
+
+#include "lib8080.h"
+
+#define RAM_BYTES 0x10000
+#define FRAMEBUFFER_BYTES (LIB8080_SCREEN_WIDTH * LIB8080_SCREEN_HEIGHT * 4)
+
+typedef struct {
+	PyObject_HEAD
+	lib8080_machine *machine;
+	uint8_t *framebuffer; /* What render() last drew */
+	PyObject *in; /* I/O handlers, or NULL */
+	PyObject *out;
+	/* The first exception a handler raised during run(), raised again once it returns */
+	PyObject *errorType;
+	PyObject *errorValue;
+	PyObject *errorTraceback;
+	int running;
+	unsigned long runner; /* Thread running it */
+} MachineObject;
+
+/* Memory owned by a Machine or VecEnv, exported through the buffer protocol */
+typedef struct {
+	PyObject_HEAD
+	PyObject *owner;
+	void *data;
+	const char *format; /* struct module style, "B" or "i" */
+	Py_ssize_t itemsize;
+	int ndim;
+	Py_ssize_t shape[3];
+	Py_ssize_t strides[3];
+	int readonly;
+} ViewObject;
+
+static PyTypeObject ViewType;
+
+static int View_getbuffer(ViewObject *self, Py_buffer *view, int flags) {
+	Py_ssize_t length = self->itemsize;
+	int i;
+	if((flags & PyBUF_WRITABLE) && self->readonly) {
+		PyErr_SetString(PyExc_BufferError, "View is read only");
+		return -1;
+	}
+	for(i = 0; i < self->ndim; i++) {
+		length *= self->shape[i];
+	}
+	view->buf = self->data;
+	view->obj = (PyObject *) self;
+	Py_INCREF(self);
+	view->len = length;
+	view->readonly = self->readonly;
+	view->itemsize = self->itemsize;
+	view->format = (flags & PyBUF_FORMAT) ? (char *) self->format : NULL;
+	view->ndim = (flags & PyBUF_ND) ? self->ndim : 1;
+	view->shape = (flags & PyBUF_ND) ? self->shape : NULL;
+	view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? self->strides : NULL;
+	view->suboffsets = NULL;
+	view->internal = NULL;
+	return 0;
+}
+
+static void View_dealloc(ViewObject *self) {
+	Py_XDECREF(self->owner);
+	Py_TYPE(self)->tp_free((PyObject *) self);
+}
+
+static PyBufferProcs View_buffer = {(getbufferproc) View_getbuffer, NULL};
+
+static PyTypeObject ViewType = {
+	PyVarObject_HEAD_INIT(NULL, 0)
+	.tp_name = "i8080.View",
+	.tp_basicsize = sizeof(ViewObject),
+	.tp_dealloc = (destructor) View_dealloc,
+	.tp_as_buffer = &View_buffer,
+	.tp_flags = Py_TPFLAGS_DEFAULT,
+	.tp_doc = "Memory of a Machine or VecEnv, for memoryview() and numpy.asarray()",
+};
+
+/* A memoryview of shape[0] x ... items, laid out one after another */
+static PyObject *newView(PyObject *owner, void *data, const char *format, Py_ssize_t itemsize, int ndim,
+                         const Py_ssize_t *shape, int readonly) {
+	PyObject *memoryview;
+	Py_ssize_t stride = itemsize;
+	int i;
+	ViewObject *view = PyObject_New(ViewObject, &ViewType);
+	if(!view) {
+		return NULL;
+	}
+	Py_INCREF(owner);
+	view->owner = owner;
+	view->data = data;
+	view->format = format;
+	view->itemsize = itemsize;
+	view->ndim = ndim;
+	view->readonly = readonly;
+	for(i = ndim - 1; i >= 0; i--) {
+		view->shape[i] = shape[i];
+		view->strides[i] = stride;
+		stride *= shape[i];
+	}
+	memoryview = PyMemoryView_FromObject((PyObject *) view);
+	Py_DECREF(view);
+	return memoryview;
+}
+
+/* Sets an exception if another thread is in run(), since the machine isn't locked */
+static int busy(MachineObject *self) {
+	if(self->running && self->runner != PyThread_get_thread_ident()) {
+		PyErr_SetString(PyExc_RuntimeError, "Machine is running in another thread");
+		return 1;
+	}
+	return 0;
+}
+
+/* Keeps a handler's exception for run() to raise */
+static void handlerFailed(MachineObject *self) {
+	if(!self->errorType) {
+		PyErr_Fetch(&self->errorType, &self->errorValue, &self->errorTraceback);
+	} else {
+		PyErr_Clear();
+	}
+}
+
+static uint8_t pythonIn(void *context, uint8_t port) {
+	MachineObject *self = (MachineObject *) context;
+	PyGILState_STATE gil = PyGILState_Ensure();
+	uint8_t value = 0;
+	if(!self->errorType) { /* Once one has failed the rest of the run is ignored */
+		PyObject *handler = self->in; /* Held in case it replaces itself */
+		PyObject *result;
+		long number;
+		Py_INCREF(handler);
+		result = PyObject_CallFunction(handler, "i", port);
+		number = result ? PyLong_AsLong(result) : -1;
+		if(PyErr_Occurred()) {
+			handlerFailed(self);
+		} else {
+			value = (uint8_t) number;
+		}
+		Py_XDECREF(result);
+		Py_DECREF(handler);
+	}
+	PyGILState_Release(gil);
+	return value;
+}
+
+static void pythonOut(void *context, uint8_t port, uint8_t value) {
+	MachineObject *self = (MachineObject *) context;
+	PyGILState_STATE gil = PyGILState_Ensure();
+	if(!self->errorType) {
+		PyObject *handler = self->out;
+		PyObject *result;
+		Py_INCREF(handler);
+		result = PyObject_CallFunction(handler, "ii", port, value);
+		if(!result) {
+			handlerFailed(self);
+		}
+		Py_XDECREF(result);
+		Py_DECREF(handler);
+	}
+	PyGILState_Release(gil);
+}
+
+static PyObject *Machine_new(PyTypeObject *type, PyObject *args, PyObject *kwargs) {
+	MachineObject *self;
+	if(!PyArg_ParseTuple(args, ":Machine") || (kwargs && PyDict_Size(kwargs))) {
+		PyErr_SetString(PyExc_TypeError, "Machine() takes no arguments");
+		return NULL;
+	}
+	self = (MachineObject *) type->tp_alloc(type, 0);
+	if(!self) {
+		return NULL;
+	}
+	self->machine = lib8080_create();
+	self->framebuffer = PyMem_Calloc(FRAMEBUFFER_BYTES, 1);
+	if(!self->machine || !self->framebuffer) {
+		Py_DECREF(self);
+		return PyErr_NoMemory();
+	}
+	return (PyObject *) self;
+}
+
+static int Machine_traverse(MachineObject *self, visitproc visit, void *arg) {
+	Py_VISIT(self->in);
+	Py_VISIT(self->out);
+	return 0;
+}
+
+static int Machine_clear(MachineObject *self) {
+	if(self->machine) {
+		lib8080_set_io(self->machine, NULL, NULL, NULL);
+	}
+	Py_CLEAR(self->in);
+	Py_CLEAR(self->out);
+	return 0;
+}
+
+static void Machine_dealloc(MachineObject *self) {
+	PyObject_GC_UnTrack(self);
+	Machine_clear(self);
+	Py_XDECREF(self->errorType);
+	Py_XDECREF(self->errorValue);
+	Py_XDECREF(self->errorTraceback);
+	lib8080_destroy(self->machine);
+	PyMem_Free(self->framebuffer);
+	Py_TYPE(self)->tp_free((PyObject *) self);
+}
+
+static PyObject *Machine_load(MachineObject *self, PyObject *args, PyObject *kwargs) {
+	static char *keywords[] = {"data", "address", NULL};
+	Py_buffer data;
+	unsigned int address = 0;
+	lib8080_status status;
+	if(busy(self) || !PyArg_ParseTupleAndKeywords(args, kwargs, "y*|I:load", keywords, &data, &address)) {
+		return NULL;
+	}
+	status = address > 0xffff ? LIB8080_INVALID_ARGUMENT : lib8080_load_rom(self->machine, data.buf, data.len, (uint16_t) address);
+	PyBuffer_Release(&data);
+	if(status != LIB8080_OK) {
+		PyErr_SetString(PyExc_ValueError, "ROM doesn't fit in memory");
+		return NULL;
+	}
+	Py_RETURN_NONE;
+}
+
+static PyObject *Machine_run(MachineObject *self, PyObject *argument) {
+	unsigned long long cycles = PyLong_AsUnsignedLongLong(argument);
+	uint64_t ran;
+	if(PyErr_Occurred()) {
+		return NULL;
+	}
+	if(self->running) {
+		PyErr_SetString(PyExc_RuntimeError, "Machine is already running");
+		return NULL;
+	}
+	self->running = 1;
+	self->runner = PyThread_get_thread_ident();
+	Py_BEGIN_ALLOW_THREADS
+	ran = lib8080_run(self->machine, cycles);
+	Py_END_ALLOW_THREADS
+	self->running = 0;
+	if(self->errorType) {
+		PyErr_Restore(self->errorType, self->errorValue, self->errorTraceback);
+		self->errorType = self->errorValue = self->errorTraceback = NULL;
+		return NULL;
+	}
+	return PyLong_FromUnsignedLongLong(ran);
+}
+
+static PyObject *Machine_render(MachineObject *self, PyObject *unused) {
+	if(busy(self)) {
+		return NULL;
+	}
+	lib8080_render(self->machine, self->framebuffer);
+	Py_RETURN_NONE;
+}
+
+static PyObject *Machine_set_io(MachineObject *self, PyObject *args, PyObject *kwargs) {
+	static char *keywords[] = {"input", "output", NULL};
+	PyObject *in = Py_None;
+	PyObject *out = Py_None;
+	if(busy(self) || !PyArg_ParseTupleAndKeywords(args, kwargs, "|OO:set_io", keywords, &in, &out)) {
+		return NULL;
+	}
+	if((in != Py_None && !PyCallable_Check(in)) || (out != Py_None && !PyCallable_Check(out))) {
+		PyErr_SetString(PyExc_TypeError, "Handlers must be callable or None");
+		return NULL;
+	}
+	Py_XINCREF(in == Py_None ? NULL : in);
+	Py_XINCREF(out == Py_None ? NULL : out);
+	Py_XSETREF(self->in, in == Py_None ? NULL : in);
+	Py_XSETREF(self->out, out == Py_None ? NULL : out);
+	lib8080_set_io(self->machine, self->in ? pythonIn : NULL, self->out ? pythonOut : NULL, self);
+	Py_RETURN_NONE;
+}
+
+static PyObject *Machine_set_inputs(MachineObject *self, PyObject *argument) {
+	long inputs = PyLong_AsLong(argument);
+	if(inputs == -1 && PyErr_Occurred()) {
+		return NULL;
+	}
+	if(inputs < 0 || inputs > 0xff) {
+		PyErr_SetString(PyExc_ValueError, "Expected 0 to 0xff");
+		return NULL;
+	}
+	if(busy(self)) {
+		return NULL;
+	}
+	lib8080_set_inputs(self->machine, (uint8_t) inputs);
+	Py_RETURN_NONE;
+}
+
+static PyObject *Machine_snapshot(MachineObject *self, PyObject *unused) {
+	PyObject *bytes;
+	size_t size = 0;
+	lib8080_status status;
+	if(busy(self)) {
+		return NULL;
+	}
+	bytes = PyBytes_FromStringAndSize(NULL, (Py_ssize_t) lib8080_snapshot_max_size());
+	if(!bytes) {
+		return NULL;
+	}
+	status = lib8080_snapshot(self->machine, PyBytes_AS_STRING(bytes), (size_t) PyBytes_GET_SIZE(bytes), &size);
+	if(status != LIB8080_OK) {
+		Py_DECREF(bytes);
+		return PyErr_NoMemory();
+	}
+	_PyBytes_Resize(&bytes, (Py_ssize_t) size);
+	return bytes;
+}
+
+static PyObject *Machine_restore(MachineObject *self, PyObject *args) {
+	Py_buffer data;
+	lib8080_status status;
+	if(busy(self) || !PyArg_ParseTuple(args, "y*:restore", &data)) {
+		return NULL;
+	}
+	status = lib8080_restore(self->machine, data.buf, (size_t) data.len);
+	PyBuffer_Release(&data);
+	if(status == LIB8080_OUT_OF_MEMORY) {
+		return PyErr_NoMemory();
+	}
+	if(status != LIB8080_OK) {
+		PyErr_SetString(PyExc_ValueError, "Not a valid snapshot");
+		return NULL;
+	}
+	Py_RETURN_NONE;
+}
+
+static PyObject *Machine_get_ram(MachineObject *self, void *closure) {
+	const Py_ssize_t shape[1] = {RAM_BYTES};
+	return newView((PyObject *) self, lib8080_memory(self->machine), "B", 1, 1, shape, 0);
+}
+
+static PyObject *Machine_get_framebuffer(MachineObject *self, void *closure) {
+	const Py_ssize_t shape[3] = {LIB8080_SCREEN_HEIGHT, LIB8080_SCREEN_WIDTH, 4};
+	return newView((PyObject *) self, self->framebuffer, "B", 1, 3, shape, 1);
+}
+
+static PyObject *Machine_get_cycles(MachineObject *self, void *closure) {
+	if(busy(self)) {
+		return NULL;
+	}
+	return PyLong_FromUnsignedLongLong(lib8080_cycles(self->machine));
+}
+
+/* The registers are properties; closure is the Register describing one */
+typedef struct {
+	size_t offset;
+	int wide; /* 16 bit */
+} Register;
+
+#define REGISTER(field, wide) {offsetof(lib8080_registers, field), wide}
+static const Register REGISTERS[] = {
+	REGISTER(a, 0), REGISTER(b, 0), REGISTER(c, 0), REGISTER(d, 0), REGISTER(e, 0), REGISTER(h, 0), REGISTER(l, 0),
+	REGISTER(flags, 0), REGISTER(sp, 1), REGISTER(pc, 1), REGISTER(int_enable, 0), REGISTER(halted, 0)
+};
+
+static PyObject *Machine_get_register(MachineObject *self, void *closure) {
+	const Register *reg = (const Register *) closure;
+	lib8080_registers registers;
+	const char *field = (const char *) &registers + reg->offset;
+	if(busy(self)) {
+		return NULL;
+	}
+	lib8080_get_registers(self->machine, &registers);
+	return PyLong_FromLong(reg->wide ? *(const uint16_t *) field : *(const uint8_t *) field);
+}
+
+static int Machine_set_register(MachineObject *self, PyObject *value, void *closure) {
+	const Register *reg = (const Register *) closure;
+	lib8080_registers registers;
+	char *field = (char *) &registers + reg->offset;
+	long number;
+	if(!value) {
+		PyErr_SetString(PyExc_AttributeError, "Registers can't be deleted");
+		return -1;
+	}
+	number = PyLong_AsLong(value);
+	if(number == -1 && PyErr_Occurred()) {
+		return -1;
+	}
+	if(number < 0 || number > (reg->wide ? 0xffff : 0xff)) {
+		PyErr_SetString(PyExc_ValueError, reg->wide ? "Expected 0 to 0xffff" : "Expected 0 to 0xff");
+		return -1;
+	}
+	if(busy(self)) {
+		return -1;
+	}
+	lib8080_get_registers(self->machine, &registers);
+	if(reg->wide) {
+		*(uint16_t *) field = (uint16_t) number;
+	} else {
+		*(uint8_t *) field = (uint8_t) number;
+	}
+	lib8080_set_registers(self->machine, &registers);
+	return 0;
+}
+
+#define REGISTER_PROPERTY(name, index) \
+	{name, (getter) Machine_get_register, (setter) Machine_set_register, NULL, (void *) &REGISTERS[index]}
+
+static PyGetSetDef Machine_getset[] = {
+	{"ram", (getter) Machine_get_ram, NULL, "All 64 KiB of memory, writable", NULL},
+	{"framebuffer", (getter) Machine_get_framebuffer, NULL, "RGBA screen drawn by render(), rows x columns x 4", NULL},
+	{"cycles", (getter) Machine_get_cycles, NULL, "Cycles since power on", NULL},
+	REGISTER_PROPERTY("a", 0), REGISTER_PROPERTY("b", 1), REGISTER_PROPERTY("c", 2), REGISTER_PROPERTY("d", 3),
+	REGISTER_PROPERTY("e", 4), REGISTER_PROPERTY("h", 5), REGISTER_PROPERTY("l", 6), REGISTER_PROPERTY("flags", 7),
+	REGISTER_PROPERTY("sp", 8), REGISTER_PROPERTY("pc", 9), REGISTER_PROPERTY("int_enable", 10),
+	REGISTER_PROPERTY("halted", 11),
+	{NULL}
+};
+
+static PyMethodDef Machine_methods[] = {
+	{"load", (PyCFunction) (void (*)(void)) Machine_load, METH_VARARGS | METH_KEYWORDS,
+	 "load(data, address=0)\nCopies a ROM into memory"},
+	{"run", (PyCFunction) Machine_run, METH_O,
+	 "run(cycles)\nRuns at least cycles cycles without holding the GIL, returns how many it ran"},
+	{"render", (PyCFunction) Machine_render, METH_NOARGS, "Draws video memory into framebuffer"},
+	{"set_io", (PyCFunction) (void (*)(void)) Machine_set_io, METH_VARARGS | METH_KEYWORDS,
+	 "set_io(input=None, output=None)\ninput(port) returns the byte IN reads, output(port, value) gets OUT writes.\n"
+	 "None leaves that direction to the board."},
+	{"set_inputs", (PyCFunction) Machine_set_inputs, METH_O, "set_inputs(buttons)\nPresses the INPUT_ buttons set in buttons"},
+	{"snapshot", (PyCFunction) Machine_snapshot, METH_NOARGS, "The whole machine state as bytes"},
+	{"restore", (PyCFunction) Machine_restore, METH_VARARGS, "restore(snapshot)\nGoes back to a snapshot or save state"},
+	{NULL}
+};
+
+static PyTypeObject MachineType = {
+	PyVarObject_HEAD_INIT(NULL, 0)
+	.tp_name = "i8080.Machine",
+	.tp_basicsize = sizeof(MachineObject),
+	.tp_dealloc = (destructor) Machine_dealloc,
+	.tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC,
+	.tp_doc = "Machine()\nA Space Invaders board: 8080, 64 KiB of RAM and 120 interrupts a second",
+	.tp_traverse = (traverseproc) Machine_traverse,
+	.tp_clear = (inquiry) Machine_clear,
+	.tp_methods = Machine_methods,
+	.tp_getset = Machine_getset,
+	.tp_new = Machine_new,
+};
+
+typedef struct {
+	PyObject_HEAD
+	lib8080_vecenv *env;
+	lib8080_observations observations;
+	int count;
+	int stepping;
+} VecEnvObject;
+
+static PyObject *VecEnv_new(PyTypeObject *type, PyObject *args, PyObject *kwargs) {
+	static char *keywords[] = {"rom", "count", "threads", NULL};
+	Py_buffer rom;
+	int count;
+	int threads = 0;
+	VecEnvObject *self;
+	if(!PyArg_ParseTupleAndKeywords(args, kwargs, "y*i|i:VecEnv", keywords, &rom, &count, &threads)) {
+		return NULL;
+	}
+	if(count <= 0) {
+		PyBuffer_Release(&rom);
+		PyErr_SetString(PyExc_ValueError, "count must be positive");
+		return NULL;
+	}
+	self = (VecEnvObject *) type->tp_alloc(type, 0);
+	if(!self) {
+		PyBuffer_Release(&rom);
+		return NULL;
+	}
+	Py_BEGIN_ALLOW_THREADS
+	self->env = lib8080_vecenv_create(rom.buf, (size_t) rom.len, count, threads);
+	Py_END_ALLOW_THREADS
+	PyBuffer_Release(&rom);
+	if(!self->env) {
+		Py_DECREF(self);
+		PyErr_SetString(PyExc_ValueError, "ROM didn't start a game");
+		return NULL;
+	}
+	self->count = count;
+	lib8080_vecenv_observations(self->env, &self->observations);
+	return (PyObject *) self;
+}
+
+static void VecEnv_dealloc(VecEnvObject *self) {
+	lib8080_vecenv_destroy(self->env);
+	Py_TYPE(self)->tp_free((PyObject *) self);
+}
+
+/* Runs a step or a reset without the GIL, or fails if another thread is already in one */
+static PyObject *runVecEnv(VecEnvObject *self, const uint8_t *actions) {
+	if(self->stepping) {
+		PyErr_SetString(PyExc_RuntimeError, "VecEnv is stepping in another thread");
+		return NULL;
+	}
+	self->stepping = 1;
+	Py_BEGIN_ALLOW_THREADS
+	if(actions) {
+		lib8080_vecenv_step(self->env, actions);
+	} else {
+		lib8080_vecenv_reset(self->env);
+	}
+	Py_END_ALLOW_THREADS
+	self->stepping = 0;
+	Py_RETURN_NONE;
+}
+
+static PyObject *VecEnv_step(VecEnvObject *self, PyObject *args) {
+	Py_buffer actions;
+	PyObject *result;
+	if(!PyArg_ParseTuple(args, "y*:step", &actions)) {
+		return NULL;
+	}
+	if(actions.len != self->count) {
+		PyBuffer_Release(&actions);
+		PyErr_SetString(PyExc_ValueError, "Expected one action per game");
+		return NULL;
+	}
+	result = runVecEnv(self, (const uint8_t *) actions.buf);
+	PyBuffer_Release(&actions);
+	return result;
+}
+
+static PyObject *VecEnv_reset(VecEnvObject *self, PyObject *unused) {
+	return runVecEnv(self, NULL);
+}
+
+static PyObject *VecEnv_get_pixels(VecEnvObject *self, void *closure) {
+	const Py_ssize_t shape[3] = {self->count, LIB8080_OBSERVATION_HEIGHT, LIB8080_OBSERVATION_WIDTH};
+	return newView((PyObject *) self, (void *) self->observations.pixels, "B", 1, 3, shape, 1);
+}
+
+static PyObject *VecEnv_get_scores(VecEnvObject *self, void *closure) {
+	const Py_ssize_t shape[1] = {self->count};
+	return newView((PyObject *) self, (void *) self->observations.scores, "i", sizeof(int32_t), 1, shape, 1);
+}
+
+static PyObject *VecEnv_get_rewards(VecEnvObject *self, void *closure) {
+	const Py_ssize_t shape[1] = {self->count};
+	return newView((PyObject *) self, (void *) self->observations.rewards, "i", sizeof(int32_t), 1, shape, 1);
+}
+
+static PyObject *VecEnv_get_lives(VecEnvObject *self, void *closure) {
+	const Py_ssize_t shape[1] = {self->count};
+	return newView((PyObject *) self, (void *) self->observations.lives, "B", 1, 1, shape, 1);
+}
+
+static PyObject *VecEnv_get_dones(VecEnvObject *self, void *closure) {
+	const Py_ssize_t shape[1] = {self->count};
+	return newView((PyObject *) self, (void *) self->observations.dones, "B", 1, 1, shape, 1);
+}
+
+static Py_ssize_t VecEnv_length(VecEnvObject *self) {
+	return self->count;
+}
+
+static PyGetSetDef VecEnv_getset[] = {
+	{"pixels", (getter) VecEnv_get_pixels, NULL, "Games x OBSERVATION_HEIGHT x OBSERVATION_WIDTH, 0 to 255", NULL},
+	{"scores", (getter) VecEnv_get_scores, NULL, "Player 1's score in each game", NULL},
+	{"rewards", (getter) VecEnv_get_rewards, NULL, "Points scored in the last step", NULL},
+	{"lives", (getter) VecEnv_get_lives, NULL, "Spare ships", NULL},
+	{"dones", (getter) VecEnv_get_dones, NULL, "Games that ended in the last step, they restart on the next", NULL},
+	{NULL}
+};
+
+static PyMethodDef VecEnv_methods[] = {
+	{"step", (PyCFunction) VecEnv_step, METH_VARARGS,
+	 "step(actions)\nRuns every game a frame, actions has an ACTION_ byte per game. The GIL is released."},
+	{"reset", (PyCFunction) VecEnv_reset, METH_NOARGS, "Starts every game over"},
+	{NULL}
+};
+
+static PySequenceMethods VecEnv_sequence = {(lenfunc) VecEnv_length};
+
+static PyTypeObject VecEnvType = {
+	PyVarObject_HEAD_INIT(NULL, 0)
+	.tp_name = "i8080.VecEnv",
+	.tp_basicsize = sizeof(VecEnvObject),
+	.tp_dealloc = (destructor) VecEnv_dealloc,
+	.tp_as_sequence = &VecEnv_sequence,
+	.tp_flags = Py_TPFLAGS_DEFAULT,
+	.tp_doc = "VecEnv(rom, count, threads=0)\ncount Space Invaders games stepped in parallel on up to threads threads.\n"
+	          "The observation views are overwritten in place by every step.",
+	.tp_methods = VecEnv_methods,
+	.tp_getset = VecEnv_getset,
+	.tp_new = VecEnv_new,
+};
+
+static struct PyModuleDef module = {
+	PyModuleDef_HEAD_INIT,
+	.m_name = "i8080",
+	.m_doc = "Intel 8080 emulator",
+	.m_size = -1,
+};
+
+PyMODINIT_FUNC PyInit_i8080(void) {
+	PyObject *m;
+	if(lib8080_version() != LIB8080_VERSION) {
+		PyErr_SetString(PyExc_ImportError, "lib8080 version doesn't match lib8080.h");
+		return NULL;
+	}
+	if(PyType_Ready(&ViewType) < 0 || PyType_Ready(&MachineType) < 0 || PyType_Ready(&VecEnvType) < 0) {
+		return NULL;
+	}
+	m = PyModule_Create(&module);
+	if(!m) {
+		return NULL;
+	}
+	Py_INCREF(&MachineType);
+	Py_INCREF(&VecEnvType);
+	if(PyModule_AddObject(m, "Machine", (PyObject *) &MachineType) < 0 ||
+	   PyModule_AddObject(m, "VecEnv", (PyObject *) &VecEnvType) < 0 ||
+	   PyModule_AddIntConstant(m, "SCREEN_WIDTH", LIB8080_SCREEN_WIDTH) < 0 ||
+	   PyModule_AddIntConstant(m, "SCREEN_HEIGHT", LIB8080_SCREEN_HEIGHT) < 0 ||
+	   PyModule_AddIntConstant(m, "OBSERVATION_WIDTH", LIB8080_OBSERVATION_WIDTH) < 0 ||
+	   PyModule_AddIntConstant(m, "OBSERVATION_HEIGHT", LIB8080_OBSERVATION_HEIGHT) < 0 ||
+	   PyModule_AddIntConstant(m, "ACTION_FIRE", LIB8080_ACTION_FIRE) < 0 ||
+	   PyModule_AddIntConstant(m, "ACTION_LEFT", LIB8080_ACTION_LEFT) < 0 ||
+	   PyModule_AddIntConstant(m, "ACTION_RIGHT", LIB8080_ACTION_RIGHT) < 0 ||
+	   PyModule_AddIntConstant(m, "INPUT_COIN", LIB8080_INPUT_COIN) < 0 ||
+	   PyModule_AddIntConstant(m, "INPUT_P2_START", LIB8080_INPUT_P2_START) < 0 ||
+	   PyModule_AddIntConstant(m, "INPUT_P1_START", LIB8080_INPUT_P1_START) < 0 ||
+	   PyModule_AddIntConstant(m, "INPUT_P1_FIRE", LIB8080_INPUT_P1_FIRE) < 0 ||
+	   PyModule_AddIntConstant(m, "INPUT_P1_LEFT", LIB8080_INPUT_P1_LEFT) < 0 ||
+	   PyModule_AddIntConstant(m, "INPUT_P1_RIGHT", LIB8080_INPUT_P1_RIGHT) < 0) {
+		Py_DECREF(m);
+		return NULL;
+	}
+	return m;
+}
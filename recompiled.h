@@ -0,0 +1,12 @@
+#ifndef RECOMPILED_H
+#define RECOMPILED_H
+
+#include "cpu.h"
+
+// Defined by the C++ file the recompiler generates from a ROM. Runs translated code from
+// cpu->PC until at least budget cycles have passed and returns the cycles taken. Returns
+// early when it reaches something only the interpreter handles, and 0 if cpu->PC itself
+// isn't translated, in which case emulate8080() has to step it.
+int runRecompiled(unique_ptr<CPU> &cpu, int budget);
+
+#endif
@@ -0,0 +1,708 @@
+// Static recompiler: translates a fixed 8080 ROM into a C++ source file that runs against the
+// same CPU struct as emulate8080(). Every basic block becomes a label, registers live in local
+// variables, and a flag is only computed when something reads it before it is overwritten.
+// Anything that can't be translated (IN, OUT, HLT, computed jump targets, writes into
+// translated code) leaves runRecompiled() so the interpreter can take over.
+//
+// Usage: recompiler <rom> <load address> <output.cpp> [entry point...]
+#include "cpu.h"
+
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using std::cout;
+using std::endl;
+using std::string;
+
+const char *const MNEMONICS[] = {
+	"NOP", "LXI B,D16", "STAX B", "INX B", "INR B", "DCR B", "MVI B,D8", "RLC", // 0x00
+	"-", "DAD B", "LDAX B", "DCX B", "INR C", "DCR C", "MVI C,D8", "RRC", // 0x08
+	"-", "LXI D,D16", "STAX D", "INX D", "INR D", "DCR D", "MVI D,D8", "RAL", // 0x10
+	"-", "DAD D", "LDAX D", "DCX D", "INR E", "DCR E", "MVI E,D8", "RAR", // 0x18
+	"RIM", "LXI H,D16", "SHLD adr", "INX H", "INR H", "DCR H", "MVI H,D8", "DAA", // 0x20
+	"-", "DAD H", "LHLD adr", "DCX H", "INR L", "DCR L", "MVI L,D8", "CMA", // 0x28
+	"SIM", "LXI SP,D16", "STA adr", "INX SP", "INR M", "DCR M", "MVI M,D8", "STC", // 0x30
+	"-", "DAD SP", "LDA adr", "DCX SP", "INR A", "DCR A", "MVI A,D8", "CMC", // 0x38
+	"MOV B,B", "MOV B,C", "MOV B,D", "MOV B,E", "MOV B,H", "MOV B,L", "MOV B,M", "MOV B,A", // 0x40
+	"MOV C,B", "MOV C,C", "MOV C,D", "MOV C,E", "MOV C,H", "MOV C,L", "MOV C,M", "MOV C,A", // 0x48
+	"MOV D,B", "MOV D,C", "MOV D,D", "MOV D,E", "MOV D,H", "MOV D,L", "MOV D,M", "MOV D,A", // 0x50
+	"MOV E,B", "MOV E,C", "MOV E,D", "MOV E,E", "MOV E,H", "MOV E,L", "MOV E,M", "MOV E,A", // 0x58
+	"MOV H,B", "MOV H,C", "MOV H,D", "MOV H,E", "MOV H,H", "MOV H,L", "MOV H,M", "MOV H,A", // 0x60
+	"MOV L,B", "MOV L,C", "MOV L,D", "MOV L,E", "MOV L,H", "MOV L,L", "MOV L,M", "MOV L,A", // 0x68
+	"MOV M,B", "MOV M,C", "MOV M,D", "MOV M,E", "MOV M,H", "MOV M,L", "HLT", "MOV M,A", // 0x70
+	"MOV A,B", "MOV A,C", "MOV A,D", "MOV A,E", "MOV A,H", "MOV A,L", "MOV A,M", "MOV A,A", // 0x78
+	"ADD B", "ADD C", "ADD D", "ADD E", "ADD H", "ADD L", "ADD M", "ADD A", // 0x80
+	"ADC B", "ADC C", "ADC D", "ADC E", "ADC H", "ADC L", "ADC M", "ADC A", // 0x88
+	"SUB B", "SUB C", "SUB D", "SUB E", "SUB H", "SUB L", "SUB M", "SUB A", // 0x90
+	"SBB B", "SBB C", "SBB D", "SBB E", "SBB H", "SBB L", "SBB M", "SBB A", // 0x98
+	"ANA B", "ANA C", "ANA D", "ANA E", "ANA H", "ANA L", "ANA M", "ANA A", // 0xa0
+	"XRA B", "XRA C", "XRA D", "XRA E", "XRA H", "XRA L", "XRA M", "XRA A", // 0xa8
+	"ORA B", "ORA C", "ORA D", "ORA E", "ORA H", "ORA L", "ORA M", "ORA A", // 0xb0
+	"CMP B", "CMP C", "CMP D", "CMP E", "CMP H", "CMP L", "CMP M", "CMP A", // 0xb8
+	"RNZ", "POP B", "JNZ adr", "JMP adr", "CNZ adr", "PUSH B", "ADI D8", "RST 0", // 0xc0
+	"RZ", "RET", "JZ adr", "-", "CZ adr", "CALL adr", "ACI D8", "RST 1", // 0xc8
+	"RNC", "POP D", "JNC adr", "OUT D8", "CNC adr", "PUSH D", "SUI D8", "RST 2", // 0xd0
+	"RC", "-", "JC adr", "IN D8", "CC adr", "-", "SBI D8", "RST 3", // 0xd8
+	"RPO", "POP H", "JPO adr", "XTHL", "CPO adr", "PUSH H", "ANI D8", "RST 4", // 0xe0
+	"RPE", "PCHL", "JPE adr", "XCHG", "CPE adr", "-", "XRI D8", "RST 5", // 0xe8
+	"RP", "POP PSW", "JP adr", "DI", "CP adr", "PUSH PSW", "ORI D8", "RST 6", // 0xf0
+	"RM", "SPHL", "JM adr", "EI", "CM adr", "-", "CPI D8", "RST 7" // 0xf8
+};
+// A missing comma joins two strings and shifts every opcode after them
+static_assert(sizeof(MNEMONICS) / sizeof(MNEMONICS[0]) == 256, "Every opcode needs a mnemonic");
+
+const char *const REGISTERS[8] = {"B", "C", "D", "E", "H", "L", "RAM[(H << 8) | L]", "A"};
+const char *const CONDITIONS[8] = {"!Z", "Z", "!CY", "CY", "!P", "P", "!S", "S"};
+const uint8_t CONDITION_FLAGS[8] = {FLAG_Z, FLAG_Z, FLAG_CY, FLAG_CY, FLAG_P, FLAG_P, FLAG_S, FLAG_S};
+
+struct Instruction {
+	uint16_t address;
+	uint8_t opCode;
+	uint16_t operand; // D8, D16 or adr
+	uint8_t live; // Flags read later on before being overwritten
+};
+
+struct Block {
+	std::vector<Instruction> code;
+	std::vector<uint16_t> next; // Blocks control can pass to directly
+	bool exits = false; // Can leave through dispatch or back to the interpreter
+	bool check = false; // Checks the cycle budget on entry
+	uint8_t liveIn = FLAG_ALL;
+};
+
+struct Program {
+	std::vector<uint8_t> rom;
+	uint16_t base;
+	std::vector<bool> code; // Every byte of every translated instruction
+	std::map<uint16_t, Block> blocks;
+};
+
+bool inRom(const Program &p, uint32_t address) {
+	return address >= p.base && address < p.base + p.rom.size();
+}
+
+bool isFallback(uint8_t opCode) {
+	switch(opCode) {
+		case 0x76: // HLT
+		case 0xd3: // OUT
+		case 0xdb: // IN
+			return true;
+	}
+	return MNEMONICS[opCode][0] == '-' || opCode == 0x20 || opCode == 0x30; // Undocumented, left to the interpreter (RIM and SIM too)
+}
+
+bool isJump(uint8_t opCode) {
+	return opCode == 0xc3 || (opCode & 0xc7) == 0xc2;
+}
+
+bool isCall(uint8_t opCode) {
+	return opCode == 0xcd || (opCode & 0xc7) == 0xc4;
+}
+
+bool isReturn(uint8_t opCode) {
+	return opCode == 0xc9 || (opCode & 0xc7) == 0xc0;
+}
+
+bool isRST(uint8_t opCode) {
+	return (opCode & 0xc7) == 0xc7;
+}
+
+bool endsBlock(uint8_t opCode) {
+	return isJump(opCode) || isCall(opCode) || isReturn(opCode) || isRST(opCode) || opCode == 0xe9 || isFallback(opCode);
+}
+
+// Flags an instruction sets unconditionally
+uint8_t flagsWritten(uint8_t opCode) {
+	if(opCode >= 0x80 && opCode < 0xc0) { // ADD, ADC, SUB, SBB, ANA, XRA, ORA, CMP
+		return FLAG_ALL;
+	}
+	switch(opCode) {
+		case 0xc6: case 0xce: case 0xd6: case 0xde: case 0xe6: case 0xee: case 0xf6: case 0xfe: // Immediate ALU
+		case 0xf1: // POP PSW
+		case 0x27: // DAA
+			return FLAG_ALL;
+		case 0x07: case 0x0f: case 0x17: case 0x1f: // Rotates
+		case 0x09: case 0x19: case 0x29: case 0x39: // DAD
+		case 0x37: case 0x3f: // STC, CMC
+			return FLAG_CY;
+	}
+	if((opCode & 0xc6) == 0x04) { // INR, DCR
+		return FLAG_Z | FLAG_S | FLAG_P | FLAG_AC;
+	}
+	return 0;
+}
+
+// Flags an instruction reads, including ones it only sets conditionally
+uint8_t flagsRead(uint8_t opCode) {
+	if((opCode >= 0x88 && opCode < 0x90) || (opCode >= 0x98 && opCode < 0xa0)) { // ADC, SBB
+		return FLAG_CY;
+	}
+	if((opCode & 0xc7) == 0xc0 || (opCode & 0xc7) == 0xc2 || (opCode & 0xc7) == 0xc4) { // Rcc, Jcc, Ccc
+		return CONDITION_FLAGS[(opCode >> 3) & 7];
+	}
+	switch(opCode) {
+		case 0x17: case 0x1f: case 0x3f: case 0xce: case 0xde: // RAL, RAR, CMC, ACI, SBI
+			return FLAG_CY;
+		case 0x27: // DAA (CY is only ever set)
+			return FLAG_CY | FLAG_AC;
+		case 0xf5: // PUSH PSW
+			return FLAG_ALL;
+	}
+	return 0;
+}
+
+// Whether an instruction can write to memory through an address only known at run time
+bool writesMemory(uint8_t opCode) {
+	if((opCode >= 0x70 && opCode < 0x78 && opCode != 0x76) || isCall(opCode) || isRST(opCode)) { // MOV M,r
+		return true;
+	}
+	switch(opCode) {
+		case 0x02: case 0x12: // STAX
+		case 0x34: case 0x35: case 0x36: // INR M, DCR M, MVI M
+		case 0xc5: case 0xd5: case 0xe5: case 0xf5: // PUSH
+		case 0xe3: // XTHL
+			return true;
+	}
+	return false;
+}
+
+// Where a jump, call or RST goes
+uint16_t branchTarget(const Instruction &instruction) {
+	if(isRST(instruction.opCode)) {
+		return instruction.opCode & 0x38;
+	}
+	return instruction.operand;
+}
+
+Instruction decode(const Program &p, uint16_t address) {
+	Instruction instruction;
+	instruction.address = address;
+	instruction.opCode = p.rom[address - p.base];
+	instruction.operand = 0;
+	instruction.live = FLAG_ALL;
+	if(OPCODE_SIZES[instruction.opCode] > 1) {
+		instruction.operand = p.rom[address - p.base + 1];
+	}
+	if(OPCODE_SIZES[instruction.opCode] > 2) {
+		instruction.operand |= p.rom[address - p.base + 2] << 8;
+	}
+	return instruction;
+}
+
+// Recursive descent from the entry points: finds every reachable instruction and every leader
+void findBlocks(Program &p, std::vector<uint16_t> entries) {
+	std::set<uint16_t> leaders(entries.begin(), entries.end());
+	std::vector<bool> visited(0x10000, false);
+	p.code.assign(0x10000, false);
+
+	while(!entries.empty()) {
+		uint32_t address = entries.back();
+		entries.pop_back();
+		while(inRom(p, address) && !visited[address]) {
+			visited[address] = true;
+			uint8_t opCode = p.rom[address - p.base];
+			if(!inRom(p, address + OPCODE_SIZES[opCode] - 1)) {
+				break;
+			}
+			for(int i = 0; i < OPCODE_SIZES[opCode]; i++) {
+				p.code[address + i] = true;
+			}
+			Instruction instruction = decode(p, address);
+			uint16_t next = address + OPCODE_SIZES[opCode];
+			if(isJump(opCode) || isCall(opCode) || isRST(opCode)) {
+				leaders.insert(branchTarget(instruction));
+				entries.push_back(branchTarget(instruction));
+			}
+			if(endsBlock(opCode)) {
+				if(opCode != 0xc3 && opCode != 0xc9 && opCode != 0xe9) { // Everything but JMP, RET and PCHL can continue
+					leaders.insert(next);
+					entries.push_back(next);
+				}
+				break;
+			}
+			address = next;
+		}
+	}
+
+	for(uint16_t leader : leaders) {
+		if(!inRom(p, leader) || !p.code[leader]) {
+			continue;
+		}
+		Block &block = p.blocks[leader];
+		uint32_t address = leader;
+		while(true) {
+			if(!inRom(p, address) || !inRom(p, address + OPCODE_SIZES[p.rom[address - p.base]] - 1)) {
+				block.exits = true; // Runs off the end of the ROM
+				break;
+			}
+			Instruction instruction = decode(p, address);
+			block.code.push_back(instruction);
+			uint16_t next = address + OPCODE_SIZES[instruction.opCode];
+			if(isFallback(instruction.opCode) || isReturn(instruction.opCode) || instruction.opCode == 0xe9) {
+				block.exits = true;
+			}
+			if(isJump(instruction.opCode) || isCall(instruction.opCode) || isRST(instruction.opCode)) {
+				block.next.push_back(branchTarget(instruction));
+			}
+			if(endsBlock(instruction.opCode)) {
+				if(instruction.opCode != 0xc3 && instruction.opCode != 0xcd && !isRST(instruction.opCode) && instruction.opCode != 0xc9 &&
+				   instruction.opCode != 0xe9 && !isFallback(instruction.opCode)) {
+					block.next.push_back(next); // Conditional jump, call or return falls through
+				}
+				break;
+			}
+			if(leaders.count(next)) {
+				block.next.push_back(next);
+				break;
+			}
+			address = next;
+		}
+	}
+
+	// Loops must pass through a budget check so the interpreter gets control back
+	for(auto &entry : p.blocks) {
+		for(uint16_t target : entry.second.next) {
+			auto found = p.blocks.find(target);
+			if(found != p.blocks.end() && target <= entry.second.code.back().address) {
+				found->second.check = true;
+			}
+			if(found == p.blocks.end()) {
+				entry.second.exits = true; // Leaves the ROM (e.g. a CP/M BDOS call)
+			}
+		}
+	}
+}
+
+string format(const char *fmt, ...) {
+	char buffer[256];
+	va_list args;
+	va_start(args, fmt);
+	vsnprintf(buffer, sizeof(buffer), fmt, args);
+	va_end(args);
+	return buffer;
+}
+
+// Whether an instruction can overwrite translated code (and so has to be able to leave)
+bool writesCode(const Program &p, const Instruction &instruction) {
+	if(instruction.opCode == 0x32) { // STA adr
+		return p.code[instruction.operand];
+	}
+	if(instruction.opCode == 0x22) { // SHLD adr
+		return p.code[instruction.operand] || p.code[(uint16_t) (instruction.operand + 1)];
+	}
+	return writesMemory(instruction.opCode);
+}
+
+// Backward dataflow over the whole program: which flags are read before being overwritten.
+// Every point that can hand control back to the interpreter keeps all flags live.
+void findLiveFlags(Program &p) {
+	for(auto &entry : p.blocks) {
+		entry.second.liveIn = 0;
+	}
+	bool changed = true;
+	while(changed) {
+		changed = false;
+		for(auto it = p.blocks.rbegin(); it != p.blocks.rend(); ++it) {
+			Block &block = it->second;
+			uint8_t live = block.exits ? FLAG_ALL : 0;
+			for(uint16_t target : block.next) {
+				auto found = p.blocks.find(target);
+				live |= found == p.blocks.end() ? (uint8_t) FLAG_ALL : (uint8_t) found->second.liveIn;
+			}
+			for(auto instruction = block.code.rbegin(); instruction != block.code.rend(); ++instruction) {
+				if(writesCode(p, *instruction)) {
+					live = FLAG_ALL; // Writing into translated code leaves
+				}
+				instruction->live = live;
+				live = (live & ~flagsWritten(instruction->opCode)) | flagsRead(instruction->opCode);
+			}
+			if(block.check) {
+				live = FLAG_ALL;
+			}
+			if(live != block.liveIn) {
+				block.liveIn = live;
+				changed = true;
+			}
+		}
+	}
+}
+
+string jumpTo(const Program &p, uint16_t target) {
+	if(p.blocks.count(target)) {
+		return format("goto L_%04x;", target);
+	}
+	return format("{ PC = 0x%04x; goto leave; }", target); // Not translated
+}
+
+// AC is the carry out of bit 3 when answer = before + operand
+void emitArithmeticFlags(std::ostream &out, uint8_t need, const string &before, const string &operand) {
+	if(need & FLAG_AC) out << "\tAC = ((" << before << " ^ " << operand << " ^ answer) >> 4) & 1;\n";
+	if(need & FLAG_Z) out << "\tZ = (answer & 0xff) == 0;\n";
+	if(need & FLAG_S) out << "\tS = (answer & 0x80) == 0x80;\n";
+	if(need & FLAG_P) out << "\tP = parity(answer & 0xff);\n";
+	if(need & FLAG_CY) out << "\tCY = answer > 0xff;\n";
+}
+
+void emitLogicFlags(std::ostream &out, uint8_t need) {
+	if(need & FLAG_Z) out << "\tZ = A == 0;\n";
+	if(need & FLAG_S) out << "\tS = (A & 0x80) == 0x80;\n";
+	if(need & FLAG_P) out << "\tP = parity(A);\n";
+	if(need & FLAG_CY) out << "\tCY = 0;\n";
+	if(need & FLAG_AC) out << "\tAC = 0;\n";
+}
+
+void emitPush(std::ostream &out, const string &hi, const string &lo, const string &indent = "\t") {
+	out << indent << "written |= store(RAM, SP - 1, " << hi << ");\n";
+	out << indent << "written |= store(RAM, SP - 2, " << lo << ");\n";
+	out << indent << "SP -= 2;\n";
+}
+
+// ADD, ADC, SUB, SBB, ANA, XRA, ORA and CMP (CPI when immediate), mirroring emulate8080()
+void emitALU(std::ostream &out, int kind, const string &v, uint8_t live) {
+	uint8_t need = live & FLAG_ALL;
+	switch(kind) {
+		case 0: // ADD
+		case 1: // ADC
+			out << "\tanswer = (uint32_t) A + " << v << (kind == 1 ? " + CY" : "") << ";\n";
+			emitArithmeticFlags(out, need, "A", v);
+			out << "\tA = answer;\n";
+			break;
+		case 2: // SUB
+		case 3: // SBB
+		case 7: // CMP, CPI
+			out << "\tanswer = (uint32_t) A - " << v << (kind == 3 ? " - CY" : "") << ";\n";
+			emitArithmeticFlags(out, need, "A", "~" + v);
+			if(kind != 7) {
+				out << "\tA = answer;\n";
+			}
+			break;
+		case 4: // ANA
+			if(need & FLAG_AC) out << "\tAC = ((A | " << v << ") >> 3) & 1;\n";
+			out << "\tA = A & " << v << ";\n";
+			emitLogicFlags(out, need & ~FLAG_AC);
+			break;
+		case 5: // XRA
+			out << "\tA = A ^ " << v << ";\n";
+			emitLogicFlags(out, need);
+			break;
+		case 6: // ORA
+			out << "\tA = A | " << v << ";\n";
+			emitLogicFlags(out, need);
+			break;
+	}
+}
+
+void emitInstruction(std::ostream &out, const Program &p, const Instruction &instruction) {
+	uint8_t opCode = instruction.opCode;
+	uint8_t need = instruction.live & flagsWritten(opCode);
+	uint16_t next = instruction.address + OPCODE_SIZES[opCode];
+	string d8 = format("0x%02x", instruction.operand & 0xff);
+	string d16 = format("0x%04x", instruction.operand);
+	string source = REGISTERS[opCode & 7];
+	string destination = REGISTERS[(opCode >> 3) & 7];
+	string condition = CONDITIONS[(opCode >> 3) & 7];
+	const char *const pairs[4][2] = {{"B", "C"}, {"D", "E"}, {"H", "L"}, {"SP", "SP"}};
+	string hi = pairs[(opCode >> 4) & 3][0];
+	string lo = pairs[(opCode >> 4) & 3][1];
+	string pair = hi == "SP" ? "SP" : "((" + hi + " << 8) | " + lo + ")";
+
+	out << format("\t// 0x%04x: %s", instruction.address, MNEMONICS[opCode]);
+	if(OPCODE_SIZES[opCode] == 2) out << " " << d8;
+	if(OPCODE_SIZES[opCode] == 3) out << " " << d16;
+	out << "\n";
+	if(isFallback(opCode)) {
+		out << format("\tPC = 0x%04x;\n\tgoto leave;\n", instruction.address);
+		return;
+	}
+	out << "\tcycles += " << static_cast<int>(OPCODE_CYCLES[opCode]) << ";\n";
+
+	if(opCode >= 0x40 && opCode < 0x80) { // MOV
+		if((opCode & 0x38) == 0x30) {
+			out << "\twritten |= store(RAM, (H << 8) | L, " << source << ");\n";
+		} else if(destination != source) {
+			out << "\t" << destination << " = " << source << ";\n";
+		}
+	} else if(opCode >= 0x80 && opCode < 0xc0) {
+		emitALU(out, (opCode >> 3) & 7, source, instruction.live);
+	} else if((opCode & 0xc7) == 0xc6) {
+		emitALU(out, (opCode >> 3) & 7, d8, instruction.live);
+	} else if((opCode & 0xc6) == 0x04) { // INR, DCR
+		bool increment = (opCode & 1) == 0;
+		string value = destination;
+		if((opCode & 0x38) == 0x30) {
+			out << "\taddress = (H << 8) | L;\n";
+			value = "RAM[address]";
+		}
+		out << "\tanswer = (uint32_t) " << value << (increment ? " + 1;\n" : " - 1;\n");
+		emitArithmeticFlags(out, need & ~FLAG_CY, value, increment ? "0x01" : "0xfe"); // DCR adds ~1 with a carry in
+		if((opCode & 0x38) == 0x30) {
+			out << "\twritten |= store(RAM, address, answer);\n";
+		} else {
+			out << "\t" << value << " = answer;\n";
+		}
+	} else if((opCode & 0xc7) == 0x06) { // MVI
+		if((opCode & 0x38) == 0x30) {
+			out << "\twritten |= store(RAM, (H << 8) | L, " << d8 << ");\n";
+		} else {
+			out << "\t" << destination << " = " << d8 << ";\n";
+		}
+	} else if((opCode & 0xcf) == 0x01) { // LXI
+		if(hi == "SP") {
+			out << "\tSP = " << d16 << ";\n";
+		} else {
+			out << format("\t%s = 0x%02x;\n\t%s = 0x%02x;\n", lo.c_str(), instruction.operand & 0xff, hi.c_str(), instruction.operand >> 8);
+		}
+	} else if((opCode & 0xcf) == 0x03) { // INX
+		out << (hi == "SP" ? "\tSP++;\n" : "\t" + lo + "++;\n\tif(" + lo + " == 0) {\n\t\t" + hi + "++;\n\t}\n");
+	} else if((opCode & 0xcf) == 0x0b) { // DCX
+		out << (hi == "SP" ? "\tSP--;\n" : "\t" + lo + "--;\n\tif(" + lo + " == 0xff) {\n\t\t" + hi + "--;\n\t}\n");
+	} else if((opCode & 0xcf) == 0x09) { // DAD
+		out << "\tanswer = (uint32_t) ((H << 8) | L) + " << pair << ";\n";
+		out << "\tH = answer >> 8;\n\tL = answer;\n";
+		if(need & FLAG_CY) out << "\tCY = (answer & 0xffff0000) != 0;\n";
+	} else if((opCode & 0xcf) == 0xc1) { // POP
+		if(opCode == 0xf1) { // POP PSW
+			out << "\tA = RAM[(uint16_t) (SP + 1)];\n";
+			if(need & FLAG_Z) out << "\tZ = (RAM[SP] >> 6) & 1;\n";
+			if(need & FLAG_S) out << "\tS = RAM[SP] >> 7;\n";
+			if(need & FLAG_P) out << "\tP = (RAM[SP] >> 2) & 1;\n";
+			if(need & FLAG_CY) out << "\tCY = RAM[SP] & 1;\n";
+			if(need & FLAG_AC) out << "\tAC = (RAM[SP] >> 4) & 1;\n";
+		} else {
+			out << "\t" << lo << " = RAM[SP];\n\t" << hi << " = RAM[(uint16_t) (SP + 1)];\n";
+		}
+		out << "\tSP += 2;\n";
+	} else if((opCode & 0xcf) == 0xc5) { // PUSH
+		if(opCode == 0xf5) { // PUSH PSW
+			emitPush(out, "A", "S << 7 | Z << 6 | AC << 4 | P << 2 | 0x02 | CY");
+		} else {
+			emitPush(out, hi, lo);
+		}
+	} else if(isJump(opCode)) {
+		out << (opCode == 0xc3 ? "\t" : "\tif(" + condition + ") ") << jumpTo(p, instruction.operand) << "\n";
+	} else if(isCall(opCode) || isRST(opCode)) {
+		uint16_t target = branchTarget(instruction);
+		string indent = "\t";
+		if(opCode != 0xcd && !isRST(opCode)) {
+			out << "\tif(" << condition << ") {\n\t\tcycles += 6;\n";
+			indent = "\t\t";
+		}
+		emitPush(out, format("0x%02x", next >> 8), format("0x%02x", next & 0xff), indent);
+		out << indent << "if(written) {\n" << indent << format("\tPC = 0x%04x;\n", target) << indent << "\tgoto modified;\n" << indent << "}\n";
+		out << indent << jumpTo(p, target) << "\n";
+		if(indent.size() == 2) {
+			out << "\t}\n";
+		}
+	} else if(isReturn(opCode)) {
+		string indent = "\t";
+		if(opCode != 0xc9) {
+			out << "\tif(" << condition << ") {\n\t\tcycles += 6;\n";
+			indent = "\t\t";
+		}
+		out << indent << "PC = RAM[SP] | (RAM[(uint16_t) (SP + 1)] << 8);\n";
+		out << indent << "SP += 2;\n" << indent << "goto dispatch;\n";
+		if(opCode != 0xc9) {
+			out << "\t}\n";
+		}
+	} else {
+		switch(opCode) {
+			case 0x00: // NOP
+				break;
+			case 0x02: // STAX B
+			case 0x12: // STAX D
+				out << "\twritten |= store(RAM, " << pair << ", A);\n";
+				break;
+			case 0x0a: // LDAX B
+			case 0x1a: // LDAX D
+				out << "\tA = RAM[" << pair << "];\n";
+				break;
+			case 0x07: // RLC
+				out << "\tA = (A << 1) | (A >> 7);\n";
+				if(need & FLAG_CY) out << "\tCY = A & 1;\n";
+				break;
+			case 0x0f: // RRC
+				out << "\tA = (A >> 1) | (A << 7);\n";
+				if(need & FLAG_CY) out << "\tCY = A >> 7;\n";
+				break;
+			case 0x17: // RAL
+				out << "\tanswer = CY;\n\tCY = A >> 7;\n\tA = (A << 1) | answer;\n";
+				break;
+			case 0x1f: // RAR
+				out << "\tanswer = CY;\n\tCY = A & 1;\n\tA = (A >> 1) | (answer << 7);\n";
+				break;
+			case 0x22: // SHLD adr
+				out << format("\tRAM[0x%04x] = L;\n\tRAM[0x%04x] = H;\n", instruction.operand, (uint16_t) (instruction.operand + 1));
+				break;
+			case 0x2a: // LHLD adr
+				out << format("\tL = RAM[0x%04x];\n\tH = RAM[0x%04x];\n", instruction.operand, (uint16_t) (instruction.operand + 1));
+				break;
+			case 0x27: // DAA
+				out << "\taddress = (A & 0x0f) > 9 || AC ? 0x06 : 0x00;\n";
+				out << "\tif((A >> 4) > 9 || CY || ((A >> 4) == 9 && (A & 0x0f) > 9)) {\n\t\taddress |= 0x60;\n\t\tCY = 1;\n\t}\n";
+				out << "\tanswer = A + address;\n";
+				emitArithmeticFlags(out, need & ~FLAG_CY, "A", "address");
+				out << "\tA = answer;\n";
+				break;
+			case 0x2f: // CMA
+				out << "\tA = ~A;\n";
+				break;
+			case 0x32: // STA adr
+				out << format("\tRAM[0x%04x] = A;\n", instruction.operand);
+				break;
+			case 0x3a: // LDA adr
+				out << format("\tA = RAM[0x%04x];\n", instruction.operand);
+				break;
+			case 0x37: // STC
+				if(need & FLAG_CY) out << "\tCY = 1;\n";
+				break;
+			case 0x3f: // CMC
+				if(need & FLAG_CY) out << "\tCY = !CY;\n";
+				break;
+			case 0xe3: // XTHL
+				out << "\tanswer = L;\n\tL = RAM[SP];\n\twritten |= store(RAM, SP, answer);\n";
+				out << "\tanswer = H;\n\tH = RAM[(uint16_t) (SP + 1)];\n\twritten |= store(RAM, SP + 1, answer);\n";
+				break;
+			case 0xe9: // PCHL
+				out << "\tPC = (H << 8) | L;\n\tgoto dispatch;\n";
+				break;
+			case 0xeb: // XCHG
+				out << "\tanswer = H;\n\tH = D;\n\tD = answer;\n\tanswer = L;\n\tL = E;\n\tE = answer;\n";
+				break;
+			case 0xf3: // DI
+				out << "\tcpu->int_enable = 0;\n";
+				break;
+			case 0xf9: // SPHL
+				out << "\tSP = (H << 8) | L;\n";
+				break;
+			case 0xfb: // EI
+				out << "\tcpu->int_enable = 1;\n";
+				break;
+		}
+	}
+
+	if(writesCode(p, instruction) && !isCall(opCode) && !isRST(opCode)) {
+		if(opCode == 0x32 || opCode == 0x22) {
+			out << format("\tPC = 0x%04x;\n\tgoto modified;\n", next);
+		} else {
+			out << format("\tif(written) {\n\t\tPC = 0x%04x;\n\t\tgoto modified;\n\t}\n", next);
+		}
+	}
+}
+
+void emitProgram(std::ostream &out, const Program &p, const string &romName) {
+	out << format("// Generated by recompiler from %s (0x%04x-0x%04x). Do not edit.\n", romName.c_str(), p.base, (unsigned) (p.base + p.rom.size() - 1));
+	out << "#include \"recompiled.h\"\n\n";
+	out << format("static const uint16_t CODE_BASE = 0x%04x;\n", p.base);
+	out << format("static const uint16_t CODE_SIZE = 0x%04x;\n", (unsigned) p.rom.size());
+	out << "static const uint8_t CODE_MAP[] = { // One bit per translated byte\n";
+	for(size_t i = 0; i < p.rom.size(); i += 8) {
+		uint8_t bits = 0;
+		for(size_t j = 0; j < 8 && i + j < p.rom.size(); j++) {
+			bits |= p.code[p.base + i + j] << j;
+		}
+		out << ((i % 128) == 0 ? "\t" : " ") << format("0x%02x,", bits) << ((i % 128) == 120 || i + 8 >= p.rom.size() ? "\n" : "");
+	}
+	out << "};\n\n";
+	out << "static bool codeModified = false; // Translated code was overwritten, only the interpreter is safe now\n\n";
+	out << "// Writes a byte and reports whether it landed on translated code\n";
+	out << "static inline bool store(uint8_t *RAM, uint16_t address, uint8_t value) {\n";
+	out << "\tRAM[address] = value;\n";
+	out << "\tuint16_t offset = address - CODE_BASE;\n";
+	out << "\treturn offset < CODE_SIZE && (CODE_MAP[offset >> 3] & (1 << (offset & 7)));\n";
+	out << "}\n\n";
+
+	out << "int runRecompiled(unique_ptr<CPU> &cpu, int budget) {\n";
+	out << "\tif(codeModified) {\n\t\treturn 0;\n\t}\n";
+	out << "\tuint8_t A = cpu->A, B = cpu->B, C = cpu->C, D = cpu->D, E = cpu->E, H = cpu->H, L = cpu->L;\n";
+	out << "\tuint8_t Z = getFlag(cpu->f, FLAG_Z), S = getFlag(cpu->f, FLAG_S), P = getFlag(cpu->f, FLAG_P);\n";
+	out << "\tuint8_t CY = getFlag(cpu->f, FLAG_CY), AC = getFlag(cpu->f, FLAG_AC);\n";
+	out << "\tuint16_t SP = cpu->SP, PC = cpu->PC;\n";
+	out << "\tuint8_t *RAM = cpu->RAM;\n";
+	out << "\tuint32_t answer = 0;\n\tuint16_t address = 0;\n\tbool written = false;\n\tint cycles = 0;\n";
+	out << "\t(void) answer;\n\t(void) address;\n\t(void) written; // Scratch a small program may not need\n\n";
+	out << "dispatch:\n\tif(cycles >= budget) {\n\t\tgoto leave;\n\t}\n\tswitch(PC) {\n";
+	for(auto &entry : p.blocks) {
+		out << format("\t\tcase 0x%04x: goto L_%04x;\n", entry.first, entry.first);
+	}
+	out << "\t}\n\tgoto leave;\n";
+
+	for(auto &entry : p.blocks) {
+		const Block &block = entry.second;
+		out << format("\nL_%04x:\n", entry.first);
+		if(block.check) {
+			out << format("\tif(cycles >= budget) {\n\t\tPC = 0x%04x;\n\t\tgoto leave;\n\t}\n", entry.first);
+		}
+		for(const Instruction &instruction : block.code) {
+			emitInstruction(out, p, instruction);
+		}
+		const Instruction &last = block.code.back();
+		uint8_t opCode = last.opCode;
+		if(opCode != 0xc3 && opCode != 0xc9 && opCode != 0xcd && opCode != 0xe9 && !isRST(opCode) && !isFallback(opCode)) {
+			out << "\t" << jumpTo(p, last.address + OPCODE_SIZES[opCode]) << "\n";
+		}
+	}
+
+	out << "\nmodified:\n\tcodeModified = true;\n";
+	out << "leave:\n";
+	out << "\tcpu->A = A;\n\tcpu->B = B;\n\tcpu->C = C;\n\tcpu->D = D;\n\tcpu->E = E;\n\tcpu->H = H;\n\tcpu->L = L;\n";
+	out << "\tsetFlags(cpu->f, S << 7 | Z << 6 | AC << 4 | P << 2 | CY);\n";
+	out << "\tcpu->SP = SP;\n\tcpu->PC = PC;\n";
+	out << "\treturn cycles;\n}\n";
+}
+
+int main(int argc, char *argv[]) {
+	if(argc < 4) {
+		cout << "Usage: recompiler <rom> <load address> <output.cpp> [entry point...]" << endl;
+		return 1;
+	}
+
+	Program p;
+	std::ifstream input(argv[1], std::ios::binary);
+	if(!input) {
+		throw std::runtime_error("Could not open file!");
+	}
+	p.rom.assign(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+	p.base = std::strtoul(argv[2], nullptr, 16);
+	if(p.rom.empty() || p.base + p.rom.size() > 0x10000) {
+		throw std::runtime_error("ROM does not fit in memory!");
+	}
+
+	std::vector<uint16_t> entries = {p.base};
+	for(int i = 4; i < argc; i++) {
+		entries.push_back(std::strtoul(argv[i], nullptr, 16));
+	}
+	for(uint16_t vector = 0x00; vector <= 0x38; vector += 8) { // Interrupt handlers
+		if(inRom(p, vector)) {
+			entries.push_back(vector);
+		}
+	}
+
+	findBlocks(p, entries);
+	findLiveFlags(p);
+
+	std::ofstream output(argv[3]);
+	if(!output) {
+		throw std::runtime_error("Could not open file!");
+	}
+	string romName = argv[1];
+	emitProgram(output, p, romName.substr(romName.find_last_of('/') + 1));
+
+	int instructions = 0;
+	int flagsSkipped = 0;
+	for(auto &entry : p.blocks) {
+		for(const Instruction &instruction : entry.second.code) {
+			instructions++;
+			flagsSkipped += __builtin_popcount(flagsWritten(instruction.opCode) & ~instruction.live);
+		}
+	}
+	cout << std::dec << p.blocks.size() << " blocks, " << instructions << " instructions, " << flagsSkipped << " flag computations skipped" << endl;
+	return 0;
+}
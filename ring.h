@@ -0,0 +1,72 @@
+#ifndef RING_H
+#define RING_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+#include "cpu.h"
+
+// Lock-free ring buffer for exactly one producer thread and one consumer thread. Neither side
+// ever waits: write() stores what fits and read() takes what's there. Each index lives on its
+// own cache line next to the other side's last seen value, so the threads only share a line
+// when one of them runs out of room or data.
+template<typename T>
+class RingBuffer {
+public:
+	explicit RingBuffer(std::size_t capacity) : items(roundUp(capacity)), mask(items.size() - 1) {}
+
+	// Producer: returns how many items were stored
+	std::size_t write(const T *source, std::size_t count) {
+		std::size_t head = writer.index.load(std::memory_order_relaxed);
+		if(items.size() - (head - writer.seen) < count) {
+			writer.seen = reader.index.load(std::memory_order_acquire);
+		}
+		count = std::min(count, items.size() - (head - writer.seen));
+		for(std::size_t i = 0; i < count; i++) {
+			items[(head + i) & mask] = source[i];
+		}
+		writer.index.store(head + count, std::memory_order_release);
+		return count;
+	}
+
+	// Consumer: returns how many items were taken
+	std::size_t read(T *destination, std::size_t count) {
+		std::size_t tail = reader.index.load(std::memory_order_relaxed);
+		if(reader.seen - tail < count) {
+			reader.seen = writer.index.load(std::memory_order_acquire);
+		}
+		count = std::min(count, reader.seen - tail);
+		for(std::size_t i = 0; i < count; i++) {
+			destination[i] = items[(tail + i) & mask];
+		}
+		reader.index.store(tail + count, std::memory_order_release);
+		return count;
+	}
+
+	std::size_t capacity() const {
+		return items.size();
+	}
+
+private:
+	struct alignas(CACHE_LINE_SIZE) Side {
+		std::atomic<std::size_t> index{0}; // Total items this side has moved
+		std::size_t seen = 0; // Other side's index when this side last looked
+	};
+
+	static std::size_t roundUp(std::size_t capacity) {
+		std::size_t size = 1;
+		while(size < capacity) {
+			size <<= 1;
+		}
+		return size;
+	}
+
+	std::vector<T> items;
+	std::size_t mask;
+	Side writer;
+	Side reader;
+};
+
+#endif
@@ -0,0 +1,52 @@
+#include "rom.h"
+
+#include <algorithm>
+#include <stdexcept>
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+SharedRom::SharedRom(const uint8_t *data, std::size_t size, uint16_t address) : bytes(data, data + size), address(address) {
+	if(size > RAM_SIZE - address) {
+		throw std::runtime_error("ROM doesn't fit in memory!");
+	}
+#ifdef __linux__
+	// Sealed so the pages every CPU reads can't change under them
+	file = memfd_create("rom", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if(file >= 0 && (ftruncate(file, RAM_SIZE) != 0 || pwrite(file, data, size, address) != (ssize_t) size ||
+	                 fcntl(file, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) != 0)) {
+		close(file);
+		file = -1;
+	}
+	pageSize = (uint32_t) sysconf(_SC_PAGESIZE);
+#endif
+}
+
+SharedRom::~SharedRom() {
+#ifdef __linux__
+	if(file >= 0) {
+		close(file);
+	}
+#endif
+}
+
+void mapRom(CPU &cpu, const SharedRom &rom) {
+	uint32_t start = rom.address;
+	uint32_t end = start + (uint32_t) rom.bytes.size();
+	uint32_t first = (start + rom.pageSize - 1) / rom.pageSize * rom.pageSize; // Pages first up to last are mapped
+	uint32_t last = end / rom.pageSize * rom.pageSize;
+	if(rom.file < 0 || first >= last) {
+		first = last = end;
+	}
+#ifdef __linux__
+	if(first < last && mmap(cpu.RAM + first, last - first, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, rom.file,
+	                        first) == MAP_FAILED) {
+		throw std::runtime_error("Could not map ROM!");
+	}
+#endif
+	const uint8_t *bytes = rom.bytes.data();
+	std::copy(bytes, bytes + (first - start), cpu.RAM + start);
+	std::copy(bytes + (last - start), bytes + (end - start), cpu.RAM + last);
+}
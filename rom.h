@@ -0,0 +1,34 @@
+#ifndef ROM_H
+#define ROM_H
+
+#include "cpu.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A ROM image kept once per process and mapped into the RAM of every CPU running it instead of
+// copied into each, for hosts running thousands of machines. A CPU reads the image's own pages
+// until it writes one (the board ignores writes to ROM, the interpreter doesn't), which then
+// gets a private copy, so memory accesses stay plain RAM[address] loads and stores. With RAM
+// pages only taking memory once written, a Space Invaders machine costs the 8 KiB of RAM the
+// board has.
+//
+// Only pages wholly inside the image are mapped; bytes sharing a page with RAM are copied, and
+// where the image can't be mapped (no memfd_create()) all of it is.
+struct SharedRom {
+	SharedRom(const uint8_t *data, std::size_t size, uint16_t address);
+	~SharedRom();
+	SharedRom(const SharedRom &) = delete;
+	SharedRom &operator=(const SharedRom &) = delete;
+
+	std::vector<uint8_t> bytes;
+	uint16_t address;
+	int file = -1; // Sealed, holding the image at its addresses, or -1
+	uint32_t pageSize = RAM_SIZE;
+};
+
+// Puts the image into cpu's RAM as loadRom() would. The mapping outlives rom.
+void mapRom(CPU &cpu, const SharedRom &rom);
+
+#endif
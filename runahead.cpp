@@ -0,0 +1,68 @@
+#include "runahead.h"
+#ifdef COUNTERS
+#include "counters.h"
+#endif
+#ifdef COVERAGE
+#include "coverage.h"
+#endif
+
+#include <cstring>
+
+// The frames run ahead are rewound, so the counters and coverage leave them out
+static void suspendTools(bool suspended) {
+#ifdef COUNTERS
+	suspendCounters(suspended);
+#endif
+#ifdef COVERAGE
+	suspendCoverage(suspended);
+#endif
+	(void) suspended;
+}
+
+void runAhead(Machine &machine, RunAhead &ahead, uint64_t cycles) {
+	auto start = std::chrono::steady_clock::now();
+	saveMachine(machine, ahead.state);
+	auto saved = std::chrono::steady_clock::now();
+
+	Audio *audio = machine.audio;
+	Debugger *debugger = machine.debugger;
+	Watchpoints *watchpoints = machine.watchpoints;
+	machine.audio = nullptr;
+	machine.debugger = nullptr;
+	machine.watchpoints = nullptr;
+	suspendTools(true);
+	try {
+		runUntil(machine, machine.cycles + cycles);
+	} catch(...) {
+		suspendTools(false);
+		machine.audio = audio;
+		machine.debugger = debugger;
+		machine.watchpoints = watchpoints;
+		rewindMachine(machine, ahead.state);
+		throw;
+	}
+	suspendTools(false);
+	std::memcpy(ahead.vram.data(), machine.cpu->RAM + VRAM_START, VRAM_SIZE);
+	machine.audio = audio;
+	machine.debugger = debugger;
+	machine.watchpoints = watchpoints;
+	auto ran = std::chrono::steady_clock::now();
+
+	rewindMachine(machine, ahead.state);
+	auto rewound = std::chrono::steady_clock::now();
+	ahead.runs++;
+	ahead.saving += saved - start;
+	ahead.running += ran - saved;
+	ahead.rewinding += rewound - ran;
+}
+
+void printRunAheadStats(const RunAhead &ahead, std::ostream &out) {
+	if(!ahead.runs) {
+		return;
+	}
+	double runs = (double) ahead.runs;
+	out << std::dec << "Ran ahead " << ahead.runs << " times, on average saving took "
+	    << std::chrono::duration<double, std::micro>(ahead.saving).count() / runs << " us, running "
+	    << std::chrono::duration<double, std::micro>(ahead.running).count() / runs << " us and rewinding "
+	    << std::chrono::duration<double, std::micro>(ahead.rewinding).count() / runs << " us" << std::endl;
+}
@@ -0,0 +1,32 @@
+#ifndef RUNAHEAD_H
+#define RUNAHEAD_H
+
+#include "machine.h"
+#include "savestate.h"
+#include "video.h"
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+// Space Invaders reads the buttons on IN 1 and only shows what they did a frame or more later.
+// Running ahead hides that: after each real frame the machine is saved, run further with the
+// same inputs, its screen kept to be shown, and rewound. The screen shown is then the one the
+// game would have drawn had the inputs changed that much earlier. Only the real frames make
+// sound, reach the debugger and watchpoints or are counted and covered.
+struct RunAhead {
+	std::array<uint8_t, VRAM_SIZE> vram; // The screen to show
+	MachineState state;
+	// What it costs, to check it stays well within a frame
+	uint64_t runs = 0;
+	std::chrono::nanoseconds saving{0};
+	std::chrono::nanoseconds running{0};
+	std::chrono::nanoseconds rewinding{0};
+};
+
+// Runs cycles past the current one into vram, then puts the machine back as it was
+void runAhead(Machine &machine, RunAhead &ahead, uint64_t cycles);
+void printRunAheadStats(const RunAhead &ahead, std::ostream &out);
+
+#endif
@@ -0,0 +1,382 @@
+#include "savestate.h"
+#include "audio.h"
+#include "writefile.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+const char SAVE_STATE_MAGIC[8] = {'8', '0', '8', '0', 'S', 'A', 'V', 'E'};
+const uint16_t STORED = 0;
+const uint16_t LZ = 1;
+const std::size_t FLAGS_OFFSET = 7 + 2 * 2;
+const std::size_t SHIFT_OFFSET = SAVE_STATE_PAYLOAD_SIZE - RAM_SIZE - 3;
+
+const std::size_t MIN_MATCH = 4;
+const std::size_t MAX_OFFSET = 0xffff;
+const int HASH_BITS = 12;
+const uint32_t NO_POSITION = 0xffffffff;
+
+static void put(std::vector<uint8_t> &out, uint64_t value, int bytes) {
+	for(int i = 0; i < bytes; i++) {
+		out.push_back((value >> (i * 8)) & 0xff);
+	}
+}
+
+static uint64_t get(const uint8_t *&in, int bytes) {
+	uint64_t value = 0;
+	for(int i = 0; i < bytes; i++) {
+		value |= (uint64_t) *in++ << (i * 8);
+	}
+	return value;
+}
+
+static uint32_t read32(const uint8_t *data) {
+	return data[0] | data[1] << 8 | data[2] << 16 | (uint32_t) data[3] << 24;
+}
+
+// Lengths that don't fit in a token nibble continue in bytes of 255 and a final smaller one
+static void putLength(std::vector<uint8_t> &out, std::size_t length) {
+	for(; length >= 255; length -= 255) {
+		out.push_back(255);
+	}
+	out.push_back((uint8_t) length);
+}
+
+static bool getLength(const uint8_t *&in, const uint8_t *end, std::size_t &length) {
+	uint8_t byte;
+	do {
+		if(in == end) {
+			return false;
+		}
+		byte = *in++;
+		length += byte;
+	} while(byte == 255);
+	return true;
+}
+
+// A token (literal count in the high nibble, match length - 4 in the low one, 15 meaning the
+// length continues after it), the literals, then the match's 2-byte offset. The last sequence
+// is only literals.
+static void putSequence(std::vector<uint8_t> &out, const uint8_t *literals, std::size_t literalCount,
+                        std::size_t matchLength, std::size_t offset) {
+	std::size_t match = matchLength ? matchLength - MIN_MATCH : 0;
+	out.push_back((uint8_t) (std::min<std::size_t>(literalCount, 15) << 4 | std::min<std::size_t>(match, 15)));
+	if(literalCount >= 15) {
+		putLength(out, literalCount - 15);
+	}
+	out.insert(out.end(), literals, literals + literalCount);
+	if(matchLength) {
+		put(out, offset, 2);
+		if(match >= 15) {
+			putLength(out, match - 15);
+		}
+	}
+}
+
+std::vector<uint8_t> compress(const uint8_t *data, std::size_t size) {
+	std::vector<uint8_t> out;
+	out.reserve(size / 4 + 16);
+	std::vector<uint32_t> table(1 << HASH_BITS, NO_POSITION); // Last position each 4 byte hash was seen at
+	std::size_t anchor = 0; // Start of the literals not yet written
+	std::size_t position = 0;
+	while(position + MIN_MATCH <= size) {
+		uint32_t value = read32(data + position);
+		uint32_t &slot = table[(value * 2654435761u) >> (32 - HASH_BITS)];
+		std::size_t candidate = slot;
+		slot = (uint32_t) position;
+		if(candidate == NO_POSITION || position - candidate > MAX_OFFSET || read32(data + candidate) != value) {
+			position++;
+			continue;
+		}
+		std::size_t length = MIN_MATCH;
+		while(position + length < size && data[candidate + length] == data[position + length]) {
+			length++;
+		}
+		putSequence(out, data + anchor, position - anchor, length, position - candidate);
+		position += length;
+		anchor = position;
+	}
+	putSequence(out, data + anchor, size - anchor, 0, 0);
+	return out;
+}
+
+bool decompress(const uint8_t *data, std::size_t size, uint8_t *output, std::size_t outputSize) {
+	const uint8_t *in = data;
+	const uint8_t *end = data + size;
+	std::size_t written = 0;
+	while(in < end) {
+		uint8_t token = *in++;
+		std::size_t literals = token >> 4;
+		if(literals == 15 && !getLength(in, end, literals)) {
+			return false;
+		}
+		if(literals > (std::size_t) (end - in) || literals > outputSize - written) {
+			return false;
+		}
+		std::memcpy(output + written, in, literals);
+		in += literals;
+		written += literals;
+		if(in == end) { // Last sequence
+			break;
+		}
+
+		if(end - in < 2) {
+			return false;
+		}
+		std::size_t offset = get(in, 2);
+		std::size_t length = token & 0x0f;
+		if(length == 15 && !getLength(in, end, length)) {
+			return false;
+		}
+		length += MIN_MATCH;
+		if(offset == 0 || offset > written || length > outputSize - written) {
+			return false;
+		}
+		if(offset >= length) {
+			std::memcpy(output + written, output + written - offset, length);
+			written += length;
+		} else { // Overlapping, e.g. a run of one repeated byte
+			for(std::size_t i = 0; i < length; i++, written++) {
+				output[written] = output[written - offset];
+			}
+		}
+	}
+	return written == outputSize;
+}
+
+void takeSnapshot(const Machine &machine, std::vector<uint8_t> &payload) {
+	const CPU &cpu = *machine.cpu;
+	payload.clear();
+	payload.reserve(SAVE_STATE_PAYLOAD_SIZE);
+	uint8_t registers[] = {cpu.A, cpu.B, cpu.C, cpu.D, cpu.E, cpu.H, cpu.L};
+	payload.insert(payload.end(), registers, registers + sizeof(registers));
+	put(payload, cpu.SP, 2);
+	put(payload, cpu.PC, 2);
+	put(payload, getFlags(cpu.f), 1);
+	put(payload, cpu.int_enable, 1);
+	put(payload, cpu.halted, 1);
+	put(payload, machine.cycles, 8);
+	put(payload, machine.nextInterrupt, 8);
+	put(payload, machine.nextVector, 1);
+	put(payload, machine.idleCycles, 8);
+	put(payload, machine.port3, 1);
+	put(payload, machine.port5, 1);
+	put(payload, machine.shift, 2);
+	put(payload, machine.shiftOffset, 1);
+	payload.insert(payload.end(), cpu.RAM, cpu.RAM + RAM_SIZE);
+}
+
+void restoreSnapshot(Machine &machine, const std::vector<uint8_t> &payload) {
+	if(payload.size() != SAVE_STATE_PAYLOAD_SIZE) {
+		throw std::runtime_error("Save state has the wrong size!");
+	}
+	CPU &cpu = *machine.cpu;
+	const uint8_t *in = payload.data();
+	cpu.A = *in++;
+	cpu.B = *in++;
+	cpu.C = *in++;
+	cpu.D = *in++;
+	cpu.E = *in++;
+	cpu.H = *in++;
+	cpu.L = *in++;
+	cpu.SP = (uint16_t) get(in, 2);
+	cpu.PC = (uint16_t) get(in, 2);
+	setFlags(cpu.f, (uint8_t) get(in, 1));
+	cpu.int_enable = (uint8_t) get(in, 1);
+	cpu.halted = (uint8_t) get(in, 1);
+	machine.cycles = get(in, 8);
+	machine.nextInterrupt = get(in, 8);
+	machine.nextVector = (int) get(in, 1);
+	machine.idleCycles = get(in, 8);
+	machine.port3 = (uint8_t) get(in, 1);
+	machine.port5 = (uint8_t) get(in, 1);
+	machine.shift = (uint16_t) get(in, 2);
+	machine.shiftOffset = (uint8_t) get(in, 1) & 0x07;
+	writeMemory(cpu, in);
+	machine.idle = IdleLoop();
+	machine.loops.rejected.reset(); // The code may be different
+	if(machine.audio) {
+		resetAudio(*machine.audio, machine.cycles, machine.port3, machine.port5);
+	}
+}
+
+void saveMachine(const Machine &machine, MachineState &state) {
+	const CPU &cpu = *machine.cpu;
+	state.A = cpu.A;
+	state.BC = cpu.BC;
+	state.DE = cpu.DE;
+	state.HL = cpu.HL;
+	state.SP = cpu.SP;
+	state.PC = cpu.PC;
+	state.f = cpu.f;
+	state.int_enable = cpu.int_enable;
+	state.halted = cpu.halted;
+	state.cycles = machine.cycles;
+	state.nextInterrupt = machine.nextInterrupt;
+	state.nextVector = machine.nextVector;
+	state.idleCycles = machine.idleCycles;
+	state.idle = machine.idle;
+	state.loopCycles = machine.loops.cycles;
+	state.shift = machine.shift;
+	state.shiftOffset = machine.shiftOffset;
+	state.port3 = machine.port3;
+	state.port5 = machine.port5;
+	std::memcpy(state.ram.data(), cpu.RAM, RAM_SIZE);
+}
+
+// The block loop cache stays, it checks the code it was worked out from every time
+void rewindMachine(Machine &machine, const MachineState &state) {
+	CPU &cpu = *machine.cpu;
+	cpu.A = state.A;
+	cpu.BC = state.BC;
+	cpu.DE = state.DE;
+	cpu.HL = state.HL;
+	cpu.SP = state.SP;
+	cpu.PC = state.PC;
+	cpu.f = state.f;
+	cpu.int_enable = state.int_enable;
+	cpu.halted = state.halted;
+	machine.cycles = state.cycles;
+	machine.nextInterrupt = state.nextInterrupt;
+	machine.nextVector = state.nextVector;
+	machine.idleCycles = state.idleCycles;
+	machine.idle = state.idle;
+	machine.loops.cycles = state.loopCycles;
+	machine.shift = state.shift;
+	machine.shiftOffset = state.shiftOffset;
+	machine.port3 = state.port3;
+	machine.port5 = state.port5;
+	writeMemory(cpu, state.ram.data());
+}
+
+std::vector<uint8_t> encodeState(const std::vector<uint8_t> &payload) {
+	std::vector<uint8_t> compressed = compress(payload.data(), payload.size());
+	bool stored = compressed.size() >= payload.size();
+	const std::vector<uint8_t> &body = stored ? payload : compressed;
+
+	std::vector<uint8_t> file(SAVE_STATE_MAGIC, SAVE_STATE_MAGIC + sizeof(SAVE_STATE_MAGIC));
+	file.reserve(SAVE_STATE_HEADER_SIZE + body.size());
+	put(file, SAVE_STATE_VERSION, 2);
+	put(file, stored ? STORED : LZ, 2);
+	put(file, payload.size(), 4);
+	put(file, body.size(), 4);
+	put(file, crc32(payload.data(), payload.size()), 4);
+	put(file, crc32(file.data(), file.size()), 4);
+	file.insert(file.end(), body.begin(), body.end());
+	return file;
+}
+
+std::vector<uint8_t> decodeState(const std::vector<uint8_t> &file) {
+	if(file.size() < SAVE_STATE_HEADER_SIZE || std::memcmp(file.data(), SAVE_STATE_MAGIC, sizeof(SAVE_STATE_MAGIC)) != 0) {
+		throw std::runtime_error("Not a save state!");
+	}
+	const uint8_t *in = file.data() + sizeof(SAVE_STATE_MAGIC);
+	uint16_t version = (uint16_t) get(in, 2);
+	uint16_t compression = (uint16_t) get(in, 2);
+	uint32_t payloadSize = (uint32_t) get(in, 4);
+	uint32_t storedSize = (uint32_t) get(in, 4);
+	uint32_t payloadCrc = (uint32_t) get(in, 4);
+	if(get(in, 4) != crc32(file.data(), SAVE_STATE_HEADER_SIZE - 4) || storedSize != file.size() - SAVE_STATE_HEADER_SIZE) {
+		throw std::runtime_error("Save state is corrupt!");
+	}
+	if(version < 1 || version > SAVE_STATE_VERSION) {
+		throw std::runtime_error("Unsupported save state version!");
+	}
+
+	std::vector<uint8_t> payload(payloadSize);
+	if(compression == STORED && storedSize == payloadSize) {
+		std::memcpy(payload.data(), in, payloadSize);
+	} else if(compression != LZ || !decompress(in, storedSize, payload.data(), payloadSize)) {
+		throw std::runtime_error("Save state is corrupt!");
+	}
+	if(crc32(payload.data(), payload.size()) != payloadCrc) {
+		throw std::runtime_error("Save state is corrupt!");
+	}
+	if(version == 1 && payload.size() > FLAGS_OFFSET) { // Flags were packed Z S P CY AC from bit 0 up
+		uint8_t old = payload[FLAGS_OFFSET];
+		payload[FLAGS_OFFSET] = (old & 0x01) << 6 | (old & 0x02) << 6 | (old & 0x04) | (old & 0x08) >> 3 | (old & 0x10) | 0x02;
+	}
+	if(version <= 2 && payload.size() >= SHIFT_OFFSET) { // Before the shift register was emulated
+		payload.insert(payload.begin() + SHIFT_OFFSET, 3, 0x00);
+	}
+	return payload;
+}
+
+void saveState(const Machine &machine, const std::string &fileName) {
+	std::vector<uint8_t> payload;
+	takeSnapshot(machine, payload);
+	writeFile(fileName, encodeState(payload));
+}
+
+void loadState(Machine &machine, const std::string &fileName) {
+	std::ifstream input(fileName, std::ios::binary);
+	if(!input) {
+		throw std::runtime_error("Could not open file!");
+	}
+	std::vector<uint8_t> file((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+	restoreSnapshot(machine, decodeState(file));
+}
+
+static void writeStates(StateWriter *writer) {
+	std::unique_lock<std::mutex> lock(writer->mutex);
+	for(;;) {
+		writer->wake.wait(lock, [writer] { return writer->stopping || !writer->jobs.empty(); });
+		if(writer->jobs.empty()) { // Stopping with nothing left to do
+			break;
+		}
+		StateWriter::Job job = std::move(writer->jobs.front());
+		writer->jobs.pop_front();
+		lock.unlock();
+		bool written = true;
+		try {
+			writeFile(job.fileName, encodeState(job.payload));
+		} catch(const std::exception &) {
+			written = false;
+		}
+		lock.lock();
+		(written ? writer->written : writer->failed)++;
+		if(!writer->spare.capacity()) {
+			writer->spare.swap(job.payload);
+		}
+	}
+}
+
+void startStateWriter(StateWriter &writer) {
+	writer.stopping = false;
+	writer.thread = std::thread(writeStates, &writer);
+}
+
+void queueSave(StateWriter &writer, const Machine &machine, const std::string &fileName) {
+	std::vector<uint8_t> payload;
+	{
+		std::lock_guard<std::mutex> lock(writer.mutex);
+		payload.swap(writer.spare);
+	}
+	takeSnapshot(machine, payload);
+	{
+		std::lock_guard<std::mutex> lock(writer.mutex);
+		auto waiting = std::find_if(writer.jobs.begin(), writer.jobs.end(),
+		                            [&](const StateWriter::Job &job) { return job.fileName == fileName; });
+		if(waiting != writer.jobs.end()) { // Not written yet, so the older state can go
+			waiting->payload.swap(payload);
+			writer.spare.swap(payload);
+			return;
+		}
+		writer.jobs.push_back({std::move(payload), fileName});
+	}
+	writer.wake.notify_one();
+}
+
+void stopStateWriter(StateWriter &writer) {
+	{
+		std::lock_guard<std::mutex> lock(writer.mutex);
+		writer.stopping = true;
+	}
+	writer.wake.notify_one();
+	if(writer.thread.joinable()) {
+		writer.thread.join();
+	}
+}
@@ -0,0 +1,108 @@
+#ifndef SAVESTATE_H
+#define SAVESTATE_H
+
+#include "crc32.h"
+#include "machine.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Save state files are a fixed header followed by the payload, which is LZ compressed unless
+// that wouldn't make it smaller. Every number is little endian.
+//
+//   0  char[8]  "8080SAVE"
+//   8  uint16   version
+//  10  uint16   compression (0 = stored, 1 = LZ)
+//  12  uint32   payload size
+//  16  uint32   stored size (bytes following the header)
+//  20  uint32   CRC-32 of the payload
+//  24  uint32   CRC-32 of bytes 0 - 23
+//
+// Version 3 payload: A B C D E H L, SP PC, PSW flags byte, int_enable, halted, cycles,
+// nextInterrupt, nextVector, idleCycles, sound ports 3 and 5, shift register and its offset,
+// then all 64 KiB of RAM. Older versions are still loaded: version 2 has no shift register and
+// version 1 also has the flags packed Z S P CY AC from bit 0.
+const uint16_t SAVE_STATE_VERSION = 3;
+const std::size_t SAVE_STATE_HEADER_SIZE = 28;
+// Registers, flags and interrupt state, then Machine's counters, the sound ports and the shift
+// register
+const std::size_t SAVE_STATE_PAYLOAD_SIZE = 7 + 2 * 2 + 3 + 8 + 8 + 1 + 8 + 2 + 3 + RAM_SIZE;
+
+// LZ77 in the style of LZ4 blocks; decompress() returns false on corrupt input instead of
+// reading or writing out of bounds
+std::vector<uint8_t> compress(const uint8_t *data, std::size_t size);
+bool decompress(const uint8_t *data, std::size_t size, uint8_t *output, std::size_t outputSize);
+
+// The cheap half of saving, done on the emulation thread: copies the machine into a payload
+void takeSnapshot(const Machine &machine, std::vector<uint8_t> &payload);
+// Throws if the payload is the wrong size
+void restoreSnapshot(Machine &machine, const std::vector<uint8_t> &payload);
+// Compresses a payload into a complete file image
+std::vector<uint8_t> encodeState(const std::vector<uint8_t> &payload);
+// Checks the header and checksums and returns the payload, throws on anything wrong
+std::vector<uint8_t> decodeState(const std::vector<uint8_t> &file);
+
+// Everything emulating changes, kept in memory to rewind to within a session: the registers as
+// they are (flags still lazy), the clock, the board, the idle loop and RAM. Nothing is encoded,
+// so saving is a 64 KiB copy and rewinding only copies back the 4 KiB pages that changed, a few
+// microseconds each. Sound, the inputs and whatever the machine is attached to aren't included.
+struct MachineState {
+	uint8_t A = 0x00;
+	uint16_t BC = 0x0000;
+	uint16_t DE = 0x0000;
+	uint16_t HL = 0x0000;
+	uint16_t SP = 0x0000;
+	uint16_t PC = 0x0000;
+	Flags f;
+	uint8_t int_enable = 0x00;
+	uint8_t halted = 0x00;
+	uint64_t cycles = 0;
+	uint64_t nextInterrupt = 0;
+	int nextVector = 1;
+	uint64_t idleCycles = 0;
+	IdleLoop idle;
+	uint64_t loopCycles = 0;
+	uint16_t shift = 0x0000;
+	uint8_t shiftOffset = 0;
+	uint8_t port3 = 0x00;
+	uint8_t port5 = 0x00;
+	std::vector<uint8_t> ram = std::vector<uint8_t>(RAM_SIZE);
+};
+
+void saveMachine(const Machine &machine, MachineState &state);
+void rewindMachine(Machine &machine, const MachineState &state);
+
+void saveState(const Machine &machine, const std::string &fileName);
+void loadState(Machine &machine, const std::string &fileName);
+
+// Compresses and writes snapshots on a background thread, so checkpointing a machine only
+// costs the emulation thread a copy of its state. Files are written to a temporary name and
+// renamed, so a checkpoint is never left half written. Only the newest state waiting for each
+// file is kept, so a slow disk holds back one state per file rather than a growing queue.
+struct StateWriter {
+	struct Job {
+		std::vector<uint8_t> payload;
+		std::string fileName;
+	};
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::deque<Job> jobs; // At most one for each file
+	std::vector<uint8_t> spare; // A written payload's memory, for the next snapshot to reuse
+	bool stopping = false;
+	uint64_t written = 0; // Files finished, guarded by mutex
+	uint64_t failed = 0;
+};
+
+void startStateWriter(StateWriter &writer);
+void queueSave(StateWriter &writer, const Machine &machine, const std::string &fileName);
+// Finishes every queued save before returning
+void stopStateWriter(StateWriter &writer);
+
+#endif
@@ -0,0 +1,281 @@
+// Checks every ALU instruction against a reference model written from the 8080 manual, for
+// every operand pair and every combination of incoming flags, with the sweep spread across
+// all cores. Each register and immediate form is run separately since each is its own case
+// in emulate8080().
+//
+// g++ -std=c++14 -O2 -pthread cpu.cpp test_alu.cpp -o test_alu
+#include "cpu.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+const uint16_t CODE = 0x0100;
+const uint16_t OPERAND = 0x2000; // Where HL points for the M forms
+const int REPORT_LIMIT = 5; // Mismatches printed per opcode
+const char *const SOURCES[8] = {"B", "C", "D", "E", "H", "L", "M", "A"};
+const char *const OPERATIONS[8] = {"ADD", "ADC", "SUB", "SBB", "ANA", "XRA", "ORA", "CMP"};
+const char *const IMMEDIATES[8] = {"ADI", "ACI", "SUI", "SBI", "ANI", "XRI", "ORI", "CPI"};
+const uint8_t FLAG_ORDER[5] = {FLAG_Z, FLAG_S, FLAG_P, FLAG_CY, FLAG_AC};
+const int FLAG_COMBINATIONS = 1 << 5;
+
+// Flags in the reference model's own order, bit i is FLAG_ORDER[i]
+struct State {
+	uint8_t value; // A, or the register for INR and DCR
+	uint8_t flags;
+};
+
+enum FlagIndex {
+	Z,
+	S,
+	P,
+	CY,
+	AC
+};
+
+static bool flag(uint8_t flags, int index) {
+	return (flags >> index) & 1;
+}
+
+static uint8_t withFlag(uint8_t flags, int index, bool value) {
+	return (flags & ~(1 << index)) | (value << index);
+}
+
+static bool evenParity(uint8_t value) {
+	int ones = 0;
+	for(int bit = 0; bit < 8; bit++) {
+		ones += (value >> bit) & 1;
+	}
+	return ones % 2 == 0;
+}
+
+static uint8_t resultFlags(uint8_t flags, uint8_t result) {
+	flags = withFlag(flags, Z, result == 0);
+	flags = withFlag(flags, S, result & 0x80);
+	return withFlag(flags, P, evenParity(result));
+}
+
+// The reference model. Subtraction is done the way the 8080 does it, adding the complement,
+// which is where AC comes from; CY is the inverted carry, i.e. the borrow.
+static State reference(int operation, uint8_t a, uint8_t operand, uint8_t flags) {
+	bool carry = flag(flags, CY);
+	State state = {a, flags};
+	switch(operation) {
+		case 0: // ADD
+		case 1: { // ADC
+			int in = operation == 1 && carry;
+			state.value = a + operand + in;
+			state.flags = withFlag(state.flags, CY, a + operand + in > 0xff);
+			state.flags = withFlag(state.flags, AC, (a & 0x0f) + (operand & 0x0f) + in > 0x0f);
+			break;
+		}
+		case 2: // SUB
+		case 3: // SBB
+		case 7: { // CMP
+			int borrow = operation == 3 && carry;
+			uint8_t result = a - operand - borrow;
+			state.value = operation == 7 ? a : result;
+			state.flags = withFlag(state.flags, CY, a < operand + borrow);
+			state.flags = withFlag(state.flags, AC, (a & 0x0f) + (~operand & 0x0f) + !borrow > 0x0f);
+			return {state.value, resultFlags(state.flags, result)};
+		}
+		case 4: // ANA
+			state.value = a & operand;
+			state.flags = withFlag(state.flags, CY, false);
+			state.flags = withFlag(state.flags, AC, ((a | operand) & 0x08) != 0);
+			break;
+		case 5: // XRA
+		case 6: // ORA
+			state.value = operation == 5 ? a ^ operand : a | operand;
+			state.flags = withFlag(state.flags, CY, false);
+			state.flags = withFlag(state.flags, AC, false);
+			break;
+	}
+	state.flags = resultFlags(state.flags, state.value);
+	return state;
+}
+
+static State referenceIncrement(bool increment, uint8_t value, uint8_t flags) {
+	uint8_t result = increment ? value + 1 : value - 1;
+	flags = withFlag(flags, AC, increment ? (value & 0x0f) == 0x0f : (value & 0x0f) != 0);
+	return {result, resultFlags(flags, result)};
+}
+
+static State referenceDAA(uint8_t a, uint8_t flags) {
+	uint8_t correction = 0;
+	bool carry = flag(flags, CY);
+	if((a & 0x0f) > 9 || flag(flags, AC)) {
+		correction |= 0x06;
+	}
+	if((a >> 4) > 9 || carry || ((a >> 4) >= 9 && (a & 0x0f) > 9)) {
+		correction |= 0x60;
+		carry = true;
+	}
+	uint8_t result = a + correction;
+	flags = withFlag(flags, AC, (a & 0x0f) + (correction & 0x0f) > 0x0f);
+	flags = withFlag(flags, CY, carry);
+	return {result, resultFlags(flags, result)};
+}
+
+static State referenceAccumulator(uint8_t opCode, uint8_t a, uint8_t flags) {
+	bool carry = flag(flags, CY);
+	switch(opCode) {
+		case 0x07: // RLC
+			return {(uint8_t) (a << 1 | a >> 7), withFlag(flags, CY, a & 0x80)};
+		case 0x0f: // RRC
+			return {(uint8_t) (a >> 1 | a << 7), withFlag(flags, CY, a & 0x01)};
+		case 0x17: // RAL
+			return {(uint8_t) (a << 1 | carry), withFlag(flags, CY, a & 0x80)};
+		case 0x1f: // RAR
+			return {(uint8_t) (a >> 1 | carry << 7), withFlag(flags, CY, a & 0x01)};
+		case 0x27: // DAA
+			return referenceDAA(a, flags);
+		case 0x2f: // CMA
+			return {(uint8_t) ~a, flags};
+		case 0x37: // STC
+			return {a, withFlag(flags, CY, true)};
+		case 0x3f: // CMC
+			return {a, withFlag(flags, CY, !carry)};
+	}
+	return {a, flags};
+}
+
+static uint8_t &reg(CPU &cpu, int index) {
+	uint8_t *registers[8] = {&cpu.B, &cpu.C, &cpu.D, &cpu.E, &cpu.H, &cpu.L, &cpu.RAM[OPERAND], &cpu.A};
+	return *registers[index];
+}
+
+static void setTestFlags(CPU &cpu, uint8_t flags) {
+	for(int i = 0; i < 5; i++) {
+		setFlag(cpu.f, FLAG_ORDER[i], flag(flags, i));
+	}
+}
+
+static uint8_t testFlags(const CPU &cpu) {
+	uint8_t flags = 0;
+	for(int i = 0; i < 5; i++) {
+		flags = withFlag(flags, i, getFlag(cpu.f, FLAG_ORDER[i]));
+	}
+	return flags;
+}
+
+struct Test {
+	uint8_t opCode;
+	std::string name;
+	int operation; // 0 - 7 ALU operations, 8 INR, 9 DCR, 10 everything that only touches A and flags
+	int source; // Register index (see SOURCES), 8 for immediate
+};
+
+struct Results {
+	std::mutex mutex;
+	std::vector<uint64_t> failures;
+	std::vector<uint64_t> cases;
+};
+
+static void report(Results &results, size_t test, const Test &t, uint8_t a, uint8_t operand, uint8_t flags,
+                   State expected, State actual) {
+	std::lock_guard<std::mutex> lock(results.mutex);
+	if(results.failures[test]++ < REPORT_LIMIT) {
+		printf("%-8s A=%02x operand=%02x flags in=%02x: expected %02x flags %02x, got %02x flags %02x "
+		       "(flag bits Z S P CY AC)\n",
+		       t.name.c_str(), a, operand, flags, expected.value, expected.flags, actual.value, actual.flags);
+	}
+}
+
+// One work unit: a test with one starting value of A (or of the register for INR and DCR)
+static void runUnit(unique_ptr<CPU> &cpu, Results &results, size_t test, const Test &t, uint8_t a) {
+	uint64_t cases = 0;
+	bool binary = t.operation < 8;
+	int operands = binary && t.source != 7 ? 256 : 1; // ADD A and friends use A as the operand
+	for(int operand = 0; operand < operands; operand++) {
+		for(uint8_t flags = 0; flags < FLAG_COMBINATIONS; flags++) {
+			cpu->A = a;
+			cpu->HL = OPERAND;
+			cpu->PC = CODE;
+			cpu->RAM[CODE] = t.opCode;
+			cpu->RAM[CODE + 1] = (uint8_t) operand;
+			State expected;
+			if(binary) {
+				if(t.source < 8 && t.source != 7) {
+					reg(*cpu, t.source) = (uint8_t) operand;
+				}
+				expected = reference(t.operation, a, t.source == 7 ? a : (uint8_t) operand, flags);
+			} else if(t.operation == 10) {
+				expected = referenceAccumulator(t.opCode, a, flags);
+			} else {
+				reg(*cpu, t.source) = a;
+				expected = referenceIncrement(t.operation == 8, a, flags);
+			}
+			setTestFlags(*cpu, flags);
+
+			emulate8080(cpu);
+			State actual = {binary || t.operation == 10 ? cpu->A : reg(*cpu, t.source), testFlags(*cpu)};
+			if(actual.value != expected.value || actual.flags != expected.flags) {
+				report(results, test, t, a, (uint8_t) operand, flags, expected, actual);
+			}
+			cases++;
+		}
+	}
+	std::lock_guard<std::mutex> lock(results.mutex);
+	results.cases[test] += cases;
+}
+
+static std::vector<Test> allTests() {
+	std::vector<Test> tests;
+	for(int operation = 0; operation < 8; operation++) {
+		for(int source = 0; source < 8; source++) {
+			tests.push_back({(uint8_t) (0x80 | operation << 3 | source), std::string(OPERATIONS[operation]) + " " + SOURCES[source], operation, source});
+		}
+		tests.push_back({(uint8_t) (0xc6 | operation << 3), IMMEDIATES[operation], operation, 8});
+	}
+	for(int destination = 0; destination < 8; destination++) {
+		tests.push_back({(uint8_t) (0x04 | destination << 3), std::string("INR ") + SOURCES[destination], 8, destination});
+		tests.push_back({(uint8_t) (0x05 | destination << 3), std::string("DCR ") + SOURCES[destination], 9, destination});
+	}
+	const char *const accumulator[8] = {"RLC", "RRC", "RAL", "RAR", "DAA", "CMA", "STC", "CMC"};
+	for(int i = 0; i < 8; i++) {
+		tests.push_back({(uint8_t) (0x07 | i << 3), accumulator[i], 10, 7});
+	}
+	return tests;
+}
+
+int main() {
+	std::vector<Test> tests = allTests();
+	Results results;
+	results.failures.resize(tests.size());
+	results.cases.resize(tests.size());
+
+	std::atomic<size_t> next{0};
+	size_t units = tests.size() * 256;
+	unsigned threadCount = std::max(1u, std::thread::hardware_concurrency());
+	std::vector<std::thread> threads;
+	for(unsigned i = 0; i < threadCount; i++) {
+		threads.emplace_back([&] {
+			unique_ptr<CPU> cpu(new CPU());
+			for(size_t unit = next++; unit < units; unit = next++) {
+				runUnit(cpu, results, unit / 256, tests[unit / 256], (uint8_t) (unit % 256));
+			}
+		});
+	}
+	for(std::thread &thread : threads) {
+		thread.join();
+	}
+
+	uint64_t cases = 0;
+	int failedTests = 0;
+	for(size_t i = 0; i < tests.size(); i++) {
+		cases += results.cases[i];
+		if(results.failures[i]) {
+			failedTests++;
+			printf("%-8s %llu of %llu cases wrong\n", tests[i].name.c_str(), (unsigned long long) results.failures[i],
+			       (unsigned long long) results.cases[i]);
+		}
+	}
+	printf("%zu instructions, %llu cases on %u threads: %s\n", tests.size(), (unsigned long long) cases, threadCount,
+	       failedTests ? "FAIL" : "PASS");
+	return failedTests ? 1 : 0;
+}
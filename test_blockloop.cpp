@@ -0,0 +1,164 @@
+// Runs copy and fill loops from random starting states both through runBlockLoop() and one
+// instruction at a time, stopping both at the same random cycles the way runUntil() stops for
+// interrupts, and checks the registers, flags, memory and cycles match at every stop. Loops
+// that have to be left to the interpreter are checked never to run natively.
+//
+// g++ -std=c++14 -O2 cpu.cpp blockloop.cpp test_blockloop.cpp -o test_blockloop
+#include "blockloop.h"
+
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+const uint16_t CODE = 0x0100;
+const uint16_t DATA = 0x4000; // Random bytes, where the pairs point
+const uint32_t DATA_SIZE = 0x4000;
+const int TRIALS = 200;
+const uint64_t TRIAL_CYCLES = 400000;
+const uint32_t MAX_STOP = 20000; // Cycles between stops
+
+enum CodePages {
+	MARK_CODE,
+	MARK_NONE,
+	MARK_DATA
+};
+
+struct Shape {
+	const char *name;
+	std::vector<uint8_t> code; // At CODE and followed by HLT, the JNZ's target is CODE
+	bool native; // Whether it should ever run natively
+	int from; // Pairs (0 BC, 1 DE, 2 HL) copied from and to, sometimes set up to overlap
+	int to;
+	CodePages pages;
+	int hl; // Fixed start values, -1 for random
+	int b;
+};
+
+static std::vector<Shape> allShapes() {
+	return {
+		{"LDAX D / MOV M,A / INX H / INX D / DCR B", {0x1a, 0x77, 0x23, 0x13, 0x05, 0xc2, 0x00, 0x01}, true, 1, 2,
+		 MARK_CODE, -1, -1},
+		{"MOV A,M / STAX D / INX D / INX H / DCR C", {0x7e, 0x12, 0x13, 0x23, 0x0d, 0xc2, 0x00, 0x01}, true, 2, 1,
+		 MARK_CODE, -1, -1},
+		{"LDAX B / INX B / STAX D / INX D / DCR L", {0x0a, 0x03, 0x12, 0x13, 0x2d, 0xc2, 0x00, 0x01}, true, 0, 1,
+		 MARK_CODE, -1, -1},
+		{"MOV A,M / STAX D / DCX H / DCX D / DCX B / MOV A,B / ORA C",
+		 {0x7e, 0x12, 0x2b, 0x1b, 0x0b, 0x78, 0xb1, 0xc2, 0x00, 0x01}, true, 2, 1, MARK_CODE, -1, 0x10},
+		{"MVI M,01 / INX H / DCR B", {0x36, 0x01, 0x23, 0x05, 0xc2, 0x00, 0x01}, true, -1, -1, MARK_CODE, -1, -1},
+		{"MVI M,00 / INX H / MOV A,H / CPI 80", {0x36, 0x00, 0x23, 0x7c, 0xfe, 0x80, 0xc2, 0x00, 0x01}, true, -1, -1,
+		 MARK_CODE, -1, -1},
+		{"DCX H / MVI M,20 / MOV A,L / CPI 00", {0x2b, 0x36, 0x20, 0x7d, 0xfe, 0x00, 0xc2, 0x00, 0x01}, true, -1, -1,
+		 MARK_CODE, -1, -1},
+		{"STAX D / INX D / DCR C", {0x12, 0x13, 0x0d, 0xc2, 0x00, 0x01}, true, -1, -1, MARK_CODE, -1, -1},
+		{"MOV M,C / DCX H / DCR B", {0x71, 0x2b, 0x05, 0xc2, 0x00, 0x01}, true, -1, -1, MARK_CODE, -1, -1},
+		{"LDAX D / ADD M / MOV M,A / INX H / INX D / DCR B", {0x1a, 0x86, 0x77, 0x23, 0x13, 0x05, 0xc2, 0x00, 0x01},
+		 false, 1, 2, MARK_CODE, -1, -1},
+		{"MOV M,B / INX H / DCR B", {0x70, 0x23, 0x05, 0xc2, 0x00, 0x01}, false, -1, -1, MARK_CODE, -1, -1},
+		{"DCX D / STAX D / MOV A,E / CPI 00", {0x1b, 0x12, 0x7b, 0xfe, 0x00, 0xc2, 0x00, 0x01}, false, -1, -1,
+		 MARK_CODE, -1, -1},
+		{"MVI M,01 / INX H / DCR B on a code page", {0x36, 0x01, 0x23, 0x05, 0xc2, 0x00, 0x01}, false, -1, -1,
+		 MARK_DATA, -1, -1},
+		// Turns its own MVI into RLC on the second pass
+		{"MVI M,07 / DCX H / DCR B over itself", {0x36, 0x07, 0x2b, 0x05, 0xc2, 0x00, 0x01}, false, -1, -1, MARK_NONE,
+		 CODE + 1, 3},
+	};
+}
+
+static bool sameState(const CPU &a, const CPU &b) {
+	return a.A == b.A && a.BC == b.BC && a.DE == b.DE && a.HL == b.HL && a.SP == b.SP && a.PC == b.PC &&
+	       getFlags(a.f) == getFlags(b.f) && a.halted == b.halted && memcmp(a.RAM, b.RAM, RAM_SIZE) == 0;
+}
+
+static void printState(const char *name, const CPU &cpu, uint64_t cycles) {
+	printf("  %-11s A=%02x BC=%04x DE=%04x HL=%04x PC=%04x flags=%02x cycles=%llu\n", name, cpu.A, cpu.BC, cpu.DE,
+	       cpu.HL, cpu.PC, getFlags(cpu.f), (unsigned long long) cycles);
+}
+
+static uint16_t &pair(CPU &cpu, int p) {
+	return p == 0 ? cpu.BC : p == 1 ? cpu.DE : cpu.HL;
+}
+
+// Returns whether both ways agreed throughout, and adds up the cycles run natively
+static bool runTrial(const Shape &shape, std::mt19937 &random, uint64_t &nativeCycles) {
+	unique_ptr<CPU> interpreted(new CPU());
+	unique_ptr<CPU> native(new CPU());
+	CPU &start = *interpreted;
+	std::memset(start.RAM, 0x00, RAM_SIZE);
+	for(uint32_t i = 0; i < DATA_SIZE; i++) {
+		start.RAM[DATA + i] = (uint8_t) random();
+	}
+	std::copy(shape.code.begin(), shape.code.end(), start.RAM + CODE);
+	start.RAM[CODE + shape.code.size()] = 0x76; // HLT
+	start.A = (uint8_t) random();
+	start.BC = DATA + random() % DATA_SIZE;
+	start.DE = DATA + random() % DATA_SIZE;
+	start.HL = DATA + random() % DATA_SIZE;
+	setFlags(start.f, (uint8_t) random());
+	if(shape.from >= 0 && random() % 3 == 0) {
+		pair(start, shape.to) = pair(start, shape.from) + random() % 7 - 3;
+	}
+	if(shape.hl >= 0) {
+		start.HL = shape.hl;
+	}
+	if(shape.b >= 0) {
+		start.B = shape.b;
+	}
+	start.SP = 0xff00;
+	start.PC = CODE;
+
+	CPU &copy = *native;
+	copy.A = start.A;
+	copy.BC = start.BC;
+	copy.DE = start.DE;
+	copy.HL = start.HL;
+	copy.SP = start.SP;
+	copy.PC = start.PC;
+	copy.f = start.f;
+	std::memcpy(copy.RAM, start.RAM, RAM_SIZE);
+	BlockLoops loops;
+	if(shape.pages == MARK_CODE) {
+		markCode(loops, CODE, (uint32_t) shape.code.size());
+	} else if(shape.pages == MARK_DATA) {
+		markCode(loops, DATA, RAM_SIZE - DATA); // Fills may run past the random bytes
+	}
+
+	uint64_t interpretedCycles = 0;
+	uint64_t cycles = 0;
+	uint64_t until = 0;
+	while(until < TRIAL_CYCLES && !(interpreted->halted && native->halted)) {
+		until += 1 + random() % MAX_STOP;
+		while(interpretedCycles < until && !interpreted->halted) {
+			interpretedCycles += emulate8080(interpreted);
+		}
+		while(cycles < until && !native->halted) {
+			int taken = atBlockLoop(*native, loops) ? runBlockLoop(native, loops, until - cycles) : 0;
+			cycles += taken ? taken : emulate8080(native);
+		}
+		if(interpretedCycles != cycles || !sameState(*interpreted, *native)) {
+			printf("%s: differs after stopping at %llu\n", shape.name, (unsigned long long) until);
+			printState("interpreted", *interpreted, interpretedCycles);
+			printState("native", *native, cycles);
+			return false;
+		}
+	}
+	nativeCycles += loops.cycles;
+	return true;
+}
+
+int main() {
+	std::mt19937 random(8080);
+	int failed = 0;
+	for(const Shape &shape : allShapes()) {
+		uint64_t nativeCycles = 0;
+		bool same = true;
+		for(int trial = 0; trial < TRIALS && same; trial++) {
+			same = runTrial(shape, random, nativeCycles);
+		}
+		bool ok = same && (nativeCycles != 0) == shape.native;
+		printf("%-60s %s, %llu cycles native\n", shape.name, ok ? "ok" : "FAILED", (unsigned long long) nativeCycles);
+		failed += !ok;
+	}
+	printf("%s\n", failed ? "FAIL" : "PASS");
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,159 @@
+# Tests the i8080 Python module: cpudiag.bin with BDOS calls handled in Python, writes through
+# the RAM view reaching the CPU, the framebuffer, snapshots, run() letting other threads in, and
+# the vectorized Space Invaders games.
+#
+# PYTHONPATH=build python3 test_i8080.py cpudiag.bin invaders
+import sys
+import threading
+
+import i8080
+
+failed = False
+
+
+def check(ok, what):
+	global failed
+	print(what + ": " + ("ok" if ok else "FAILED"))
+	failed = failed or not ok
+
+
+def boot(machine, program):
+	machine.load(bytes([0x76, 0, 0, 0, 0, 0xd3, 0x00, 0xc9])) # HLT, then OUT 0 / RET for BDOS at 5
+	machine.load(program, 0x100)
+	machine.sp = 0xff00
+	machine.pc = 0x100
+	machine.halted = 0
+
+
+def runToHalt(machine):
+	while not machine.halted:
+		machine.run(100000)
+
+
+with open(sys.argv[1] if len(sys.argv) > 1 else "cpudiag.bin", "rb") as programFile:
+	program = programFile.read()
+
+machine = i8080.Machine()
+output = []
+
+
+def bdos(port, value):
+	if machine.c == 2:
+		output.append(chr(machine.e))
+	elif machine.c == 9:
+		ram = machine.ram
+		address = machine.d << 8 | machine.e
+		end = bytes(ram[address:]).index(b"$")
+		output.append(bytes(ram[address:address + end]).decode("ascii"))
+
+
+machine.set_io(output=bdos)
+boot(machine, program)
+runToHalt(machine)
+print("".join(output))
+check("CPU IS OPERATIONAL" in "".join(output), "cpudiag")
+
+# MVI A,42 / HLT poked in through the view
+ram = machine.ram
+check(ram.readonly is False and len(ram) == 0x10000, "RAM view")
+ram[0x200:0x203] = bytes([0x3e, 0x42, 0x76])
+machine.pc = 0x200
+machine.halted = 0
+machine.run(20)
+check(machine.a == 0x42 and machine.halted, "writes through the view")
+machine.a = 0x00
+check(machine.ram[0x201] == 0x42 and machine.a == 0x00, "reads through the view")
+
+# Undocumented opcodes run as the 8080 aliases them, DD as CALL and D9 as RET, instead of stopping
+machine.load(bytes([0xdd, 0x10, 0x02, 0x76]), 0x200)
+machine.load(bytes([0xd9]), 0x210)
+machine.sp = 0xff00
+machine.pc = 0x200
+machine.halted = 0
+machine.run(100)
+check(machine.halted and machine.pc == 0x204 and machine.sp == 0xff00, "undocumented opcodes")
+
+ram[0x2400] = 0x01 # Bottom left pixel
+machine.render()
+frame = machine.framebuffer
+check(frame.shape == (i8080.SCREEN_HEIGHT, i8080.SCREEN_WIDTH, 4) and frame.readonly, "framebuffer view")
+check([frame[255, 0, i] for i in range(4)] == [0xff, 0xff, 0xff, 0xff] and
+      [frame[254, 0, i] for i in range(4)] == [0, 0, 0, 0xff], "render")
+
+# Snapshot partway through cpudiag, then run the rest twice
+output = []
+boot(machine, program)
+machine.run(2000)
+snapshot = machine.snapshot()
+runToHalt(machine)
+first = ("".join(output), machine.cycles)
+output = []
+machine.restore(snapshot)
+runToHalt(machine)
+check("CPU IS OPERATIONAL" in first[0] and ("".join(output), machine.cycles) == first, "snapshot and restore")
+try:
+	machine.restore(snapshot[:-1])
+	check(False, "truncated snapshot")
+except ValueError:
+	check(True, "truncated snapshot")
+
+
+# An exception in a handler comes out of run()
+def broken(port, value):
+	raise KeyError(port)
+
+
+machine.set_io(output=broken)
+boot(machine, program)
+try:
+	runToHalt(machine)
+	check(False, "handler exception")
+except KeyError:
+	check(True, "handler exception")
+
+# While one thread is in run(), this one keeps going and is kept off the machine. The loop
+# (INR M / JMP) writes memory every pass, so it isn't skipped as idle.
+machine.set_io()
+machine.load(bytes([0x34, 0xc3, 0x00, 0x02]), 0x200)
+machine.pc = 0x200
+machine.halted = 0
+runner = threading.Thread(target=machine.run, args=(2000000000,))
+runner.start()
+blocked = False
+while runner.is_alive() and not blocked:
+	try:
+		machine.pc
+	except RuntimeError:
+		blocked = True
+runner.join()
+check(blocked, "run() releases the GIL")
+
+# The views are made once and see every step
+with open(sys.argv[2] if len(sys.argv) > 2 else "invaders", "rb") as romFile:
+	rom = romFile.read()
+games = i8080.VecEnv(rom, 4, threads=2)
+pixels = games.pixels
+scores = games.scores
+rewards = games.rewards
+dones = games.dones
+check(len(games) == 4 and pixels.shape == (4, i8080.OBSERVATION_HEIGHT, i8080.OBSERVATION_WIDTH), "observation views")
+check(scores.format == "i" and scores.tolist() == [0, 0, 0, 0] and games.lives.tolist() == [2, 2, 2, 2], "started")
+total = [0, 0, 0, 0]
+ended = 0
+for step in range(3000):
+	fire = i8080.ACTION_FIRE if step // 4 % 2 else 0
+	games.step(bytes([fire, fire | i8080.ACTION_LEFT, fire | i8080.ACTION_RIGHT, 0]))
+	total = [t + r for t, r in zip(total, rewards.tolist())]
+	ended += sum(dones.tolist())
+check(total[0] > 0 and total[3] == 0 and ended > 0, "stepping")
+check(sum(pixels.tobytes()) > 0, "pixels")
+try:
+	games.step(bytes(3))
+	check(False, "wrong number of actions")
+except ValueError:
+	check(True, "wrong number of actions")
+games.reset()
+check(scores.tolist() == [0, 0, 0, 0] and dones.tolist() == [0, 0, 0, 0], "reset")
+
+print("FAIL" if failed else "PASS")
+sys.exit(1 if failed else 0)
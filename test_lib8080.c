@@ -0,0 +1,369 @@
+/* Runs cpudiag.bin through the C interface only, the way a host would: the ROM comes from a
+ * buffer, BDOS calls are an OUT the host handles, and a snapshot taken partway through is
+ * restored and run again to the same result. Small programs check that the stack and PC wrap
+ * around the top of memory and that the undocumented opcodes run as their aliases. Then checks
+ * that vectorized Space Invaders games come out the same however many threads step them, and
+ * that machines sharing a ROM image run the same as ones with their own copy. Compiled as C to keep lib8080.h honest.
+ *
+ * cc -c test_lib8080.c && g++ -pthread lib8080.cpp cpu.cpp blockloop.cpp machine.cpp audio.cpp savestate.cpp video.cpp vecenv.cpp rom.cpp warmstart.cpp test_lib8080.o -o test_lib8080
+ * ./test_lib8080 cpudiag.bin invaders */
+#include "lib8080.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TPA 0x0100
+#define BDOS_PORT 0x00
+#define OUTPUT_SIZE 4096
+
+struct Host {
+	lib8080_machine *machine;
+	char output[OUTPUT_SIZE];
+	size_t length;
+};
+
+static void print(struct Host *host, char c) {
+	if(host->length < OUTPUT_SIZE - 1) {
+		host->output[host->length++] = c;
+		host->output[host->length] = '\0';
+	}
+}
+
+/* CP/M console output: function 2 prints E, function 9 the $ terminated string at DE */
+static void bdos(void *context, uint8_t port, uint8_t value) {
+	struct Host *host = (struct Host *) context;
+	const uint8_t *memory = lib8080_memory(host->machine);
+	lib8080_registers registers;
+	(void) value;
+	if(port != BDOS_PORT) {
+		return;
+	}
+	lib8080_get_registers(host->machine, &registers);
+	if(registers.c == 2) {
+		print(host, (char) registers.e);
+	} else if(registers.c == 9) {
+		uint16_t address = (uint16_t) (registers.d << 8 | registers.e);
+		for(; memory[address] != '$'; address++) {
+			print(host, (char) memory[address]);
+		}
+	}
+}
+
+static void boot(struct Host *host, const uint8_t *program, size_t size) {
+	static const uint8_t PAGE_ZERO[8] = {0x76, 0, 0, 0, 0, 0xd3, BDOS_PORT, 0xc9}; /* HLT, then OUT BDOS_PORT / RET at 5 */
+	lib8080_registers registers;
+	memset(&registers, 0, sizeof(registers));
+	registers.sp = 0xff00; /* Holds return address 0x0000 */
+	registers.pc = TPA;
+	if(lib8080_load_rom(host->machine, PAGE_ZERO, sizeof(PAGE_ZERO), 0) != LIB8080_OK ||
+	   lib8080_load_rom(host->machine, program, size, TPA) != LIB8080_OK) {
+		fprintf(stderr, "Loading failed\n");
+		exit(1);
+	}
+	lib8080_set_registers(host->machine, &registers);
+	lib8080_set_io(host->machine, NULL, bdos, host);
+	host->length = 0;
+	host->output[0] = '\0';
+}
+
+/* Until the HLT at 0x0000 */
+static void finish(struct Host *host) {
+	lib8080_registers registers;
+	do {
+		lib8080_run(host->machine, 100000);
+		lib8080_get_registers(host->machine, &registers);
+	} while(!registers.halted);
+}
+
+static int check(int ok, const char *what) {
+	printf("%s: %s\n", what, ok ? "ok" : "FAILED");
+	return ok;
+}
+
+static size_t readFile(const char *fileName, uint8_t *data, size_t size) {
+	size_t read;
+	FILE *file = fopen(fileName, "rb");
+	if(!file) {
+		fprintf(stderr, "Could not open file!\n");
+		exit(1);
+	}
+	read = fread(data, 1, size, file);
+	fclose(file);
+	return read;
+}
+
+#define GAMES 6
+#define STEPS 3000
+#define PIXELS (LIB8080_OBSERVATION_WIDTH * LIB8080_OBSERVATION_HEIGHT)
+
+/* Fire on and off, and every third game also moves left. Returns the total reward, or -1 if
+ * games given the same actions ever differ. */
+static long playGames(const uint8_t *rom, size_t size, int threads, int *dones) {
+	lib8080_vecenv *env = lib8080_vecenv_create(rom, size, GAMES, threads);
+	lib8080_observations observations;
+	uint8_t actions[GAMES];
+	long rewards = 0;
+	int step;
+	int game;
+	*dones = 0;
+	if(!env) {
+		return -1;
+	}
+	lib8080_vecenv_observations(env, &observations);
+	for(step = 0; step < STEPS; step++) {
+		for(game = 0; game < GAMES; game++) {
+			actions[game] = ((step / 4) % 2 ? LIB8080_ACTION_FIRE : 0) | (game % 3 == 0 ? LIB8080_ACTION_LEFT : 0);
+		}
+		lib8080_vecenv_step(env, actions);
+		for(game = 0; game < GAMES; game++) {
+			const uint8_t *pixels = observations.pixels + game * PIXELS;
+			const uint8_t *same = observations.pixels + (game % 3) * PIXELS;
+			if(memcmp(pixels, same, PIXELS) != 0 || observations.scores[game] != observations.scores[game % 3]) {
+				lib8080_vecenv_destroy(env);
+				return -1;
+			}
+			rewards += observations.rewards[game];
+			*dones += observations.dones[game];
+		}
+	}
+	lib8080_vecenv_destroy(env);
+	return rewards;
+}
+
+/* Two machines mapping the ROM and one with a copy run the attract mode alike, and a write to
+ * the ROM only reaches the machine making it */
+static int shareRom(const uint8_t *rom, size_t size) {
+	lib8080_rom *shared = lib8080_rom_create(rom, size, 0);
+	lib8080_rom *unaligned = lib8080_rom_create(rom, 0x1000, 0x0123);
+	lib8080_machine *machines[3];
+	int same = shared && unaligned && lib8080_rom_create(rom, 2, 0xffff) == NULL;
+	int i;
+	for(i = 0; i < 3; i++) {
+		machines[i] = lib8080_create();
+		same &= (i < 2 ? lib8080_map_rom(machines[i], shared) : lib8080_load_rom(machines[i], rom, size, 0)) == LIB8080_OK;
+	}
+	lib8080_rom_destroy(shared); /* The machines keep it */
+	for(i = 0; i < 3 && same; i++) {
+		lib8080_run(machines[i], 20000000);
+	}
+	same &= memcmp(lib8080_memory(machines[0]), lib8080_memory(machines[2]), 0x10000) == 0 &&
+	        memcmp(lib8080_memory(machines[1]), lib8080_memory(machines[2]), 0x10000) == 0 &&
+	        lib8080_cycles(machines[0]) == lib8080_cycles(machines[2]);
+	lib8080_memory(machines[0])[0x0000] ^= 0xff;
+	same &= lib8080_memory(machines[0])[0x0000] != rom[0] && lib8080_memory(machines[1])[0x0000] == rom[0];
+
+	same &= lib8080_map_rom(machines[1], unaligned) == LIB8080_OK &&
+	        memcmp(lib8080_memory(machines[1]) + 0x0123, rom, 0x1000) == 0 && lib8080_memory(machines[1])[0x0122] == rom[0x0122];
+	for(i = 0; i < 3; i++) {
+		lib8080_destroy(machines[i]);
+	}
+	lib8080_rom_destroy(unaligned);
+	return same;
+}
+
+/* Running ahead leaves the machine exactly as plain runs would, and shows what they reach later */
+static int runAhead(const uint8_t *rom, size_t size) {
+	static uint8_t ahead[LIB8080_SCREEN_WIDTH * LIB8080_SCREEN_HEIGHT * 4];
+	static uint8_t later[LIB8080_SCREEN_WIDTH * LIB8080_SCREEN_HEIGHT * 4];
+	lib8080_machine *machines[2];
+	int same = 1;
+	int i;
+	for(i = 0; i < 2; i++) {
+		machines[i] = lib8080_create();
+		same &= lib8080_load_rom(machines[i], rom, size, 0) == LIB8080_OK;
+	}
+	for(i = 0; i < 600 && same; i++) {
+		same &= lib8080_run_ahead(machines[0], LIB8080_FRAME_CYCLES, 2 * LIB8080_FRAME_CYCLES, ahead) ==
+		        lib8080_run(machines[1], LIB8080_FRAME_CYCLES);
+	}
+	same &= memcmp(lib8080_memory(machines[0]), lib8080_memory(machines[1]), 0x10000) == 0 &&
+	        lib8080_cycles(machines[0]) == lib8080_cycles(machines[1]);
+	lib8080_run(machines[1], 2 * LIB8080_FRAME_CYCLES);
+	lib8080_render(machines[1], later);
+	same &= memcmp(ahead, later, sizeof(later)) == 0;
+	for(i = 0; i < 2; i++) {
+		lib8080_destroy(machines[i]);
+	}
+	return same;
+}
+
+/* The stack, LHLD and SHLD wrap around the top of memory instead of running off its end */
+static int stackWrap(void) {
+	static const uint8_t START[4] = {0x31, 0xff, 0xff, 0xc9}; /* LXI SP,FFFF / RET, to 0x3100 */
+	static const uint8_t RETURN[2] = {0x00, 0x31}; /* At 0xffff and 0x0000 */
+	static const uint8_t PROGRAM[24] = {
+		0x31, 0x00, 0x00, /* LXI SP,0000 */
+		0x01, 0x34, 0x12, /* LXI B,1234 */
+		0xc5, /* PUSH B */
+		0x3e, 0x56, /* MVI A,56 */
+		0x31, 0x01, 0x00, /* LXI SP,0001 */
+		0xf5, /* PUSH PSW */
+		0x2a, 0xff, 0xff, /* LHLD FFFF */
+		0x54, 0x5d, /* MOV D,H / MOV E,L */
+		0x21, 0xcd, 0xab, /* LXI H,ABCD */
+		0x22, 0xff, 0xff /* SHLD FFFF */
+	};
+	static const uint8_t HALT = 0x76;
+	lib8080_machine *machine = lib8080_create();
+	lib8080_registers registers;
+	const uint8_t *memory;
+	int ok;
+	memset(&registers, 0, sizeof(registers));
+	registers.pc = 0x3000;
+	ok = machine != NULL && lib8080_load_rom(machine, START, sizeof(START), 0x3000) == LIB8080_OK &&
+	     lib8080_load_rom(machine, RETURN, 1, 0xffff) == LIB8080_OK &&
+	     lib8080_load_rom(machine, RETURN + 1, 1, 0x0000) == LIB8080_OK &&
+	     lib8080_load_rom(machine, PROGRAM, sizeof(PROGRAM), 0x3100) == LIB8080_OK &&
+	     lib8080_load_rom(machine, &HALT, 1, 0x3100 + sizeof(PROGRAM)) == LIB8080_OK;
+	if(!ok) {
+		lib8080_destroy(machine);
+		return 0;
+	}
+	lib8080_set_registers(machine, &registers);
+	lib8080_run(machine, 300);
+	lib8080_get_registers(machine, &registers);
+	memory = lib8080_memory(machine);
+	ok = registers.halted && registers.sp == 0xffff && memory[0xfffe] == 0x34 && registers.d == 0x56 &&
+	     registers.e == registers.flags && memory[0xffff] == 0xcd && memory[0x0000] == 0xab;
+	lib8080_destroy(machine);
+	return ok;
+}
+
+/* Running into the top of memory carries on at 0x0000, fetching the opcode and operands there */
+static int pcWrap(void) {
+	static const uint8_t JUMP[3] = {0xc3, 0xfe, 0xff}; /* JMP FFFE */
+	static const uint8_t TOP[2] = {0x00, 0x3e}; /* NOP, MVI A, with its operand at 0x0000 */
+	static const uint8_t BOTTOM[2] = {0x42, 0x76}; /* 42 / HLT */
+	lib8080_machine *machine = lib8080_create();
+	lib8080_registers registers;
+	int ok;
+	memset(&registers, 0, sizeof(registers));
+	registers.pc = 0x3000;
+	ok = machine != NULL && lib8080_load_rom(machine, JUMP, sizeof(JUMP), 0x3000) == LIB8080_OK &&
+	     lib8080_load_rom(machine, TOP, sizeof(TOP), 0xfffe) == LIB8080_OK &&
+	     lib8080_load_rom(machine, BOTTOM, sizeof(BOTTOM), 0x0000) == LIB8080_OK;
+	if(!ok) {
+		lib8080_destroy(machine);
+		return 0;
+	}
+	lib8080_set_registers(machine, &registers);
+	lib8080_run(machine, 100);
+	lib8080_get_registers(machine, &registers);
+	ok = registers.halted && registers.a == 0x42 && registers.pc == 0x0002;
+	lib8080_destroy(machine);
+	return ok;
+}
+
+/* The undocumented opcodes run as the 8080's aliases of NOP, JMP, RET and CALL, cycles and all */
+static int undocumented(void) {
+	static const uint8_t PROGRAM[22] = {
+		0x31, 0x00, 0x40, /* LXI SP,4000 */
+		0x08, 0x10, 0x18, 0x20, 0x28, 0x30, 0x38, /* NOPs */
+		0xdd, 0x20, 0x30, /* CALL 3020 */
+		0xed, 0x20, 0x30, /* CALL 3020 */
+		0xfd, 0x20, 0x30, /* CALL 3020 */
+		0xcb, 0x30, 0x30 /* JMP 3030 */
+	};
+	static const uint8_t SUBROUTINE[2] = {0x3c, 0xd9}; /* INR A / RET */
+	static const uint8_t HALT = 0x76;
+	lib8080_machine *machine = lib8080_create();
+	lib8080_registers registers;
+	int ok;
+	memset(&registers, 0, sizeof(registers));
+	registers.pc = 0x3000;
+	ok = machine != NULL && lib8080_load_rom(machine, PROGRAM, sizeof(PROGRAM), 0x3000) == LIB8080_OK &&
+	     lib8080_load_rom(machine, SUBROUTINE, sizeof(SUBROUTINE), 0x3020) == LIB8080_OK &&
+	     lib8080_load_rom(machine, &HALT, 1, 0x3030) == LIB8080_OK;
+	if(!ok) {
+		lib8080_destroy(machine);
+		return 0;
+	}
+	lib8080_set_registers(machine, &registers);
+	lib8080_run(machine, 300);
+	lib8080_get_registers(machine, &registers);
+	ok = registers.halted && registers.a == 3 && registers.sp == 0x4000 && registers.pc == 0x3031 &&
+	     lib8080_cycles(machine) == 10 + 7 * 4 + 3 * (17 + 5 + 10) + 10 + 7;
+	lib8080_destroy(machine);
+	return ok;
+}
+
+int main(int argc, char *argv[]) {
+	static uint8_t program[0x10000];
+	struct Host host;
+	lib8080_registers registers;
+	uint8_t *snapshot;
+	size_t size = 0;
+	size_t programSize;
+	uint64_t end;
+	char firstRun[OUTPUT_SIZE];
+	int ok = 1;
+	long rewards;
+	int dones;
+	int moreDones;
+	programSize = readFile(argc > 1 ? argv[1] : "cpudiag.bin", program, sizeof(program));
+
+	ok &= check(lib8080_version() == LIB8080_VERSION, "version");
+	host.machine = lib8080_create();
+	ok &= check(lib8080_load_rom(host.machine, program, 2, 0xffff) == LIB8080_INVALID_ARGUMENT, "ROM past the end");
+	ok &= check(stackWrap(), "stack wrap-around");
+	ok &= check(pcWrap(), "PC wrap-around");
+	ok &= check(undocumented(), "undocumented opcodes");
+
+	boot(&host, program, programSize);
+	registers.a = 0x12;
+	registers.b = 0x34;
+	registers.flags = 0xd7;
+	registers.pc = TPA;
+	registers.sp = 0xff00;
+	registers.c = registers.d = registers.e = registers.h = registers.l = 0;
+	registers.int_enable = registers.halted = 0;
+	lib8080_set_registers(host.machine, &registers);
+	memset(&registers, 0, sizeof(registers));
+	lib8080_get_registers(host.machine, &registers);
+	ok &= check(registers.a == 0x12 && registers.b == 0x34 && registers.flags == 0xd7, "registers");
+
+	finish(&host);
+	ok &= check(strstr(host.output, "CPU IS OPERATIONAL") != NULL, "cpudiag");
+	printf("%s\n", host.output);
+	strcpy(firstRun, host.output);
+
+	/* Snapshot partway, run to the end, then restore and run it again */
+	boot(&host, program, programSize);
+	lib8080_run(host.machine, 2000);
+	ok &= check(lib8080_snapshot(host.machine, NULL, 0, &size) == LIB8080_BUFFER_TOO_SMALL && size > 0 &&
+	            size <= lib8080_snapshot_max_size(), "snapshot size");
+	snapshot = (uint8_t *) malloc(size);
+	ok &= check(lib8080_snapshot(host.machine, snapshot, size, &size) == LIB8080_OK, "snapshot");
+	finish(&host);
+	end = lib8080_cycles(host.machine);
+	host.length = 0;
+	host.output[0] = '\0';
+	ok &= check(lib8080_restore(host.machine, snapshot, size) == LIB8080_OK, "restore");
+	lib8080_get_registers(host.machine, &registers);
+	ok &= check(!registers.halted, "restored state");
+	finish(&host);
+	ok &= check(strlen(host.output) > 0 && strstr(firstRun, host.output) != NULL && lib8080_cycles(host.machine) == end,
+	            "rerun from snapshot");
+
+	snapshot[size / 2] ^= 0x01;
+	ok &= check(lib8080_restore(host.machine, snapshot, size) == LIB8080_BAD_SNAPSHOT, "corrupt snapshot");
+	ok &= check(lib8080_restore(host.machine, snapshot, 10) == LIB8080_BAD_SNAPSHOT, "truncated snapshot");
+
+	free(snapshot);
+	lib8080_destroy(host.machine);
+	ok &= check(lib8080_coverage(NULL, 0, &size) == LIB8080_INVALID_ARGUMENT ||
+	            (size == LIB8080_COVERAGE_SIZE && size <= sizeof(program) &&
+	             lib8080_coverage(program, sizeof(program), &size) == LIB8080_OK && memcmp(program, "8080COV", 8) == 0 &&
+	             (program[10 + 0x100 / 8] & 1)), "coverage");
+
+	programSize = readFile(argc > 2 ? argv[2] : "invaders", program, sizeof(program));
+	ok &= check(lib8080_vecenv_create(program, 16, GAMES, 1) == NULL, "ROM that doesn't start");
+	rewards = playGames(program, programSize, 1, &dones);
+	ok &= check(rewards > 0 && dones > 0, "vectorized games");
+	ok &= check(playGames(program, programSize, 3, &moreDones) == rewards && moreDones == dones, "on 3 threads");
+	ok &= check(shareRom(program, programSize), "shared ROM");
+	ok &= check(runAhead(program, programSize), "run ahead");
+	printf(ok ? "PASS\n" : "FAIL\n");
+	return ok ? 0 : 1;
+}
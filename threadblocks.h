@@ -0,0 +1,90 @@
+#ifndef THREADBLOCKS_H
+#define THREADBLOCKS_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// A block per thread for the counters and coverage, so a thread writes only its own cache lines
+// and can use plain loads and stores while snapshots read every block from other threads.
+// Blocks live for the whole run, so snapshots need no locking and what threads that have exited
+// did still adds up. A thread takes a block the first time it asks and gives it back when it
+// exits, for a new thread to reuse. Threads that find all Size taken share a block that
+// snapshots leave out, and keep that one until they exit. There is one pool per Block type.
+template<typename Block, int Size>
+class ThreadBlocks {
+public:
+	// The calling thread's block
+	static Block &local() {
+		return threadBlock ? *threadBlock : take();
+	}
+
+	// Blocks that have been taken, which snapshots read through block()
+	static int used() {
+		return blocksUsed;
+	}
+
+	static const Block &block(int i) {
+		return blocks[i];
+	}
+
+	// Sends what the calling thread writes to the shared block until it's resumed, for work that
+	// is going to be undone. Costs the writes nothing, they just go somewhere else.
+	static void suspend(bool suspended) {
+		threadBlock = suspended ? &overflow : owner.block;
+	}
+
+	// Threads that got the shared block, since the start of the run
+	static uint64_t overflowed() {
+		return overflowThreads;
+	}
+
+private:
+	// Gives the thread's block back when it exits
+	struct Owner {
+		Block *block = nullptr;
+		~Owner() {
+			if(block && block != &overflow) {
+				std::lock_guard<std::mutex> lock(poolMutex);
+				freeBlocks.push_back(block - blocks);
+			}
+		}
+	};
+
+	static __attribute__((noinline)) Block &take() {
+		std::lock_guard<std::mutex> lock(poolMutex);
+		if(!freeBlocks.empty()) {
+			threadBlock = &blocks[freeBlocks.back()];
+			freeBlocks.pop_back();
+		} else if(blocksUsed < Size) {
+			threadBlock = &blocks[blocksUsed++];
+		} else {
+			threadBlock = &overflow;
+			overflowThreads++;
+		}
+		owner.block = threadBlock;
+		return *threadBlock;
+	}
+
+	static Block blocks[Size];
+	static Block overflow;
+	static std::atomic<int> blocksUsed;
+	static std::atomic<uint64_t> overflowThreads;
+	static std::mutex poolMutex;
+	static std::vector<int> freeBlocks;
+	static thread_local Owner owner;
+	// The same pointer without a destructor, so reaching it needs no initialization check
+	static thread_local Block *threadBlock;
+};
+
+template<typename Block, int Size> Block ThreadBlocks<Block, Size>::blocks[Size];
+template<typename Block, int Size> Block ThreadBlocks<Block, Size>::overflow;
+template<typename Block, int Size> std::atomic<int> ThreadBlocks<Block, Size>::blocksUsed{0};
+template<typename Block, int Size> std::atomic<uint64_t> ThreadBlocks<Block, Size>::overflowThreads{0};
+template<typename Block, int Size> std::mutex ThreadBlocks<Block, Size>::poolMutex;
+template<typename Block, int Size> std::vector<int> ThreadBlocks<Block, Size>::freeBlocks;
+template<typename Block, int Size> thread_local typename ThreadBlocks<Block, Size>::Owner ThreadBlocks<Block, Size>::owner;
+template<typename Block, int Size> thread_local Block *ThreadBlocks<Block, Size>::threadBlock = nullptr;
+
+#endif
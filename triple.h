@@ -0,0 +1,54 @@
+#ifndef TRIPLE_H
+#define TRIPLE_H
+
+#include <array>
+#include <atomic>
+
+#include "cpu.h"
+
+// Lock-free triple buffer for exactly one producer thread and one consumer thread. The producer
+// always has a buffer of its own to fill and never waits; the consumer always gets the newest
+// complete one, skipping any it was too slow for. The third buffer sits in the middle and the
+// two sides swap theirs with it.
+template<typename T>
+class TripleBuffer {
+public:
+	// Producer: the buffer to fill next
+	T &back() {
+		return buffers[producer.index];
+	}
+
+	// Producer: hands back() over, the consumer sees it on its next update()
+	void publish() {
+		producer.index = middle.exchange(producer.index | FRESH, std::memory_order_acq_rel) & INDEX;
+	}
+
+	// Consumer: switches front() to the newest published buffer, false if there isn't a new one
+	bool update() {
+		if(!(middle.load(std::memory_order_relaxed) & FRESH)) {
+			return false;
+		}
+		consumer.index = middle.exchange(consumer.index, std::memory_order_acq_rel) & INDEX;
+		return true;
+	}
+
+	// Consumer
+	const T &front() const {
+		return buffers[consumer.index];
+	}
+
+private:
+	static const int INDEX = 0x03;
+	static const int FRESH = 0x04; // Published since the consumer last took it
+
+	struct alignas(CACHE_LINE_SIZE) Side {
+		int index;
+	};
+
+	std::array<T, 3> buffers;
+	Side producer{0};
+	Side consumer{1};
+	alignas(CACHE_LINE_SIZE) std::atomic<int> middle{2};
+};
+
+#endif
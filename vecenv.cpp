@@ -0,0 +1,161 @@
+#include "vecenv.h"
+#include "rom.h"
+#include "savestate.h"
+#include "warmstart.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+const uint8_t BITS_SET[4] = {0, 1, 1, 2};
+const uint8_t LEVELS[5] = {0, 64, 128, 191, 255}; // By how many of the 4 pixels are lit
+
+static int32_t fromBcd(uint8_t value) {
+	return (value >> 4) * 10 + (value & 0x0f);
+}
+
+static void observe(VecEnv &env, int game, int32_t lastScore, bool done) {
+	const uint8_t *ram = env.machines[game].cpu->RAM;
+	const uint8_t *vram = ram + VRAM_START;
+	uint8_t *pixels = env.observations.pixels + game * OBSERVATION_PIXELS;
+	for(int x = 0; x < OBSERVATION_WIDTH; x++) { // Two lines of VRAM, two columns on screen
+		const uint8_t *left = vram + x * 64;
+		const uint8_t *right = left + 32;
+		for(int column = 0; column < 32; column++) {
+			for(int pair = 0; pair < 4; pair++) {
+				int lit = BITS_SET[(left[column] >> (pair * 2)) & 3] + BITS_SET[(right[column] >> (pair * 2)) & 3];
+				int y = OBSERVATION_HEIGHT - 1 - (column * 4 + pair);
+				pixels[y * OBSERVATION_WIDTH + x] = LEVELS[lit];
+			}
+		}
+	}
+	int32_t score = fromBcd(ram[P1_SCORE + 1]) * 100 + fromBcd(ram[P1_SCORE]);
+	env.observations.scores[game] = score;
+	env.observations.rewards[game] = score - lastScore;
+	env.observations.lives[game] = ram[P1_SHIPS];
+	env.observations.dones[game] = done;
+}
+
+static void resetGame(VecEnv &env, int game) {
+	restoreSnapshot(env.machines[game], env.start);
+	observe(env, game, 0, false);
+}
+
+static void stepGame(VecEnv &env, int game) {
+	if(env.observations.dones[game]) {
+		resetGame(env, game);
+	}
+	Machine &machine = env.machines[game];
+	uint8_t action = env.actions[game];
+	machine.inputs = (action & ACTION_FIRE ? INPUT_P1_FIRE : 0) | (action & ACTION_LEFT ? INPUT_P1_LEFT : 0) |
+	                 (action & ACTION_RIGHT ? INPUT_P1_RIGHT : 0);
+	bool running = runFrame(machine);
+	observe(env, game, env.observations.scores[game], !running || !machine.cpu->RAM[GAME_MODE]);
+}
+
+// Takes games until there are none left. A game that fails is done, so the next step starts it
+// over, rather than taking down a worker thread.
+static void runJob(VecEnv &env) {
+	for(int game = env.next.fetch_add(1); game < env.count; game = env.next.fetch_add(1)) {
+		try {
+			if(env.job == VecEnvJob::Reset) {
+				resetGame(env, game);
+			} else {
+				stepGame(env, game);
+			}
+		} catch(const std::exception &) {
+			env.observations.dones[game] = true;
+		}
+	}
+}
+
+static void work(VecEnv *env) {
+	uint64_t generation = 0;
+	std::unique_lock<std::mutex> lock(env->mutex);
+	for(;;) {
+		env->wake.wait(lock, [&] { return env->stopping || env->generation != generation; });
+		if(env->stopping) {
+			return;
+		}
+		generation = env->generation;
+		lock.unlock();
+		runJob(*env);
+		lock.lock();
+		if(--env->working == 0) {
+			env->finished.notify_one();
+		}
+	}
+}
+
+// The calling thread works on the job too, then waits for the rest to finish theirs
+static void runOnPool(VecEnv &env, VecEnvJob job, const uint8_t *actions) {
+	{
+		std::lock_guard<std::mutex> lock(env.mutex);
+		env.job = job;
+		env.actions = actions;
+		env.next = 0;
+		env.working = (int) env.workers.size();
+		env.generation++;
+	}
+	env.wake.notify_all();
+	runJob(env);
+	std::unique_lock<std::mutex> lock(env.mutex);
+	env.finished.wait(lock, [&] { return env.working == 0; });
+}
+
+void startVecEnv(VecEnv &env, const uint8_t *rom, std::size_t size, int count, int threads) {
+	if(count <= 0 || size > RAM_SIZE) {
+		throw std::runtime_error("Invalid game count or ROM size!");
+	}
+	env.count = count;
+	env.machines.reset(new Machine[count]);
+	// All of them read one copy of the ROM, which restoring the snapshot leaves alone
+	SharedRom shared(rom, size, 0x0000);
+	for(int game = 0; game < count; game++) {
+		mapRom(*env.machines[game].cpu, shared);
+	}
+
+	// Every game starts from the same state, a snapshot of the first one just after 1 player start
+	Machine &first = env.machines[0];
+	if(!runToWarmStart(first, WarmStart::Game)) {
+		throw std::runtime_error("ROM didn't start a game!");
+	}
+	takeSnapshot(first, env.start);
+
+	std::size_t pixels = count * OBSERVATION_PIXELS;
+	env.buffer.assign(pixels + count * (sizeof(int32_t) * 2 + 2), 0x00);
+	env.observations.pixels = env.buffer.data();
+	env.observations.scores = reinterpret_cast<int32_t *>(env.buffer.data() + pixels);
+	env.observations.rewards = env.observations.scores + count;
+	env.observations.lives = reinterpret_cast<uint8_t *>(env.observations.rewards + count);
+	env.observations.dones = env.observations.lives + count;
+
+	if(threads <= 0) {
+		threads = std::max(1, (int) std::thread::hardware_concurrency());
+	}
+	threads = std::min(threads, count);
+	env.stopping = false;
+	for(int i = 1; i < threads; i++) {
+		env.workers.emplace_back(work, &env);
+	}
+	resetVecEnv(env);
+}
+
+void stepVecEnv(VecEnv &env, const uint8_t *actions) {
+	runOnPool(env, VecEnvJob::Step, actions);
+}
+
+void resetVecEnv(VecEnv &env) {
+	runOnPool(env, VecEnvJob::Reset, nullptr);
+}
+
+void stopVecEnv(VecEnv &env) {
+	{
+		std::lock_guard<std::mutex> lock(env.mutex);
+		env.stopping = true;
+	}
+	env.wake.notify_all();
+	for(std::thread &worker : env.workers) {
+		worker.join();
+	}
+	env.workers.clear();
+}
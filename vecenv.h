@@ -0,0 +1,73 @@
+#ifndef VECENV_H
+#define VECENV_H
+
+#include "machine.h"
+#include "video.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Observations are the screen at half resolution, monochrome
+const int OBSERVATION_WIDTH = SCREEN_WIDTH / 2;
+const int OBSERVATION_HEIGHT = SCREEN_HEIGHT / 2;
+const std::size_t OBSERVATION_PIXELS = OBSERVATION_WIDTH * OBSERVATION_HEIGHT;
+
+// One byte per game and step, any combination
+enum ActionBits {
+	ACTION_FIRE = 0x01,
+	ACTION_LEFT = 0x02,
+	ACTION_RIGHT = 0x04
+};
+
+// Arrays with an entry per game, all in VecEnv::buffer
+struct Observations {
+	uint8_t *pixels; // Games x OBSERVATION_HEIGHT x OBSERVATION_WIDTH, how much of each 2x2 block is lit, 0 to 255
+	int32_t *scores; // Player 1's
+	int32_t *rewards; // Points scored in the last step
+	uint8_t *lives; // Spare ships
+	uint8_t *dones; // The game ended in the last step; it starts again on the next
+};
+
+enum class VecEnvJob {
+	Reset,
+	Step
+};
+
+// A batch of Space Invaders games for training agents. Each step runs every game for a frame on
+// a pool of threads and writes the observations into one buffer allocated up front, so stepping
+// allocates nothing and copies nothing else.
+struct VecEnv {
+	std::vector<uint8_t> start; // Snapshot, ROM included, of a game just after 1 player start
+	int count = 0;
+	std::unique_ptr<Machine[]> machines;
+	std::vector<uint8_t> buffer;
+	Observations observations;
+	// The thread pool. Each job hands out games through next until they run out.
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable finished;
+	uint64_t generation = 0; // Bumped for each job
+	int working = 0; // Workers still on the current job
+	bool stopping = false;
+	VecEnvJob job = VecEnvJob::Step;
+	const uint8_t *actions = nullptr;
+	std::atomic<int> next{0};
+};
+
+// Starts count games of the given ROM, using up to threads threads including the caller's (0 for
+// one per core). Throws if the ROM doesn't start a game.
+void startVecEnv(VecEnv &env, const uint8_t *rom, std::size_t size, int count, int threads);
+// Runs each game a frame with its action, restarting the ones that ended in the last step
+void stepVecEnv(VecEnv &env, const uint8_t *actions);
+// Starts every game over
+void resetVecEnv(VecEnv &env);
+void stopVecEnv(VecEnv &env);
+
+#endif
@@ -0,0 +1,65 @@
+// Runs a CP/M program (cpudiag.bin unless another is given) once through emulate8080() alone
+// and once through code recompiled from it with the interpreter as fallback, then checks both
+// runs printed the same thing and finished in the same state after the same number of cycles.
+//
+// recompiler cpudiag.bin 100 cpudiag_recompiled.cpp
+// g++ -O2 cpu.cpp cpm.cpp cpudiag_recompiled.cpp verify_recompiled.cpp -o verify_recompiled
+//
+// rst7.bin covers the opcodes at the end of the recompiler's tables: it points RST 7's vector
+// at a routine that prints "RST 7 ", calls one that prints "CM " with CM once with S clear and
+// once with it set, then prints "DONE".
+//   0100  LXI SP,F000 / MVI A,C3 / STA 0038 / LXI H,0140 / SHLD 0039
+//   010e  MVI A,01 / ORA A / CM 0150 / SUI 02 / CM 0150 / RST 7
+//   011a  LXI D,0160 / MVI C,09 / CALL 0005 / JMP 0000
+//   0140  LXI D,0170 / MVI C,09 / CALL 0005 / RET
+//   0150  LXI D,0180 / MVI C,09 / CALL 0005 / RET
+#include "cpm.h"
+#include "cpu.h"
+#include "recompiled.h"
+
+#include <cstring>
+#include <iostream>
+#include <string>
+
+using std::cout;
+using std::endl;
+
+// Exits into the interpreter whenever the recompiled code does, like runCPM() but checking
+// every exit
+CPM diagnose(const char *fileName, bool recompiled) {
+	CPM cpm;
+	cpm.console = nullptr;
+	loadCom(cpm, fileName);
+
+	while(cpm.cpu->PC != CPM_WARM_BOOT) {
+		if(cpm.cpu->PC == CPM_BDOS) {
+			bdosCall(cpm);
+			continue;
+		}
+		int cycles = recompiled ? runRecompiled(cpm.cpu, 100) : 0; // Small slices to exercise every exit
+		if(cycles == 0) {
+			cycles = emulate8080(cpm.cpu);
+		}
+		cpm.cycles += cycles;
+	}
+	return cpm;
+}
+
+int main(int argc, char *argv[]) {
+	const char *fileName = argc > 1 ? argv[1] : "cpudiag.bin";
+	CPM interpreted = diagnose(fileName, false);
+	CPM recompiled = diagnose(fileName, true);
+	const CPU &a = *interpreted.cpu;
+	const CPU &b = *recompiled.cpu;
+
+	cout << "Interpreter:" << interpreted.output << endl;
+	cout << "Recompiled: " << recompiled.output << endl;
+	bool same = interpreted.output == recompiled.output &&
+	            interpreted.cycles == recompiled.cycles &&
+	            a.A == b.A && a.BC == b.BC && a.DE == b.DE && a.HL == b.HL &&
+	            a.SP == b.SP && a.PC == b.PC && a.int_enable == b.int_enable &&
+	            getFlags(a.f) == getFlags(b.f) &&
+	            std::memcmp(a.RAM, b.RAM, RAM_SIZE) == 0;
+	cout << std::dec << interpreted.cycles << " cycles: " << (same ? "PASS" : "FAIL") << endl;
+	return same ? 0 : 1;
+}
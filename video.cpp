@@ -0,0 +1,217 @@
+#include "video.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/uio.h>
+#include <unistd.h>
+
+const uint8_t WHITE[3] = {0xff, 0xff, 0xff};
+const uint8_t RED[3] = {0xff, 0x20, 0x20};
+const uint8_t GREEN[3] = {0x20, 0xff, 0x20};
+
+// The strips of coloured cellophane on the cabinet glass
+static const uint8_t *overlay(int x, int y) {
+	if(y >= 32 && y < 64) {
+		return RED; // Scores and UFO
+	}
+	if((y >= 184 && y < 240) || (y >= 240 && x >= 16 && x < 134)) {
+		return GREEN; // Shields, player and spare lives
+	}
+	return WHITE;
+}
+
+void convertFrame(const uint8_t *vram, uint8_t *rgba) {
+	std::memset(rgba, 0, SCREEN_WIDTH * SCREEN_HEIGHT * 4);
+	for(int x = 0; x < SCREEN_WIDTH; x++) { // Each line of VRAM is a column on screen, bottom up
+		const uint8_t *line = vram + x * 32;
+		for(int column = 0; column < 32; column++) {
+			uint8_t bits = line[column];
+			for(int bit = 0; bits; bit++, bits >>= 1) {
+				if(bits & 1) {
+					int y = SCREEN_HEIGHT - 1 - (column * 8 + bit);
+					uint8_t *pixel = rgba + (y * SCREEN_WIDTH + x) * 4;
+					std::memcpy(pixel, overlay(x, y), 3);
+				}
+			}
+		}
+	}
+	for(int i = 3; i < SCREEN_WIDTH * SCREEN_HEIGHT * 4; i += 4) {
+		rgba[i] = 0xff; // Opaque black background
+	}
+}
+
+static bool convertNewest(Video &video) {
+	if(!video.vram.update()) {
+		return false;
+	}
+	const VramFrame &frame = video.vram.front();
+	convertFrame(frame.vram.data(), video.framebuffer.data());
+	video.lastFrame = frame.frame;
+	video.converted++;
+	return true;
+}
+
+// Video thread: converts frames as they're published until stopVideo()
+static void runVideo(Video *video) {
+	for(;;) {
+		bool running = video->running.load(std::memory_order_acquire);
+		if(!convertNewest(*video)) {
+			if(!running) {
+				break;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+}
+
+void startVideo(Video &video) {
+	video.running = true;
+	video.thread = std::thread(runVideo, &video);
+}
+
+void publishFrame(Video &video, const uint8_t *vram) {
+	VramFrame &frame = video.vram.back();
+	std::memcpy(frame.vram.data(), vram, VRAM_SIZE);
+	frame.frame = ++video.frames;
+	video.vram.publish();
+}
+
+void stopVideo(Video &video) {
+	if(!video.thread.joinable()) {
+		return;
+	}
+	video.running.store(false, std::memory_order_release);
+	video.thread.join();
+}
+
+static const char Y4M_HEADER[] = "YUV4MPEG2 W224 H256 F60:1 Ip A1:1 C420jpeg XYSCSS=420JPEG\n";
+static const char Y4M_FRAME[] = "FRAME\n";
+
+// Full range BT.601, as JPEG uses
+static void toYuv420(const uint8_t *rgba, uint8_t *planes) {
+	uint8_t *luma = planes;
+	uint8_t *cb = luma + SCREEN_WIDTH * SCREEN_HEIGHT;
+	uint8_t *cr = cb + SCREEN_WIDTH * SCREEN_HEIGHT / 4;
+	for(int i = 0; i < SCREEN_WIDTH * SCREEN_HEIGHT; i++) {
+		const uint8_t *pixel = rgba + i * 4;
+		luma[i] = (77 * pixel[0] + 150 * pixel[1] + 29 * pixel[2] + 128) >> 8;
+	}
+	for(int y = 0; y < SCREEN_HEIGHT; y += 2) { // Each chroma sample is the average of 2x2 pixels
+		for(int x = 0; x < SCREEN_WIDTH; x += 2) {
+			int rgb[3] = {};
+			for(int corner = 0; corner < 4; corner++) {
+				const uint8_t *pixel = rgba + ((y + corner / 2) * SCREEN_WIDTH + x + corner % 2) * 4;
+				for(int c = 0; c < 3; c++) {
+					rgb[c] += pixel[c];
+				}
+			}
+			int i = y / 2 * (SCREEN_WIDTH / 2) + x / 2;
+			cb[i] = (uint8_t) (((-43 * rgb[0] - 85 * rgb[1] + 128 * rgb[2] + 512) >> 10) + 128);
+			cr[i] = (uint8_t) (((128 * rgb[0] - 107 * rgb[1] - 21 * rgb[2] + 512) >> 10) + 128);
+		}
+	}
+}
+
+// Writes all of them, picking up where a partial write to a pipe left off
+static bool writeAll(int fd, iovec *vectors, int count) {
+	while(count > 0) {
+		ssize_t written = writev(fd, vectors, std::min(count, IOV_MAX));
+		if(written < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+		for(; count > 0 && (std::size_t) written >= vectors->iov_len; vectors++, count--) {
+			written -= vectors->iov_len;
+		}
+		if(count > 0) {
+			vectors->iov_base = static_cast<uint8_t *>(vectors->iov_base) + written;
+			vectors->iov_len -= written;
+		}
+	}
+	return true;
+}
+
+// The pending repeats of the frame in the buffers
+static bool flushCapture(Capture &capture) {
+	iovec vectors[CAPTURE_BATCH * 2];
+	int count = 0;
+	for(int i = 0; i < capture.pending; i++) {
+		if(capture.format == CaptureFormat::Y4m) {
+			vectors[count++] = {const_cast<char *>(Y4M_FRAME), sizeof(Y4M_FRAME) - 1};
+			vectors[count++] = {capture.planes.data(), capture.planes.size()};
+		} else {
+			vectors[count++] = {capture.rgba.data(), capture.rgba.size()};
+		}
+	}
+	bool written = writeAll(capture.fd, vectors, count);
+	capture.frames += written ? capture.pending : 0;
+	capture.pending = 0;
+	return written;
+}
+
+void startCapture(Capture &capture, const std::string &fileName, CaptureFormat format) {
+	std::signal(SIGPIPE, SIG_IGN); // A reader going away shows up as a failed write instead
+	capture.ownsFd = fileName != "-";
+	capture.fd = capture.ownsFd ? open(fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644) : STDOUT_FILENO;
+	if(capture.fd < 0) {
+		throw std::runtime_error("Could not open file!");
+	}
+	capture.format = format;
+	if(format == CaptureFormat::Y4m) {
+		iovec header = {const_cast<char *>(Y4M_HEADER), sizeof(Y4M_HEADER) - 1};
+		if(!writeAll(capture.fd, &header, 1)) {
+			throw std::runtime_error("Could not write file!");
+		}
+	}
+}
+
+bool captureFrame(Capture &capture, const uint8_t *vram) {
+	bool same = capture.converted && std::memcmp(capture.vram.data(), vram, VRAM_SIZE) == 0;
+	if(!same || capture.pending == CAPTURE_BATCH) {
+		if(capture.pending && !flushCapture(capture)) {
+			return false;
+		}
+	}
+	if(!same) {
+		std::memcpy(capture.vram.data(), vram, VRAM_SIZE);
+		convertFrame(vram, capture.rgba.data());
+		if(capture.format == CaptureFormat::Y4m) {
+			toYuv420(capture.rgba.data(), capture.planes.data());
+		}
+		capture.converted++;
+	}
+	capture.pending++;
+	return true;
+}
+
+void stopCapture(Capture &capture) {
+	if(capture.fd < 0) {
+		return;
+	}
+	flushCapture(capture);
+	if(capture.ownsFd) {
+		close(capture.fd);
+	}
+	capture.fd = -1;
+}
+
+void saveScreenshot(const Video &video, const std::string &fileName) {
+	FILE *file = fopen(fileName.c_str(), "wb");
+	if(!file) {
+		throw std::runtime_error("Could not open file!");
+	}
+	fprintf(file, "P6\n%d %d\n255\n", SCREEN_WIDTH, SCREEN_HEIGHT);
+	for(int i = 0; i < SCREEN_WIDTH * SCREEN_HEIGHT; i++) {
+		fwrite(&video.framebuffer[i * 4], 1, 3, file);
+	}
+	fclose(file);
+}
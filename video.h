@@ -0,0 +1,81 @@
+#ifndef VIDEO_H
+#define VIDEO_H
+
+#include "machine.h"
+#include "triple.h"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Space Invaders has a 1 bit per pixel 256x224 bitmap at 0x2400, shown on a monitor rotated a
+// quarter turn counterclockwise, so the picture is 224 wide and 256 tall
+const uint16_t VRAM_START = 0x2400;
+const std::size_t VRAM_SIZE = 0x1c00;
+const int SCREEN_WIDTH = 224;
+const int SCREEN_HEIGHT = 256;
+
+struct VramFrame {
+	std::array<uint8_t, VRAM_SIZE> vram;
+	uint64_t frame; // Since power on
+};
+
+struct Video {
+	// Emulation thread
+	uint64_t frames = 0; // Published
+	// Shared with the video thread
+	TripleBuffer<VramFrame> vram;
+	std::atomic<bool> running{false};
+	// Video thread
+	std::thread thread;
+	std::vector<uint8_t> framebuffer = std::vector<uint8_t>(SCREEN_WIDTH * SCREEN_HEIGHT * 4); // RGBA
+	uint64_t converted = 0; // Frames converted, the others were skipped
+	uint64_t lastFrame = 0; // The one in framebuffer
+};
+
+enum class CaptureFormat {
+	Y4m, // YUV4MPEG2 with 4:2:0 full range chroma at 60 fps, which ffmpeg and most encoders read
+	Rgba // Headerless 224x256 RGBA frames
+};
+
+const int CAPTURE_BATCH = 16; // Repeats of an unchanged frame written with one writev()
+
+// Every frame written to a file, a named pipe or stdout, as fast as whatever reads it takes them.
+// The buffers are allocated once. A frame whose VRAM didn't change isn't converted again, its
+// bytes are just written again, several repeats at a time.
+struct Capture {
+	int fd = -1;
+	bool ownsFd = false; // Not stdout
+	CaptureFormat format = CaptureFormat::Y4m;
+	std::array<uint8_t, VRAM_SIZE> vram; // Of the frame in the buffers
+	std::vector<uint8_t> rgba = std::vector<uint8_t>(SCREEN_WIDTH * SCREEN_HEIGHT * 4);
+	std::vector<uint8_t> planes = std::vector<uint8_t>(SCREEN_WIDTH * SCREEN_HEIGHT * 3 / 2); // Y, Cb, Cr
+	int pending = 0; // Repeats of that frame not written yet
+	uint64_t frames = 0; // Written
+	uint64_t converted = 0;
+};
+
+// Converts a VRAM snapshot into RGBA pixels, rotated and coloured by the cabinet's overlay like
+// the real screen
+void convertFrame(const uint8_t *vram, uint8_t *rgba);
+
+// Starts the video thread, which converts each published frame while the next is emulated
+void startVideo(Video &video);
+// Called by the emulation thread at vblank: copies VRAM (the machine's, or the screen a
+// RunAhead kept) and hands it over without waiting
+void publishFrame(Video &video, const uint8_t *vram);
+// Converts the last published frame and stops the video thread
+void stopVideo(Video &video);
+// Opens fileName, - for stdout, and writes the Y4M header
+void startCapture(Capture &capture, const std::string &fileName, CaptureFormat format);
+// Called by the emulation thread at vblank. Returns false once the reader has gone away.
+bool captureFrame(Capture &capture, const uint8_t *vram);
+// Writes what's still pending and closes the file
+void stopCapture(Capture &capture);
+// Writes the last converted frame as a binary PPM
+void saveScreenshot(const Video &video, const std::string &fileName);
+
+#endif
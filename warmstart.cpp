@@ -0,0 +1,117 @@
+#include "warmstart.h"
+#include "crc32.h"
+#include "savestate.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <vector>
+
+const char *const WARM_START_NAMES[] = {"boot", "attract", "game"};
+
+bool parseWarmStart(const std::string &name, WarmStart &point) {
+	for(int i = 0; i < 3; i++) {
+		if(name == WARM_START_NAMES[i]) {
+			point = static_cast<WarmStart>(i);
+			return true;
+		}
+	}
+	return false;
+}
+
+// Coin pulses until one counts (they're ignored while the game boots), then 1 player start
+// until the ships are dealt and the first is in play
+static bool startGame(Machine &machine, int &frames) {
+	const uint8_t *ram = machine.cpu->RAM;
+	for(; !ram[CREDITS] && frames < WARM_START_FRAMES; frames++) {
+		machine.inputs = frames % 2 ? 0x00 : INPUT_COIN;
+		runFrame(machine);
+	}
+	machine.inputs = INPUT_P1_START;
+	for(; !ram[GAME_MODE] && frames < WARM_START_FRAMES; frames++) {
+		runFrame(machine);
+	}
+	machine.inputs = 0x00;
+	for(; !ram[P1_SHIPS] && frames < WARM_START_FRAMES; frames++) {
+		runFrame(machine);
+	}
+	uint8_t dealt = ram[P1_SHIPS];
+	for(; ram[P1_SHIPS] == dealt && frames < WARM_START_FRAMES; frames++) {
+		runFrame(machine);
+	}
+	return frames < WARM_START_FRAMES;
+}
+
+bool runToWarmStart(Machine &machine, WarmStart point) {
+	int frames = 0;
+	switch(point) {
+		case WarmStart::Boot:
+			for(; !machine.idleCycles && frames < WARM_START_FRAMES; frames++) {
+				runFrame(machine);
+			}
+			break;
+		case WarmStart::Attract:
+			for(; machine.cpu->RAM[SPLASH_TASK] != 1 && frames < WARM_START_FRAMES; frames++) {
+				runFrame(machine);
+			}
+			break;
+		case WarmStart::Game:
+			return startGame(machine, frames);
+	}
+	return frames < WARM_START_FRAMES;
+}
+
+std::string defaultCacheDirectory() {
+	const char *cache = std::getenv("XDG_CACHE_HOME");
+	if(cache && *cache) {
+		return std::string(cache) + "/i8080";
+	}
+	const char *home = std::getenv("HOME");
+	return std::string(home ? home : ".") + "/.cache/i8080";
+}
+
+std::string warmStartFile(const Machine &machine, WarmStart point, const std::string &directory) {
+	char name[64];
+	std::snprintf(name, sizeof(name), "/%08x-%u.%u-%s.state", crc32(machine.cpu->RAM, ROM_SIZE),
+	              (unsigned) EMULATOR_VERSION, (unsigned) SAVE_STATE_VERSION, WARM_START_NAMES[static_cast<int>(point)]);
+	return directory + name;
+}
+
+// Along with any missing parents. Failures aren't checked, saving into a directory that isn't
+// there fails anyway.
+static void makeDirectories(const std::string &directory) {
+	for(std::size_t slash = directory.find('/', 1); ; slash = directory.find('/', slash + 1)) {
+		mkdir(directory.substr(0, slash).c_str(), 0755);
+		if(slash == std::string::npos) {
+			return;
+		}
+	}
+}
+
+WarmStartResult warmStart(Machine &machine, WarmStart point, const std::string &directory, std::string &reason) {
+	std::string fileName = warmStartFile(machine, point, directory);
+	std::vector<uint8_t> powerOn;
+	takeSnapshot(machine, powerOn);
+	try {
+		loadState(machine, fileName);
+		if(std::equal(powerOn.end() - RAM_SIZE, powerOn.end() - RAM_SIZE + ROM_SIZE, machine.cpu->RAM)) {
+			return WarmStartResult::Loaded;
+		}
+	} catch(const std::exception &) {
+		// Not cached yet, or unreadable, so it's made again
+	}
+	restoreSnapshot(machine, powerOn);
+	if(!runToWarmStart(machine, point)) {
+		throw std::runtime_error("ROM didn't reach the warm start!");
+	}
+	try {
+		makeDirectories(directory);
+		saveState(machine, fileName);
+	} catch(const std::exception &e) {
+		reason = e.what(); // It only costs the next run the same emulation
+		return WarmStartResult::NotSaved;
+	}
+	return WarmStartResult::Saved;
+}
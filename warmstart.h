@@ -0,0 +1,50 @@
+#ifndef WARMSTART_H
+#define WARMSTART_H
+
+#include "machine.h"
+
+#include <cstdint>
+#include <string>
+
+// Where Space Invaders keeps its game state
+const uint16_t SPLASH_TASK = 0x20c1; // What the attract mode is doing, 1 while the demo game plays
+const uint16_t CREDITS = 0x20eb;
+const uint16_t GAME_MODE = 0x20ef; // Non-zero while a game is being played
+const uint16_t P1_SCORE = 0x20f8; // BCD, low byte first
+const uint16_t P1_SHIPS = 0x21ff; // Spare ships
+
+// Points Space Invaders reaches from power on, cached on disk as save states so later runs
+// start there with a file read instead of emulating their way to them again
+enum class WarmStart {
+	Boot, // The ROM has set up and waits for an interrupt for the first time
+	Attract, // The attract mode's demo game starts
+	Game // A coin and 1 player start, with the first ship in play
+};
+
+// Bumped whenever the same ROM and inputs take the machine to a different state, so warm starts
+// cached by older builds are made again
+const uint32_t EMULATOR_VERSION = 1;
+const int WARM_START_FRAMES = 1200; // To reach any of them from power on
+
+// "boot", "attract" or "game"; false for anything else
+bool parseWarmStart(const std::string &name, WarmStart &point);
+// From power on, false if the ROM doesn't get there within WARM_START_FRAMES
+bool runToWarmStart(Machine &machine, WarmStart point);
+// $XDG_CACHE_HOME/i8080, or ~/.cache/i8080
+std::string defaultCacheDirectory();
+// Named after the CRC-32 of the ROM in memory, EMULATOR_VERSION and SAVE_STATE_VERSION, so a
+// different ROM or build never picks it up
+std::string warmStartFile(const Machine &machine, WarmStart point, const std::string &directory);
+// How warmStart() got the machine there
+enum class WarmStartResult {
+	Loaded, // From the cache
+	Saved, // Run there and cached for next time
+	NotSaved // Run there, but the cache couldn't be written
+};
+
+// Takes a powered on machine with its ROM loaded to point, restoring it from the cache in
+// directory or running it there and caching it. When it can't be cached, reason says why.
+// Throws if the ROM never gets there.
+WarmStartResult warmStart(Machine &machine, WarmStart point, const std::string &directory, std::string &reason);
+
+#endif
@@ -0,0 +1,70 @@
+#include "watch.h"
+
+#include <iomanip>
+#include <iostream>
+
+void addWatchpoint(Watchpoints &watchpoints, uint16_t address, uint8_t mode) {
+	uint8_t &modes = watchpoints.modes[address];
+	if(!modes && mode) {
+		watchpoints.pages[address >> WATCH_PAGE_SHIFT]++;
+		watchpoints.count++;
+	}
+	modes |= mode;
+}
+
+void removeWatchpoint(Watchpoints &watchpoints, uint16_t address, uint8_t mode) {
+	uint8_t &modes = watchpoints.modes[address];
+	if(modes && !(modes & ~mode)) {
+		watchpoints.pages[address >> WATCH_PAGE_SHIFT]--;
+		watchpoints.count--;
+	}
+	modes &= ~mode;
+}
+
+int emulateWatched(Machine &machine) {
+	Watchpoints &watchpoints = *machine.watchpoints;
+	CPU &cpu = *machine.cpu;
+	uint16_t pc = cpu.PC;
+	DataAccess accesses[MAX_DATA_ACCESSES];
+	uint8_t before[MAX_DATA_ACCESSES];
+	int count = dataAccesses(cpu, pc, accesses);
+	bool watched = false;
+	for(int i = 0; i < count; i++) {
+		if(watchpoints.pages[accesses[i].address >> WATCH_PAGE_SHIFT]) {
+			before[i] = cpu.RAM[accesses[i].address];
+			watched = true;
+		}
+	}
+	int cycles = emulate8080(machine.cpu);
+	if(!watched) {
+		return cycles;
+	}
+
+	for(int i = 0; i < count; i++) {
+		uint16_t address = accesses[i].address;
+		WatchMode mode = accesses[i].write ? WATCH_WRITE : WATCH_READ;
+		if(watchpoints.pages[address >> WATCH_PAGE_SHIFT] && (watchpoints.modes[address] & mode)) {
+			WatchHit hit = {pc, address, mode, before[i], accesses[i].write ? cpu.RAM[address] : before[i], machine.cycles};
+			if(watchpoints.onHit) {
+				watchpoints.onHit(watchpoints.hitContext, hit);
+			} else {
+				printWatchHit(hit, std::cerr);
+			}
+		}
+	}
+	return cycles;
+}
+
+void printWatchHit(const WatchHit &hit, std::ostream &out) {
+	std::ios::fmtflags flags = out.flags();
+	char fill = out.fill();
+	out << std::hex << std::setfill('0') << "Watchpoint " << std::setw(4) << hit.address
+	    << (hit.mode == WATCH_WRITE ? " written" : " read") << " by PC " << std::setw(4) << hit.pc << ": "
+	    << std::setw(2) << (int) hit.oldValue;
+	if(hit.mode == WATCH_WRITE) {
+		out << " -> " << std::setw(2) << (int) hit.newValue;
+	}
+	out << std::dec << " at cycle " << hit.cycle << std::endl;
+	out.flags(flags);
+	out.fill(fill);
+}
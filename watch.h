@@ -0,0 +1,45 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include "machine.h"
+
+#include <array>
+#include <cstdint>
+#include <ostream>
+
+// Read and write watchpoints, in -DDEBUGGER builds. Memory is split into 256 byte pages and
+// only instructions whose data accesses land on a page with a watched address take the slow
+// path, which remembers the old values and checks each access. Accesses to other pages, and
+// instruction fetches, are never checked. With nothing watched the machine runs as usual.
+enum WatchMode {
+	WATCH_READ = 0x01,
+	WATCH_WRITE = 0x02
+};
+
+const int WATCH_PAGE_SHIFT = 8;
+
+struct WatchHit {
+	uint16_t pc; // Of the instruction that made the access
+	uint16_t address;
+	WatchMode mode;
+	uint8_t oldValue; // The same as newValue for reads
+	uint8_t newValue;
+	uint64_t cycle; // When the instruction started
+};
+
+struct Watchpoints {
+	std::array<uint8_t, RAM_SIZE> modes = {}; // WatchMode bits per address
+	std::array<uint16_t, (RAM_SIZE >> WATCH_PAGE_SHIFT)> pages = {}; // Watched addresses per page
+	int count = 0;
+	// Gets every hit, after the instruction has finished. Prints them to stderr when nullptr.
+	void (*onHit)(void *context, const WatchHit &hit) = nullptr;
+	void *hitContext = nullptr;
+};
+
+void addWatchpoint(Watchpoints &watchpoints, uint16_t address, uint8_t mode);
+void removeWatchpoint(Watchpoints &watchpoints, uint16_t address, uint8_t mode);
+// Runs one instruction with machine.watchpoints checked and returns the cycles taken
+int emulateWatched(Machine &machine);
+void printWatchHit(const WatchHit &hit, std::ostream &out);
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef WRITEFILE_H
+#define WRITEFILE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Writes next to the file and renames over it, so readers only ever see a whole file. Used for
+// save states and coverage maps.
+inline void writeFile(const std::string &fileName, const std::vector<uint8_t> &data) {
+	std::string temporary = fileName + ".tmp";
+	{
+		std::ofstream output(temporary, std::ios::binary);
+		if(!output) {
+			throw std::runtime_error("Could not open file!");
+		}
+		output.write(reinterpret_cast<const char *>(data.data()), data.size());
+		if(!output) {
+			throw std::runtime_error("Could not write file!");
+		}
+	}
+	if(std::rename(temporary.c_str(), fileName.c_str()) != 0) {
+		throw std::runtime_error("Could not write file!");
+	}
+}
+
+#endif